@@ -0,0 +1,568 @@
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#include "../constants.h"
+#include "../params.h"
+#include "../molecule.h"
+#include "../particles.h"
+#include "../tree.h"
+#include "../interaction_list.h"
+#include "../clusters.h"
+#include "../boundary_element.h"
+#include "../gmres_blas.h"
+#include "../kernel_costs.h"
+#include "../kernel_policy.h"
+#include "../tabipb_timers.h"
+
+/*  Microbenchmarks for the treecode kernels on a synthetic molecule: random atoms
+ *  packed into a ball at protein density, meshed with the native SES triangulator,
+ *  so no NanoShaper or input files are needed. Each kernel is timed over one full
+ *  sweep of the work a matvec gives it, best of several repeats, and reported with
+ *  the flop and byte models of kernel_costs.h. Results are printed and written as
+ *  CSV, one row per kernel. */
+
+static constexpr double BENCH_VOLUME_PER_ATOM = 12.;   // cubic Angstroms, typical of protein heavy atoms
+static constexpr int    BENCH_BLAS_CALLS      = 100;
+static constexpr long   BENCH_GMRES_RESTART   = 10;
+static constexpr std::size_t BENCH_EXP_POINTS = 1 << 20;
+
+
+struct BenchmarkResult
+{
+    std::string kernel;
+    double calls;
+    double interactions;
+    double flops;
+    double bytes;
+    double seconds;
+};
+
+
+class KernelBenchmark
+{
+private:
+    class Particles& particles_;
+    class Clusters& clusters_;
+    const class Tree& tree_;
+    const class InteractionList& interaction_list_;
+    class BoundaryElement& bem_;
+    const struct Params& params_;
+    int repeats_;
+
+    std::vector<double> potential_old_;
+    std::vector<double> potential_new_;
+
+    std::vector<BenchmarkResult> results_;
+
+    double time_best(const std::function<void()>& sweep) const;
+    void add(const std::string& kernel, double calls, double interactions,
+             double flops, double bytes, const std::function<void()>& sweep);
+
+public:
+    KernelBenchmark(class Particles&, class Clusters&, const class Tree&,
+                    const class InteractionList&, class BoundaryElement&,
+                    const struct Params&, int repeats);
+
+    void run_treecode();
+    void run_precondition();
+    void run_gmres_helpers();
+    void run_exponential();
+
+    void print() const;
+    void write_csv(const std::string& path) const;
+};
+
+
+KernelBenchmark::KernelBenchmark(class Particles& particles, class Clusters& clusters,
+                                 const class Tree& tree, const class InteractionList& interaction_list,
+                                 class BoundaryElement& bem, const struct Params& params, int repeats)
+    : particles_(particles), clusters_(clusters), tree_(tree), interaction_list_(interaction_list),
+      bem_(bem), params_(params), repeats_(repeats)
+{
+    std::mt19937 generator(2718);
+    std::uniform_real_distribution<double> distribution(-1., 1.);
+
+    potential_old_.resize(2 * particles_.num());
+    potential_new_.assign(2 * particles_.num(), 0.);
+    for (auto& value : potential_old_) value = distribution(generator);
+
+    // the cluster kernels read charges, so fill them as a matvec would
+    clusters_.clear_charges();
+    clusters_.upward_pass(potential_old_.data());
+}
+
+
+double KernelBenchmark::time_best(const std::function<void()>& sweep) const
+{
+    double best = std::numeric_limits<double>::max();
+
+    for (int i = 0; i < repeats_; ++i) {
+        Timer timer;
+        timer.start();
+        sweep();
+        timer.stop();
+        best = std::min(best, timer.elapsed_time());
+    }
+
+    return best;
+}
+
+
+void KernelBenchmark::add(const std::string& kernel, double calls, double interactions,
+                          double flops, double bytes, const std::function<void()>& sweep)
+{
+    results_.push_back(BenchmarkResult {kernel, calls, interactions, flops, bytes,
+                                        KernelBenchmark::time_best(sweep)});
+}
+
+
+void KernelBenchmark::run_treecode()
+{
+    double*       potential_new = potential_new_.data();
+    const double* potential_old = potential_old_.data();
+    bool screened = params_.phys_kappa_ > 0.;
+
+    double pp_calls = 0., pp_interactions = 0., pp_bytes = 0.;
+    double pc_calls = 0., pc_interactions = 0., pc_bytes = 0.;
+    double cp_calls = 0., cp_interactions = 0., cp_bytes = 0.;
+    double cc_calls = 0., cc_interactions = 0., cc_bytes = 0.;
+    double mutual_pp_calls = 0., mutual_pp_pairs = 0., mutual_pp_bytes = 0.;
+    double mutual_cc_calls = 0., mutual_cc_pairs = 0., mutual_cc_bytes = 0.;
+
+    for (std::size_t target_node_idx = 0; target_node_idx < tree_.num_nodes(); ++target_node_idx) {
+
+        auto target_idxs = tree_.node_particle_idxs(target_node_idx);
+        std::size_t num_targets = target_idxs[1] - target_idxs[0];
+        std::size_t num_target_interp_pts = clusters_.num_interp_pts_per_node(target_node_idx);
+        double num_target_charges = std::pow(num_target_interp_pts, 3);
+
+        for (auto source_node_idx : interaction_list_.particle_particle(target_node_idx)) {
+            auto source_idxs = tree_.node_particle_idxs(source_node_idx);
+            std::size_t num_sources = source_idxs[1] - source_idxs[0];
+            pp_calls        += 1.;
+            pp_interactions += (double)num_targets * num_sources;
+            pp_bytes        += kernel_costs::pp_bytes(num_targets, num_sources);
+        }
+
+        for (auto source_node_idx : interaction_list_.particle_cluster(target_node_idx)) {
+            std::size_t num_source_interp_pts = clusters_.num_interp_pts_per_node(source_node_idx);
+            pc_calls        += 1.;
+            pc_interactions += num_targets * std::pow(num_source_interp_pts, 3);
+            pc_bytes        += kernel_costs::pc_bytes(num_targets, num_source_interp_pts);
+        }
+
+        for (auto source_node_idx : interaction_list_.cluster_particle(target_node_idx)) {
+            auto source_idxs = tree_.node_particle_idxs(source_node_idx);
+            std::size_t num_sources = source_idxs[1] - source_idxs[0];
+            cp_calls        += 1.;
+            cp_interactions += num_target_charges * num_sources;
+            cp_bytes        += kernel_costs::cp_bytes(num_target_interp_pts, num_sources);
+        }
+
+        for (auto source_node_idx : interaction_list_.cluster_cluster(target_node_idx)) {
+            std::size_t num_source_interp_pts = clusters_.num_interp_pts_per_node(source_node_idx);
+            cc_calls        += 1.;
+            cc_interactions += num_target_charges * std::pow(num_source_interp_pts, 3);
+            cc_bytes        += kernel_costs::cc_bytes(num_target_interp_pts, num_source_interp_pts);
+        }
+
+        for (auto source_node_idx : interaction_list_.mutual_particle_particle(target_node_idx)) {
+            auto source_idxs = tree_.node_particle_idxs(source_node_idx);
+            std::size_t num_sources = source_idxs[1] - source_idxs[0];
+            mutual_pp_calls += 1.;
+            mutual_pp_pairs += (double)num_targets * num_sources;
+            mutual_pp_bytes += kernel_costs::mutual_pp_bytes(num_targets, num_sources);
+        }
+
+        for (auto source_node_idx : interaction_list_.mutual_cluster_cluster(target_node_idx)) {
+            std::size_t num_source_interp_pts = clusters_.num_interp_pts_per_node(source_node_idx);
+            mutual_cc_calls += 1.;
+            mutual_cc_pairs += num_target_charges * std::pow(num_source_interp_pts, 3);
+            mutual_cc_bytes += kernel_costs::mutual_cc_bytes(num_target_interp_pts, num_source_interp_pts);
+        }
+    }
+
+    double upward_interactions = 0., upward_flops = 0., upward_bytes = 0.;
+    double downward_interactions = 0., downward_flops = 0., downward_bytes = 0.;
+
+    for (auto node_idx : clusters_.source_nodes()) {
+        auto particle_idxs = tree_.node_particle_idxs(node_idx);
+        std::size_t num_particles  = particle_idxs[1] - particle_idxs[0];
+        std::size_t num_interp_pts = clusters_.num_interp_pts_per_node(node_idx);
+
+        upward_interactions += num_particles * std::pow(num_interp_pts, 3);
+        upward_flops        += kernel_costs::upward_flops  (num_particles, num_interp_pts);
+        upward_bytes        += kernel_costs::upward_bytes  (num_particles, num_interp_pts);
+    }
+
+    for (auto node_idx : clusters_.target_nodes()) {
+        auto particle_idxs = tree_.node_particle_idxs(node_idx);
+        std::size_t num_particles  = particle_idxs[1] - particle_idxs[0];
+        std::size_t num_interp_pts = clusters_.num_interp_pts_per_node(node_idx);
+
+        downward_interactions += num_particles * std::pow(num_interp_pts, 3);
+        downward_flops        += kernel_costs::downward_flops(num_particles, num_interp_pts);
+        downward_bytes        += kernel_costs::downward_bytes(num_particles, num_interp_pts);
+    }
+
+#ifdef OPENACC_ENABLED
+    std::size_t potential_num = potential_old_.size();
+    #pragma acc enter data copyin(potential_old[0:potential_num], potential_new[0:potential_num])
+#endif
+
+    KernelBenchmark::add("particle_particle_interact", pp_calls, pp_interactions,
+                         kernel_costs::pp_flops(screened) * pp_interactions, pp_bytes, [&]() {
+        for (std::size_t target_node_idx = 0; target_node_idx < tree_.num_nodes(); ++target_node_idx)
+            for (auto source_node_idx : interaction_list_.particle_particle(target_node_idx))
+                bem_.particle_particle_interact(potential_new, potential_old,
+                        tree_.node_particle_idxs(target_node_idx), tree_.node_particle_idxs(source_node_idx));
+    });
+
+#ifndef OPENACC_ENABLED
+    KernelBenchmark::add("particle_particle_interact_packed", pp_calls, pp_interactions,
+                         kernel_costs::pp_flops(screened) * pp_interactions, pp_bytes, [&]() {
+        for (std::size_t target_node_idx = 0; target_node_idx < tree_.num_nodes(); ++target_node_idx)
+            for (auto source_node_idx : interaction_list_.particle_particle(target_node_idx))
+                bem_.particle_particle_interact_packed(potential_new, potential_old,
+                        tree_.node_particle_idxs(target_node_idx), tree_.node_particle_idxs(source_node_idx));
+    });
+#endif
+
+    KernelBenchmark::add("particle_cluster_interact", pc_calls, pc_interactions,
+                         kernel_costs::cluster_flops(screened) * pc_interactions, pc_bytes, [&]() {
+        for (std::size_t target_node_idx = 0; target_node_idx < tree_.num_nodes(); ++target_node_idx)
+            for (auto source_node_idx : interaction_list_.particle_cluster(target_node_idx))
+                bem_.particle_cluster_interact(potential_new,
+                        tree_.node_particle_idxs(target_node_idx), source_node_idx);
+    });
+
+    KernelBenchmark::add("cluster_particle_interact", cp_calls, cp_interactions,
+                         kernel_costs::cluster_flops(screened) * cp_interactions, cp_bytes, [&]() {
+        for (std::size_t target_node_idx = 0; target_node_idx < tree_.num_nodes(); ++target_node_idx)
+            for (auto source_node_idx : interaction_list_.cluster_particle(target_node_idx))
+                bem_.cluster_particle_interact(potential_new, potential_old,
+                        target_node_idx, tree_.node_particle_idxs(source_node_idx));
+    });
+
+    KernelBenchmark::add("cluster_cluster_interact", cc_calls, cc_interactions,
+                         kernel_costs::cluster_flops(screened) * cc_interactions, cc_bytes, [&]() {
+        for (std::size_t target_node_idx = 0; target_node_idx < tree_.num_nodes(); ++target_node_idx)
+            for (auto source_node_idx : interaction_list_.cluster_cluster(target_node_idx))
+                bem_.cluster_cluster_interact(potential_new, target_node_idx, source_node_idx);
+    });
+
+#ifndef OPENACC_ENABLED
+    // the mutual kernels are reported by the target-source evaluations they stand for
+    if (interaction_list_.mutual()) {
+        KernelBenchmark::add("particle_particle_interact_mutual", mutual_pp_calls, 2. * mutual_pp_pairs,
+                             kernel_costs::mutual_pp_flops(screened) * mutual_pp_pairs, mutual_pp_bytes, [&]() {
+            for (std::size_t node_idx = 0; node_idx < tree_.num_nodes(); ++node_idx)
+                for (auto partner_idx : interaction_list_.mutual_particle_particle(node_idx))
+                    bem_.particle_particle_interact_mutual(potential_new, potential_old,
+                            tree_.node_particle_idxs(node_idx), tree_.node_particle_idxs(partner_idx));
+        });
+
+        KernelBenchmark::add("cluster_cluster_interact_mutual", mutual_cc_calls, 2. * mutual_cc_pairs,
+                             kernel_costs::mutual_cc_flops(screened) * mutual_cc_pairs, mutual_cc_bytes, [&]() {
+            for (std::size_t node_idx = 0; node_idx < tree_.num_nodes(); ++node_idx)
+                for (auto partner_idx : interaction_list_.mutual_cluster_cluster(node_idx))
+                    bem_.cluster_cluster_interact_mutual(potential_new, node_idx, partner_idx);
+        });
+    }
+#endif
+
+    KernelBenchmark::add("upward_pass", clusters_.source_nodes().size(), upward_interactions,
+                         upward_flops, upward_bytes, [&]() {
+        clusters_.upward_pass(potential_old);
+    });
+
+    // the downward pass ends by finishing the product, as in a matvec with alpha 1, beta 0
+    std::vector<double> product(potential_old_.size(), 0.);
+    MatvecUpdate update {1., 0., 0.5 * (1. + params_.phys_eps_), 0.5 * (1. + 1. / params_.phys_eps_),
+                         particles_.num(), potential_old, potential_new, product.data()};
+
+    KernelBenchmark::add("downward_pass", clusters_.target_nodes().size(), downward_interactions,
+                         downward_flops, downward_bytes, [&]() {
+        clusters_.downward_pass(update);
+    });
+
+#ifdef OPENACC_ENABLED
+    #pragma acc exit data delete(potential_old[0:potential_num], potential_new[0:potential_num])
+#endif
+}
+
+
+void KernelBenchmark::run_precondition()
+{
+    double calls = 0., interactions = 0., flops = 0., bytes = 0.;
+
+    for (auto leaf_idx : tree_.leaves()) {
+        auto particle_idxs = tree_.node_particle_idxs(leaf_idx);
+        std::size_t num_particles = particle_idxs[1] - particle_idxs[0];
+
+        calls        += 1.;
+        interactions += (double)num_particles * num_particles;
+        flops        += kernel_costs::precondition_flops(num_particles, params_.phys_kappa_ > 0.);
+        bytes        += kernel_costs::precondition_bytes(num_particles);
+    }
+
+    std::vector<double> r(potential_old_);
+    std::vector<double> z(potential_old_.size());
+
+    KernelBenchmark::add("precondition_block", calls, interactions, flops, bytes, [&]() {
+        bem_.precondition_block(z.data(), r.data());
+    });
+}
+
+
+void KernelBenchmark::run_gmres_helpers()
+{
+    long int n = potential_old_.size();
+    long int m = BENCH_GMRES_RESTART;
+    double calls = BENCH_BLAS_CALLS;
+
+    std::vector<double> x(potential_old_);
+    std::vector<double> y(potential_old_);
+    std::vector<double> v(n * m);
+    for (long int i = 0; i < m; ++i) std::copy(x.begin(), x.end(), v.begin() + i * n);
+
+    std::vector<double> coeffs(m, 1. / m);
+    volatile double sink = 0.;
+
+    KernelBenchmark::add("gmres_dnrm2", calls, calls * n, calls * 2. * n, calls * 8. * n, [&]() {
+        for (int i = 0; i < BENCH_BLAS_CALLS; ++i) sink = sink + gmres_blas::dnrm2_(n, x.data());
+    });
+
+    KernelBenchmark::add("gmres_dscal", calls, calls * n, calls * n, calls * 16. * n, [&]() {
+        for (int i = 0; i < BENCH_BLAS_CALLS; ++i) gmres_blas::dscal_(n, 1., y.data());
+    });
+
+    KernelBenchmark::add("gmres_ddot", calls, calls * n, calls * 2. * n, calls * 16. * n, [&]() {
+        for (int i = 0; i < BENCH_BLAS_CALLS; ++i) sink = sink + gmres_blas::ddot_(n, x.data(), y.data());
+    });
+
+    KernelBenchmark::add("gmres_daxpy", calls, calls * n, calls * 2. * n, calls * 24. * n, [&]() {
+        for (int i = 0; i < BENCH_BLAS_CALLS; ++i) gmres_blas::daxpy_(n, 1e-12, x.data(), y.data());
+    });
+
+    KernelBenchmark::add("gmres_dgemv", calls, calls * n * m, calls * 2. * n * m,
+                         calls * 8. * (n * m + 2. * n + m), [&]() {
+        for (int i = 0; i < BENCH_BLAS_CALLS; ++i)
+            gmres_blas::dgemv_(n, m, v.data(), n, coeffs.data(), y.data());
+    });
+}
+
+
+void KernelBenchmark::run_exponential()
+{
+    // exp(-kappa r) over the distances of the run, from std::exp and from the table
+    const YukawaTable& table = bem_.yukawa_table_;
+    if (table.empty()) return;
+
+    auto bounds = particles_.bounds(0, particles_.num());
+    double r_max = std::sqrt((bounds[1] - bounds[0]) * (bounds[1] - bounds[0])
+                           + (bounds[3] - bounds[2]) * (bounds[3] - bounds[2])
+                           + (bounds[5] - bounds[4]) * (bounds[5] - bounds[4]));
+
+    std::mt19937 generator(1618);
+    std::uniform_real_distribution<double> distribution(0., params_.phys_kappa_ * r_max);
+
+    std::vector<double> x(BENCH_EXP_POINTS);
+    for (auto& value : x) value = distribution(generator);
+
+    double n = BENCH_EXP_POINTS;
+    volatile double sink = 0.;
+
+    LibmExponential libm(table);
+    KernelBenchmark::add("exp_libm", 1., n, 0., 8. * n, [&]() {
+        double sum = 0.;
+        for (double value : x) sum += libm(value);
+        sink = sink + sum;
+    });
+
+    YukawaTable::Lookup lookup(table);
+    KernelBenchmark::add("exp_table", 1., n, 0., 8. * n, [&]() {
+        double sum = 0.;
+        for (double value : x) sum += lookup(value);
+        sink = sink + sum;
+    });
+}
+
+
+void KernelBenchmark::print() const
+{
+    std::cout << std::endl << std::left << std::setw(36) << "kernel"
+              << std::right << std::setw(12) << "seconds"
+              << std::setw(14) << "interact/s" << std::setw(10) << "GFLOP/s"
+              << std::setw(10) << "GB/s" << std::endl;
+
+    for (const auto& result : results_) {
+        std::cout << std::left << std::setw(36) << result.kernel << std::right
+                  << std::fixed << std::setprecision(5) << std::setw(12) << result.seconds
+                  << std::scientific << std::setprecision(3)
+                  << std::setw(14) << result.interactions / result.seconds
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(10) << result.flops / result.seconds * 1e-9
+                  << std::setw(10) << result.bytes / result.seconds * 1e-9 << std::endl;
+    }
+}
+
+
+void KernelBenchmark::write_csv(const std::string& path) const
+{
+    std::ofstream csv_file(path);
+
+    csv_file << "kernel,num_particles,tree_degree,tree_theta,tree_max_per_leaf,repeats,"
+             << "calls,interactions,flops,bytes,seconds,"
+             << "interactions_per_second,gflops_per_second,gbytes_per_second\n";
+
+    csv_file << std::setprecision(10);
+
+    for (const auto& result : results_) {
+        csv_file << result.kernel << "," << particles_.num() << "," << params_.tree_degree_ << ","
+                 << params_.tree_theta_ << "," << params_.tree_max_per_leaf_ << "," << repeats_ << ","
+                 << result.calls << "," << result.interactions << ","
+                 << result.flops << "," << result.bytes << "," << result.seconds << ","
+                 << result.interactions / result.seconds << ","
+                 << result.flops / result.seconds * 1e-9 << ","
+                 << result.bytes / result.seconds * 1e-9 << "\n";
+    }
+
+    if (!csv_file.good()) {
+        std::cout << "Could not write benchmark results to " << path << "." << std::endl;
+        std::exit(1);
+    }
+
+    std::cout << std::endl << "Wrote benchmark results to " << path << "." << std::endl;
+}
+
+
+static void usage()
+{
+    std::cout << "Usage: tabipb_bench [-a atoms] [-s sdens] [-d tree_degree] [-t tree_theta]\n"
+              << "                    [-l tree_max_per_leaf] [-b bulk_strength] [-e kernel_exp_tol]\n"
+              << "                    [-m tree_mutual] [-r repeats] [-o results.csv]" << std::endl;
+    std::exit(1);
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::size_t num_atoms = 2000;
+    int repeats = 3;
+    std::string csv_path = "tabipb_bench.csv";
+
+    struct Params params;
+    params.mesh_              = Params::Mesh::SES;
+    params.mesh_generator_    = Params::MeshGenerator::NATIVE;
+    params.mesh_density_      = 2.;
+    params.mesh_probe_radius_ = 1.4;
+
+    params.phys_temp_          = 300.;
+    params.phys_eps_solute_    = 1.;
+    params.phys_eps_solvent_   = 80.;
+    params.phys_bulk_strength_ = 0.15;
+
+    params.tree_degree_       = 3;
+    params.tree_theta_        = 0.8;
+    params.tree_max_per_leaf_ = 50;
+    params.particle_layout_   = Params::ParticleLayout::AOSOA;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 == argc || argv[i][0] != '-' || std::strlen(argv[i]) != 2) usage();
+
+        std::string value = argv[++i];
+        switch (argv[i - 1][1]) {
+            case 'a': num_atoms                 = std::stoul(value); break;
+            case 's': params.mesh_density_      = std::stod(value);  break;
+            case 'd': params.tree_degree_       = std::stoi(value);  break;
+            case 't': params.tree_theta_        = std::stod(value);  break;
+            case 'l': params.tree_max_per_leaf_ = std::stoi(value);  break;
+            case 'b': params.phys_bulk_strength_ = std::stod(value); break;
+            case 'e': params.kernel_exp_tol_     = std::stod(value); break;
+            case 'm': params.tree_mutual_        = (value == "true" || value == "on"); break;
+            case 'r': repeats                   = std::stoi(value);  break;
+            case 'o': csv_path                  = value;             break;
+            default: usage();
+        }
+    }
+
+    if (num_atoms == 0 || params.mesh_density_ <= 0. || params.tree_degree_ <= 0
+     || params.tree_theta_ < 0. || params.tree_theta_ > 1. || params.tree_max_per_leaf_ <= 0
+     || params.phys_bulk_strength_ < 0. || params.kernel_exp_tol_ < 0. || repeats <= 0) usage();
+
+    params.compute_derived_params();
+
+    // random atoms in a ball at protein packing density, with alternating charges
+    std::mt19937 generator(31415);
+    std::uniform_real_distribution<double> unit(-1., 1.);
+    std::uniform_real_distribution<double> atom_radius(1.5, 1.9);
+
+    double ball_radius = std::cbrt(3. * num_atoms * BENCH_VOLUME_PER_ATOM / (4. * constants::PI));
+
+    std::vector<double> coords, charge, radius;
+    while (radius.size() < num_atoms) {
+        double x = unit(generator), y = unit(generator), z = unit(generator);
+        if (x*x + y*y + z*z > 1.) continue;
+
+        coords.push_back(ball_radius * x);
+        coords.push_back(ball_radius * y);
+        coords.push_back(ball_radius * z);
+        charge.push_back(radius.size() % 2 == 0 ? 0.5 : -0.5);
+        radius.push_back(atom_radius(generator));
+    }
+
+    struct Timers timers;
+
+    class Molecule molecule(std::move(coords), std::move(charge), std::move(radius),
+                            params, timers.molecule);
+    molecule.copyin_to_device();
+
+    class Particles particles(molecule, params, timers.particles);
+    class Tree tree(particles, params, timers.tree);
+
+    particles.copyin_to_device();
+    particles.compute_source_term();
+
+    class InteractionList interaction_list(tree, params, timers.interaction_list);
+    class Clusters clusters(particles, tree, interaction_list, params, timers.clusters);
+
+    clusters.copyin_to_device();
+    clusters.compute_all_interp_pts();
+
+    class BoundaryElement bem(particles, clusters, tree, interaction_list, molecule,
+                              params, timers.boundary_element);
+
+    std::cout << "Benchmarking " << num_atoms << " atoms, " << particles.num() << " particles, "
+              << tree.num_nodes() << " nodes, degree " << params.tree_degree_
+              << ", theta " << params.tree_theta_ << ", leaf " << params.tree_max_per_leaf_
+              << ", best of " << repeats << "." << std::endl;
+
+    class KernelBenchmark benchmark(particles, clusters, tree, interaction_list, bem, params, repeats);
+
+    benchmark.run_treecode();
+    benchmark.run_precondition();
+    benchmark.run_gmres_helpers();
+    benchmark.run_exponential();
+
+    benchmark.print();
+    benchmark.write_csv(csv_path);
+
+    molecule.delete_from_device();
+    particles.delete_from_device();
+    clusters.delete_from_device();
+
+    return 0;
+}
@@ -1,31 +1,173 @@
 #include <algorithm>
+#include <array>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
-#include <cstring>
 
 #include "constants.h"
+#include "profiler.h"
+#include "perf_counters.h"
+#include "kernel_costs.h"
+#include "kernel_policy.h"
+#include "task_graph.h"
 #include "boundary_element.h"
 
+static constexpr char PROFILE_MATRIX_VECTOR[] = "run_GMRES/iteration/matrix_vector";
+static constexpr char PROFILE_UPWARD_PASS[]   = "run_GMRES/iteration/matrix_vector/upward_pass";
+static constexpr char PROFILE_INTERACT[]      = "run_GMRES/iteration/matrix_vector/interact";
+static constexpr char PROFILE_PP[]            = "run_GMRES/iteration/matrix_vector/interact/PP";
+static constexpr char PROFILE_PC[]            = "run_GMRES/iteration/matrix_vector/interact/PC";
+static constexpr char PROFILE_CP[]            = "run_GMRES/iteration/matrix_vector/interact/CP";
+static constexpr char PROFILE_CC[]            = "run_GMRES/iteration/matrix_vector/interact/CC";
+static constexpr char PROFILE_DOWNWARD_PASS[] = "run_GMRES/iteration/matrix_vector/downward_pass";
+
 BoundaryElement::BoundaryElement(class Particles& particles, class Clusters& clusters,
          const class Tree& tree, const class InteractionList& interaction_list,
          const class Molecule& molecule, 
          const struct Params& params, struct Timers_BoundaryElement& timers)
     : particles_(particles), clusters_(clusters), tree_(tree),
       interaction_list_(interaction_list), molecule_(molecule), 
-      params_(params), timers_(timers)
+      params_(params), timers_(timers), kernel_policy_(UNSCREENED)
 {
     timers_.ctor.start();
 
     potential_.assign(2 * particles_.num(), 0.);
+    restart_iter_ = 0;
+    direct_sample_error_ = std::nan("");
+
+    if (params_.phys_kappa_ > 0.) kernel_policy_ = SCREENED;
+    
+    particles_.compute_target_charges();
+
+#ifndef OPENACC_ENABLED
+    // every pair the kernels see lies within the bounding box of the elements
+    if (kernel_policy_ == SCREENED && params_.kernel_exp_tol_ > 0.) {
+        auto bounds = particles_.bounds(0, particles_.num());
+        double r_max = std::sqrt((bounds[1] - bounds[0]) * (bounds[1] - bounds[0])
+                               + (bounds[3] - bounds[2]) * (bounds[3] - bounds[2])
+                               + (bounds[5] - bounds[4]) * (bounds[5] - bounds[4]));
+
+        if (yukawa_table_.build(params_.phys_kappa_, r_max, params_.kernel_exp_tol_)) {
+            yukawa_table_.print();
+            kernel_policy_ = TABULATED;
+        }
+    }
+#endif
+
+    BoundaryElement::count_interactions();
 
     timers_.ctor.stop();
 }
+
+
+void BoundaryElement::count_interactions()
+{
+    InteractionCounts counts;
+    
+    if (params_.engine_ == Params::Engine::DIRECT) {
+        counts.pp = BoundaryElement::direct_sum_count();
+        timers_.matvec_counts = counts;
+        return;
+    }
+    
+    // the lists fix every kernel call of a matvec, so one pass over them counts the work
+    for (std::size_t target_node_idx = 0; target_node_idx < tree_.num_nodes(); ++target_node_idx) {
+    
+        auto target_idxs = tree_.node_particle_idxs(target_node_idx);
+        std::size_t num_targets = target_idxs[1] - target_idxs[0];
+        std::size_t num_target_interp_pts = clusters_.num_interp_pts_per_node(target_node_idx);
+        double num_target_charges = std::pow(num_target_interp_pts, 3);
+        
+        for (auto source_node_idx : interaction_list_.particle_particle(target_node_idx)) {
+            auto source_idxs = tree_.node_particle_idxs(source_node_idx);
+            std::size_t num_sources = source_idxs[1] - source_idxs[0];
+            counts.pp.calls       += 1.;
+            counts.pp.evaluations += (double)num_targets * num_sources;
+            counts.pp.flops       += kernel_costs::pp_flops(kernel_policy_ != UNSCREENED)
+                                   * num_targets * num_sources;
+            counts.pp.bytes       += kernel_costs::pp_bytes(num_targets, num_sources);
+        }
+        
+        for (auto source_node_idx : interaction_list_.particle_cluster(target_node_idx)) {
+            std::size_t num_source_interp_pts = clusters_.num_interp_pts_per_node(source_node_idx);
+            counts.pc.calls       += 1.;
+            counts.pc.evaluations += num_targets * std::pow(num_source_interp_pts, 3);
+            counts.pc.bytes       += kernel_costs::pc_bytes(num_targets, num_source_interp_pts);
+        }
+        
+        for (auto source_node_idx : interaction_list_.cluster_particle(target_node_idx)) {
+            auto source_idxs = tree_.node_particle_idxs(source_node_idx);
+            std::size_t num_sources = source_idxs[1] - source_idxs[0];
+            counts.cp.calls       += 1.;
+            counts.cp.evaluations += num_target_charges * num_sources;
+            counts.cp.bytes       += kernel_costs::cp_bytes(num_target_interp_pts, num_sources);
+        }
+        
+        for (auto source_node_idx : interaction_list_.cluster_cluster(target_node_idx)) {
+            std::size_t num_source_interp_pts = clusters_.num_interp_pts_per_node(source_node_idx);
+            counts.cc.calls       += 1.;
+            counts.cc.evaluations += num_target_charges * std::pow(num_source_interp_pts, 3);
+            counts.cc.flops       += kernel_costs::cluster_flops(kernel_policy_ != UNSCREENED)
+                                   * num_target_charges * std::pow(num_source_interp_pts, 3);
+            counts.cc.bytes       += kernel_costs::cc_bytes(num_target_interp_pts, num_source_interp_pts);
+        }
+        
+        for (auto source_node_idx : interaction_list_.mutual_particle_particle(target_node_idx)) {
+            auto source_idxs = tree_.node_particle_idxs(source_node_idx);
+            std::size_t num_sources = source_idxs[1] - source_idxs[0];
+            counts.pp.calls       += 1.;
+            counts.pp.evaluations += 2. * num_targets * num_sources;
+            counts.pp.flops       += kernel_costs::mutual_pp_flops(kernel_policy_ != UNSCREENED)
+                                   * num_targets * num_sources;
+            counts.pp.bytes       += kernel_costs::mutual_pp_bytes(num_targets, num_sources);
+        }
+        
+        for (auto source_node_idx : interaction_list_.mutual_cluster_cluster(target_node_idx)) {
+            std::size_t num_source_interp_pts = clusters_.num_interp_pts_per_node(source_node_idx);
+            double num_pairs = num_target_charges * std::pow(num_source_interp_pts, 3);
+            counts.cc.calls       += 1.;
+            counts.cc.evaluations += 2. * num_pairs;
+            counts.cc.flops       += kernel_costs::mutual_cc_flops(kernel_policy_ != UNSCREENED) * num_pairs;
+            counts.cc.bytes       += kernel_costs::mutual_cc_bytes(num_target_interp_pts, num_source_interp_pts);
+        }
+        
+    }
+    
+    // the upward and downward passes interpolate the particles of the nodes the lists use
+    for (auto node_idx : clusters_.source_nodes()) {
+        auto particle_idxs = tree_.node_particle_idxs(node_idx);
+        std::size_t num_particles  = particle_idxs[1] - particle_idxs[0];
+        std::size_t num_interp_pts = clusters_.num_interp_pts_per_node(node_idx);
+        counts.upward.calls         += 1.;
+        counts.upward.evaluations   += num_particles * std::pow(num_interp_pts, 3);
+        counts.upward.flops         += kernel_costs::upward_flops  (num_particles, num_interp_pts);
+        counts.upward.bytes         += kernel_costs::upward_bytes  (num_particles, num_interp_pts);
+    }
+    
+    for (auto node_idx : clusters_.target_nodes()) {
+        auto particle_idxs = tree_.node_particle_idxs(node_idx);
+        std::size_t num_particles  = particle_idxs[1] - particle_idxs[0];
+        std::size_t num_interp_pts = clusters_.num_interp_pts_per_node(node_idx);
+        counts.downward.calls       += 1.;
+        counts.downward.evaluations += num_particles * std::pow(num_interp_pts, 3);
+        counts.downward.flops       += kernel_costs::downward_flops(num_particles, num_interp_pts);
+        counts.downward.bytes       += kernel_costs::downward_bytes(num_particles, num_interp_pts);
+    }
+    
+    // the mutual kernels count two evaluations per pair, so pp and cc add up their flops above
+    counts.pc.flops = kernel_costs::cluster_flops(kernel_policy_ != UNSCREENED) * counts.pc.evaluations;
+    counts.cp.flops = kernel_costs::cluster_flops(kernel_policy_ != UNSCREENED) * counts.cp.evaluations;
+    
+    timers_.matvec_counts = counts;
+}
           
 void BoundaryElement::run_GMRES()
 {
+    PROFILE_SCOPE("run_GMRES");
+    PERF_SCOPE(GMRES);
     timers_.run_GMRES.start();
 
     long int restrt = 10;
@@ -37,6 +179,11 @@ void BoundaryElement::run_GMRES()
     residual_       = 1e-4;
     num_iter_       = 100;
 
+    // resume from a checkpoint of the same problem, if one was given
+    if (!params_.restart_file_.empty()) BoundaryElement::read_checkpoint(params_.restart_file_);
+    
+    if (!params_.telemetry_file_.empty()) telemetry_.open(params_.telemetry_file_);
+
     std::vector<double> work_vec(ldw * (restrt + 4));
     std::vector<double> h_vec   (ldh * (restrt + 2));
     
@@ -46,6 +193,9 @@ void BoundaryElement::run_GMRES()
     int err_code = BoundaryElement::gmres_(length, particles_.source_term_ptr(), potential_.data(),
                                     restrt, work, ldw, h, ldh, num_iter_, residual_);
 
+    BoundaryElement::write_telemetry(err_code ? "failed" : "done", num_iter_, residual_);
+    telemetry_.close();
+
     if (err_code) {
         std::cout << "GMRES error code " << err_code << ". Exiting.";
         std::exit(1);
@@ -57,69 +207,198 @@ void BoundaryElement::run_GMRES()
 }
 
 
+void BoundaryElement::write_telemetry(const char* record_type, long int iter, double residual)
+{
+    if (!telemetry_.is_open()) return;
+    
+    // times cover the work since the previous record; the kernel times are summed over threads
+    std::ostringstream record;
+    record << std::setprecision(9)
+           << "{\"type\":\"" << record_type << "\",\"iteration\":" << iter
+           << ",\"residual\":" << residual
+           << ",\"elapsed\":" << telemetry_.elapsed()
+           << ",\"matvec_time\":" << telemetry_.delta(0, timers_.matrix_vector.elapsed_time())
+           << ",\"precondition_time\":" << telemetry_.delta(1, timers_.precondition.elapsed_time())
+           << ",\"kernels\":{"
+           << "\"upward_pass\":" << telemetry_.delta(2, Profiler::total_time(PROFILE_UPWARD_PASS))
+           << ",\"PP\":" << telemetry_.delta(3, Profiler::total_time(PROFILE_PP))
+           << ",\"PC\":" << telemetry_.delta(4, Profiler::total_time(PROFILE_PC))
+           << ",\"CP\":" << telemetry_.delta(5, Profiler::total_time(PROFILE_CP))
+           << ",\"CC\":" << telemetry_.delta(6, Profiler::total_time(PROFILE_CC))
+           << ",\"downward_pass\":" << telemetry_.delta(7, Profiler::total_time(PROFILE_DOWNWARD_PASS))
+           << ",\"direct_sum\":" << telemetry_.delta(8, timers_.direct_sum.elapsed_time())
+           << "},\"resident_bytes\":" << Telemetry::resident_bytes() << "}";
+    
+    telemetry_.write(record.str());
+}
+
+
 void BoundaryElement::matrix_vector(double alpha, const double* __restrict potential_old,
                              double beta,        double* __restrict potential_new)
 {
+    PROFILE_SCOPE(PROFILE_MATRIX_VECTOR);
+    if (timers_.num_matvecs == 0) timers_.first_matvec.stop();
     timers_.matrix_vector.start();
 
     double potential_coeff_1 = 0.5 * (1. +      params_.phys_eps_);
     double potential_coeff_2 = 0.5 * (1. + 1. / params_.phys_eps_);
     
     std::size_t potential_num = potential_.size();
-    auto* potential_temp = (double *)std::malloc(potential_num * sizeof(double));
-    std::memcpy(potential_temp, potential_new, potential_num * sizeof(double));
-    std::memset(potential_new, 0, potential_num * sizeof(double));
+    
+    // the kernels sum into their own zeroed buffer, so potential_new is only read
+    // once, by the update that finishes the product
+    auto* interactions = (double *)std::calloc(potential_num, sizeof(double));
+    
+    MatvecUpdate update {alpha, beta, potential_coeff_1, potential_coeff_2, potential_num / 2,
+                         potential_old, interactions, potential_new};
 
 #ifdef OPENACC_ENABLED
     #pragma acc enter data copyin(potential_old[0:potential_num], \
-                              potential_new[0:potential_num])
+                              interactions[0:potential_num])
 #endif
 
-    clusters_.clear_charges();
-    clusters_.clear_potentials();
+    if (params_.engine_ == Params::Engine::DIRECT) {
+        BoundaryElement::direct_sum_interact(interactions, potential_old);
+        
+    } else {
+        BoundaryElement::interact(interactions, potential_old);
+        
+        PROFILE_SCOPE(PROFILE_DOWNWARD_PASS);
+        PERF_SCOPE(DOWNWARD_PASS);
+        clusters_.downward_pass(update);
+    }
 
-    particles_.compute_charges(potential_old);
-    clusters_.upward_pass();
+#ifdef OPENACC_ENABLED
+    #pragma acc exit data copyout(potential_old[0:potential_num], \
+                              interactions[0:potential_num])
+#endif
+    
+    // on the host the downward pass has already updated every leaf
+#ifndef OPENACC_ENABLED
+    if (params_.engine_ == Params::Engine::DIRECT)
+#endif
+        update.apply(0, update.num);
+    
+    std::free(interactions);
+    
+    timers_.total_counts += timers_.matvec_counts;
+    timers_.num_matvecs++;
+
+    timers_.matrix_vector.stop();
+}
+
+
+void BoundaryElement::interact(double* __restrict potential, const double* __restrict potential_old)
+{
+#ifndef OPENACC_ENABLED
+    if (params_.tree_task_graph_) {
+        BoundaryElement::interact_task_graph(potential, potential_old);
+        return;
+    }
+#endif
+
+    {
+        PROFILE_SCOPE(PROFILE_UPWARD_PASS);
+        PERF_SCOPE(UPWARD_PASS);
+        clusters_.clear_charges();
+        clusters_.clear_potentials();
+
+        clusters_.upward_pass(potential_old);
+    }
+
+    PROFILE_SCOPE(PROFILE_INTERACT);
+    PERF_SCOPE(INTERACT);
 
 #ifdef OPENMP_ENABLED
     #pragma omp parallel for
 #endif
     for (std::size_t target_node_idx = 0; target_node_idx < tree_.num_nodes(); ++target_node_idx) {
-        
-        for (auto source_node_idx : interaction_list_.particle_particle(target_node_idx))
-            BoundaryElement::particle_particle_interact(potential_new, potential_old,
-                    tree_.node_particle_idxs(target_node_idx), tree_.node_particle_idxs(source_node_idx));
+        BoundaryElement::interact_particle_sources(potential, potential_old, target_node_idx);
+        BoundaryElement::interact_cluster_sources(potential, target_node_idx);
+    }
+}
+
+
+void BoundaryElement::interact_task_graph(double* __restrict potential, const double* __restrict potential_old)
+{
+    clusters_.clear_charges();
+    clusters_.clear_potentials();
     
-        for (auto source_node_idx : interaction_list_.particle_cluster(target_node_idx))
-            BoundaryElement::particle_cluster_interact(potential_new, 
-                    tree_.node_particle_idxs(target_node_idx), source_node_idx);
+    // the upward pass runs as one task per source node, so it shares the interact
+    // phase and its counters with the interactions it overlaps
+    TaskGraph graph;
+    std::size_t charges_ready = clusters_.upward_pass(graph, potential_old);
+    
+    PROFILE_SCOPE(PROFILE_INTERACT);
+    PERF_SCOPE(INTERACT);
+    
+    for (std::size_t target_node_idx = 0; target_node_idx < tree_.num_nodes(); ++target_node_idx) {
         
-        for (auto source_node_idx : interaction_list_.cluster_particle(target_node_idx))
-            BoundaryElement::cluster_particle_interact(potential_new, 
-                    target_node_idx, tree_.node_particle_idxs(source_node_idx));
+        if (!interaction_list_.particle_particle(target_node_idx).empty()
+         || !interaction_list_.cluster_particle(target_node_idx).empty()
+         || !interaction_list_.mutual_particle_particle(target_node_idx).empty()) {
+            graph.add([=]() {
+                BoundaryElement::interact_particle_sources(potential, potential_old, target_node_idx);
+            });
+        }
         
-        for (auto source_node_idx : interaction_list_.cluster_cluster(target_node_idx))
-            BoundaryElement::cluster_cluster_interact(potential_new, target_node_idx, source_node_idx);
+        if (!interaction_list_.particle_cluster(target_node_idx).empty()
+         || !interaction_list_.cluster_cluster(target_node_idx).empty()
+         || !interaction_list_.mutual_cluster_cluster(target_node_idx).empty()) {
+            std::size_t task_idx = graph.add([=]() {
+                BoundaryElement::interact_cluster_sources(potential, target_node_idx);
+            });
+            graph.depend(task_idx, charges_ready);
+        }
     }
     
-    clusters_.downward_pass(potential_new);
+    graph.run();
+    
+    timers_.interact_thread_time += graph.num_threads() * graph.wall_time();
+    timers_.interact_busy_time   += graph.busy_time();
+}
 
-#ifdef OPENACC_ENABLED
-    #pragma acc exit data copyout(potential_old[0:potential_num], \
-                              potential_new[0:potential_num])
+
+void BoundaryElement::interact_particle_sources(double* __restrict potential,
+                                         const double* __restrict potential_old,
+                                         std::size_t target_node_idx)
+{
+    for (auto source_node_idx : interaction_list_.particle_particle(target_node_idx)) {
+#ifndef OPENACC_ENABLED
+        if (params_.particle_layout_ == Params::ParticleLayout::AOSOA)
+            BoundaryElement::particle_particle_interact_packed(potential, potential_old,
+                tree_.node_particle_idxs(target_node_idx), tree_.node_particle_idxs(source_node_idx));
+        else
 #endif
+            BoundaryElement::particle_particle_interact(potential, potential_old,
+                tree_.node_particle_idxs(target_node_idx), tree_.node_particle_idxs(source_node_idx));
+    }
     
-    for (std::size_t i = 0; i < potential_.size() / 2; ++i)
-        potential_new[i] = beta * potential_temp[i]
-                + alpha * (potential_coeff_1 * potential_old[i] - potential_new[i]);
-                                             
-    for (std::size_t i = potential_.size() / 2; i < potential_.size(); ++i)
-        potential_new[i] =  beta * potential_temp[i]
-                + alpha * (potential_coeff_2 * potential_old[i] - potential_new[i]);
-                
-    std::free(potential_temp);
+    for (auto source_node_idx : interaction_list_.cluster_particle(target_node_idx))
+        BoundaryElement::cluster_particle_interact(potential, potential_old,
+                target_node_idx, tree_.node_particle_idxs(source_node_idx));
+    
+#ifndef OPENACC_ENABLED
+    for (auto source_node_idx : interaction_list_.mutual_particle_particle(target_node_idx))
+        BoundaryElement::particle_particle_interact_mutual(potential, potential_old,
+                tree_.node_particle_idxs(target_node_idx), tree_.node_particle_idxs(source_node_idx));
+#endif
+}
 
-    timers_.matrix_vector.stop();
+
+void BoundaryElement::interact_cluster_sources(double* __restrict potential, std::size_t target_node_idx)
+{
+    for (auto source_node_idx : interaction_list_.particle_cluster(target_node_idx))
+        BoundaryElement::particle_cluster_interact(potential, 
+                tree_.node_particle_idxs(target_node_idx), source_node_idx);
+    
+    for (auto source_node_idx : interaction_list_.cluster_cluster(target_node_idx))
+        BoundaryElement::cluster_cluster_interact(potential, target_node_idx, source_node_idx);
+    
+#ifndef OPENACC_ENABLED
+    for (auto source_node_idx : interaction_list_.mutual_cluster_cluster(target_node_idx))
+        BoundaryElement::cluster_cluster_interact_mutual(potential, target_node_idx, source_node_idx);
+#endif
 }
 
 
@@ -128,8 +407,31 @@ void BoundaryElement::particle_particle_interact(      double* __restrict potent
                                           std::array<std::size_t, 2> target_node_particle_idxs,
                                           std::array<std::size_t, 2> source_node_particle_idxs)
 {
-    timers_.particle_particle_interact.start();
+    PROFILE_SCOPE(PROFILE_PP);
+
+    switch (kernel_policy_) {
+        case UNSCREENED:
+            BoundaryElement::particle_particle_interact_generic<UnscreenedKernel>(potential, potential_old,
+                    target_node_particle_idxs, source_node_particle_idxs);
+            break;
+        case SCREENED:
+            BoundaryElement::particle_particle_interact_generic<ScreenedKernel>(potential, potential_old,
+                    target_node_particle_idxs, source_node_particle_idxs);
+            break;
+        case TABULATED:
+            BoundaryElement::particle_particle_interact_generic<TabulatedKernel>(potential, potential_old,
+                    target_node_particle_idxs, source_node_particle_idxs);
+            break;
+    }
+}
 
+
+template <class Kernel>
+void BoundaryElement::particle_particle_interact_generic(      double* __restrict potential,
+                                                  const double* __restrict potential_old,
+                                                  std::array<std::size_t, 2> target_node_particle_idxs,
+                                                  std::array<std::size_t, 2> source_node_particle_idxs)
+{
     std::size_t target_node_particle_begin = target_node_particle_idxs[0];
     std::size_t target_node_particle_end   = target_node_particle_idxs[1];
 
@@ -137,8 +439,7 @@ void BoundaryElement::particle_particle_interact(      double* __restrict potent
     std::size_t source_node_particle_end   = source_node_particle_idxs[1];
     
     double eps    = params_.phys_eps_;
-    double kappa  = params_.phys_kappa_;
-    double kappa2 = params_.phys_kappa2_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table_);
     
     const double* __restrict particles_x_ptr    = particles_.x_ptr();
     const double* __restrict particles_y_ptr    = particles_.y_ptr();
@@ -195,29 +496,153 @@ void BoundaryElement::particle_particle_interact(      double* __restrict potent
             if (r > 0) {
                 double one_over_r = 1. / r;
                 double G0 = constants::ONE_OVER_4PI * one_over_r;
-                double kappa_r = kappa * r;
-                double exp_kappa_r = std::exp(-kappa_r);
-                double Gk = exp_kappa_r * G0;
                 
                 double source_cos  = (source_nx * dist_x + source_ny * dist_y + source_nz * dist_z) * one_over_r;
                 double target_cos = (target_nx * dist_x + target_ny * dist_y + target_nz * dist_z) * one_over_r;
                 
                 double tp1 = G0 * one_over_r;
-                double tp2 = (1. + kappa_r) * exp_kappa_r;
+                double dot_tqsq = source_nx * target_nx + source_ny * target_ny + source_nz * target_nz;
+
+                double tp2, L2, L3;
+                kernel.boundary_terms(r, one_over_r, G0, tp1, source_cos, target_cos, dot_tqsq,
+                                      tp2, L2, L3);
+
+                double L1 = source_cos  * tp1 * (1. - tp2 * eps);
+                double L4 = target_cos * tp1 * (1. - tp2 / eps);
+                
+                pot_temp_1 += (L1 * potential_old_0 + L2 * potential_old_1) * source_area;
+                pot_temp_2 += (L3 * potential_old_0 + L4 * potential_old_1) * source_area;
+            }
+        }
+        
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        potential[j]                 += pot_temp_1;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        potential[j + num_particles] += pot_temp_2;
+    }
+
+}
+
+
+void BoundaryElement::particle_particle_interact_packed(      double* __restrict potential,
+                                                 const double* __restrict potential_old,
+                                                 std::array<std::size_t, 2> target_node_particle_idxs,
+                                                 std::array<std::size_t, 2> source_node_particle_idxs)
+{
+    PROFILE_SCOPE(PROFILE_PP);
+
+    switch (kernel_policy_) {
+        case UNSCREENED:
+            BoundaryElement::particle_particle_interact_packed_generic<UnscreenedKernel>(potential, potential_old,
+                    target_node_particle_idxs, source_node_particle_idxs);
+            break;
+        case SCREENED:
+            BoundaryElement::particle_particle_interact_packed_generic<ScreenedKernel>(potential, potential_old,
+                    target_node_particle_idxs, source_node_particle_idxs);
+            break;
+        case TABULATED:
+            BoundaryElement::particle_particle_interact_packed_generic<TabulatedKernel>(potential, potential_old,
+                    target_node_particle_idxs, source_node_particle_idxs);
+            break;
+    }
+}
+
+
+template <class Kernel>
+void BoundaryElement::particle_particle_interact_packed_generic(      double* __restrict potential,
+                                                         const double* __restrict potential_old,
+                                                         std::array<std::size_t, 2> target_node_particle_idxs,
+                                                         std::array<std::size_t, 2> source_node_particle_idxs)
+{
+    // Same kernel as particle_particle_interact, reading geometry from the AoSoA
+    // blocks of Particles. Host only; device builds always use the separate arrays.
+    std::size_t target_node_particle_begin = target_node_particle_idxs[0];
+    std::size_t target_node_particle_end   = target_node_particle_idxs[1];
 
+    std::size_t source_node_particle_begin = source_node_particle_idxs[0];
+    std::size_t source_node_particle_end   = source_node_particle_idxs[1];
+    
+    double eps    = params_.phys_eps_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table_);
+    
+    const std::size_t lanes      = Particles::PACKED_BLOCK_SIZE;
+    const std::size_t block_size = Particles::PACKED_BLOCK_SIZE * Particles::PACKED_NUM_FIELDS;
+    const double* __restrict particles_packed_ptr = particles_.packed_geometry_ptr();
+    
+    std::size_t num_particles = particles_.num();
+
+    for (std::size_t j = target_node_particle_begin; j < target_node_particle_end; ++j) {
+        
+        const double* target = &particles_packed_ptr[(j / lanes) * block_size + j % lanes];
+        
+        double target_x  = target[0 * lanes];
+        double target_y  = target[1 * lanes];
+        double target_z  = target[2 * lanes];
+        
+        double target_nx = target[3 * lanes];
+        double target_ny = target[4 * lanes];
+        double target_nz = target[5 * lanes];
+        
+        double pot_temp_1 = 0.;
+        double pot_temp_2 = 0.;
+
+        // walk the source range block by block, so each lane is a fixed offset
+        std::size_t source_block_begin = source_node_particle_begin / lanes;
+        std::size_t source_block_end   = (source_node_particle_end + lanes - 1) / lanes;
+        
+        for (std::size_t block = source_block_begin; block < source_block_end; ++block) {
+        
+        const double* source = &particles_packed_ptr[block * block_size];
+        std::size_t lane_begin = std::max(source_node_particle_begin, block * lanes) - block * lanes;
+        std::size_t lane_end   = std::min(source_node_particle_end, (block + 1) * lanes) - block * lanes;
+        
+        for (std::size_t lane = lane_begin; lane < lane_end; ++lane) {
+        
+            std::size_t k = block * lanes + lane;
+            
+            double source_x    = source[0 * lanes + lane];
+            double source_y    = source[1 * lanes + lane];
+            double source_z    = source[2 * lanes + lane];
+            
+            double source_nx   = source[3 * lanes + lane];
+            double source_ny   = source[4 * lanes + lane];
+            double source_nz   = source[5 * lanes + lane];
+            double source_area = source[6 * lanes + lane];
+            
+            double potential_old_0 = potential_old[k];
+            double potential_old_1 = potential_old[k + num_particles];
+            
+            double dist_x = source_x - target_x;
+            double dist_y = source_y - target_y;
+            double dist_z = source_z - target_z;
+            double r = std::sqrt(dist_x * dist_x + dist_y * dist_y + dist_z * dist_z);
+            
+            if (r > 0) {
+                double one_over_r = 1. / r;
+                double G0 = constants::ONE_OVER_4PI * one_over_r;
+                
+                double source_cos  = (source_nx * dist_x + source_ny * dist_y + source_nz * dist_z) * one_over_r;
+                double target_cos = (target_nx * dist_x + target_ny * dist_y + target_nz * dist_z) * one_over_r;
+                
+                double tp1 = G0 * one_over_r;
                 double dot_tqsq = source_nx * target_nx + source_ny * target_ny + source_nz * target_nz;
-                double G3 = (dot_tqsq - 3. * target_cos * source_cos) * one_over_r * tp1;
-                double G4 = tp2 * G3 - kappa2 * target_cos * source_cos * Gk;
+
+                double tp2, L2, L3;
+                kernel.boundary_terms(r, one_over_r, G0, tp1, source_cos, target_cos, dot_tqsq,
+                                      tp2, L2, L3);
 
                 double L1 = source_cos  * tp1 * (1. - tp2 * eps);
-                double L2 = G0 - Gk;
-                double L3 = G4 - G3;
                 double L4 = target_cos * tp1 * (1. - tp2 / eps);
                 
                 pot_temp_1 += (L1 * potential_old_0 + L2 * potential_old_1) * source_area;
                 pot_temp_2 += (L3 * potential_old_0 + L4 * potential_old_1) * source_area;
             }
         }
+        }
         
 #ifdef OPENMP_ENABLED
         #pragma omp atomic update
@@ -229,7 +654,6 @@ void BoundaryElement::particle_particle_interact(      double* __restrict potent
         potential[j + num_particles] += pot_temp_2;
     }
 
-    timers_.particle_particle_interact.stop();
 }
 
 
@@ -237,20 +661,50 @@ void BoundaryElement::particle_cluster_interact(double* __restrict potential,
                                          std::array<std::size_t, 2> target_node_particle_idxs,
                                          std::size_t source_node_idx)
 {
-    timers_.particle_cluster_interact.start();
+    PROFILE_SCOPE(PROFILE_PC);
+
+#ifndef OPENACC_ENABLED
+    ParticleClusterKernel fixed_kernel = BoundaryElement::particle_cluster_kernel(
+            clusters_.num_interp_pts_per_node(source_node_idx), kernel_policy_);
+    if (fixed_kernel) {
+        (this->*fixed_kernel)(potential, target_node_particle_idxs, source_node_idx);
+        return;
+    }
+#endif
 
+    switch (kernel_policy_) {
+        case UNSCREENED:
+            BoundaryElement::particle_cluster_interact_generic<UnscreenedKernel>(potential,
+                    target_node_particle_idxs, source_node_idx);
+            break;
+        case SCREENED:
+            BoundaryElement::particle_cluster_interact_generic<ScreenedKernel>(potential,
+                    target_node_particle_idxs, source_node_idx);
+            break;
+        case TABULATED:
+            BoundaryElement::particle_cluster_interact_generic<TabulatedKernel>(potential,
+                    target_node_particle_idxs, source_node_idx);
+            break;
+    }
+}
+
+
+template <class Kernel>
+void BoundaryElement::particle_cluster_interact_generic(double* __restrict potential,
+                                                 std::array<std::size_t, 2> target_node_particle_idxs,
+                                                 std::size_t source_node_idx)
+{
     std::size_t num_particles   = particles_.num();
-    int num_interp_pts_per_node = clusters_.num_interp_pts_per_node();
-    int num_charges_per_node    = clusters_.num_charges_per_node();
+    int num_interp_pts_per_node = clusters_.num_interp_pts_per_node(source_node_idx);
 
     std::size_t target_node_particle_begin      = target_node_particle_idxs[0];
     std::size_t target_node_particle_end        = target_node_particle_idxs[1];
 
-    std::size_t source_cluster_interp_pts_begin = source_node_idx * num_interp_pts_per_node;
-    std::size_t source_cluster_charges_begin    = source_node_idx * num_charges_per_node;
+    std::size_t source_cluster_interp_pts_begin = clusters_.cluster_interp_pts_idxs(source_node_idx)[0];
+    std::size_t source_cluster_charges_begin    = clusters_.cluster_charges_idxs(source_node_idx)[0];
     
     double eps    = params_.phys_eps_;
-    double kappa  = params_.phys_kappa_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table_);
     
     const double* __restrict particles_x_ptr   = particles_.x_ptr();
     const double* __restrict particles_y_ptr   = particles_.y_ptr();
@@ -304,39 +758,9 @@ void BoundaryElement::particle_cluster_interact(double* __restrict potential,
             double dy = target_y - clusters_y_ptr[source_cluster_interp_pts_begin + k2];
             double dz = target_z - clusters_z_ptr[source_cluster_interp_pts_begin + k3];
 
-            double r2    = dx*dx + dy*dy + dz*dz;
-            double r     = std::sqrt(r2);
-            double rinv  = 1. / r;
-            double r3inv = rinv  * rinv * rinv;
-            double r5inv = r3inv * rinv * rinv;
-
-            double expkr   =  std::exp(-kappa * r);
-            double d1term  =  r3inv * expkr * (1. + (kappa * r));
-            double d1term1 = -r3inv + d1term * eps;
-            double d1term2 = -r3inv + d1term / eps;
-            double d2term  =  r5inv * (-3. + expkr * (3. + (3. * kappa * r)
-                                                   + (kappa * kappa * r2)));
-            double d3term  =  r3inv * ( 1. - expkr * (1. + kappa * r));
-
-            pot_comp_    += (rinv * (1. - expkr) * (clusters_q_ptr   [kk])
-                                      + d1term1 * (clusters_q_dx_ptr[kk] * dx
-                                                 + clusters_q_dy_ptr[kk] * dy
-                                                 + clusters_q_dz_ptr[kk] * dz));
-                                    
-            pot_comp_dx  += (clusters_q_ptr   [kk]  * (d1term2 * dx)
-                          - (clusters_q_dx_ptr[kk]  * (dx * dx * d2term + d3term)
-                          +  clusters_q_dy_ptr[kk]  * (dx * dy * d2term)
-                          +  clusters_q_dz_ptr[kk]  * (dx * dz * d2term)));
-                         
-            pot_comp_dy  += (clusters_q_ptr   [kk]  *  d1term2 * dy
-                          - (clusters_q_dx_ptr[kk]  * (dx * dy * d2term)
-                          +  clusters_q_dy_ptr[kk]  * (dy * dy * d2term + d3term)
-                          +  clusters_q_dz_ptr[kk]  * (dy * dz * d2term)));
-                         
-            pot_comp_dz  += (clusters_q_ptr   [kk]  *  d1term2 * dz
-                          - (clusters_q_dx_ptr[kk]  * (dx * dz * d2term)
-                          +  clusters_q_dy_ptr[kk]  * (dy * dz * d2term)
-                          +  clusters_q_dz_ptr[kk]  * (dz * dz * d2term + d3term)));
+            kernel.far_field(dx, dy, dz, eps,
+                             clusters_q_ptr[kk], clusters_q_dx_ptr[kk], clusters_q_dy_ptr[kk], clusters_q_dz_ptr[kk],
+                             pot_comp_, pot_comp_dx, pot_comp_dy, pot_comp_dz);
         }
         }
         }
@@ -353,27 +777,58 @@ void BoundaryElement::particle_cluster_interact(double* __restrict potential,
                                       + targets_q_dz_ptr[j] * pot_comp_dz;
     }
 
-    timers_.particle_cluster_interact.stop();
 }
 
 
 void BoundaryElement::cluster_particle_interact(double* __restrict potential,
+                                         const double* __restrict potential_old,
                                          std::size_t target_node_idx,
                                          std::array<std::size_t, 2> source_node_particle_idxs)
 {
-    timers_.cluster_particle_interact.start();
+    PROFILE_SCOPE(PROFILE_CP);
+
+#ifndef OPENACC_ENABLED
+    ClusterParticleKernel fixed_kernel = BoundaryElement::cluster_particle_kernel(
+            clusters_.num_interp_pts_per_node(target_node_idx), kernel_policy_);
+    if (fixed_kernel) {
+        (this->*fixed_kernel)(potential, potential_old, target_node_idx, source_node_particle_idxs);
+        return;
+    }
+#endif
+
+    switch (kernel_policy_) {
+        case UNSCREENED:
+            BoundaryElement::cluster_particle_interact_generic<UnscreenedKernel>(potential, potential_old,
+                    target_node_idx, source_node_particle_idxs);
+            break;
+        case SCREENED:
+            BoundaryElement::cluster_particle_interact_generic<ScreenedKernel>(potential, potential_old,
+                    target_node_idx, source_node_particle_idxs);
+            break;
+        case TABULATED:
+            BoundaryElement::cluster_particle_interact_generic<TabulatedKernel>(potential, potential_old,
+                    target_node_idx, source_node_particle_idxs);
+            break;
+    }
+}
+
 
-    int num_interp_pts_per_node = clusters_.num_interp_pts_per_node();
-    int num_potentials_per_node = clusters_.num_charges_per_node();
+template <class Kernel>
+void BoundaryElement::cluster_particle_interact_generic(double* __restrict potential,
+                                                 const double* __restrict potential_old,
+                                                 std::size_t target_node_idx,
+                                                 std::array<std::size_t, 2> source_node_particle_idxs)
+{
+    int num_interp_pts_per_node = clusters_.num_interp_pts_per_node(target_node_idx);
     
-    std::size_t target_cluster_interp_pts_begin = target_node_idx * num_interp_pts_per_node;
-    std::size_t target_cluster_potentials_begin = target_node_idx * num_potentials_per_node;
+    std::size_t target_cluster_interp_pts_begin = clusters_.cluster_interp_pts_idxs(target_node_idx)[0];
+    std::size_t target_cluster_potentials_begin = clusters_.cluster_potentials_idxs(target_node_idx)[0];
 
     std::size_t source_node_particle_begin      = source_node_particle_idxs[0];
     std::size_t source_node_particle_end        = source_node_particle_idxs[1];
     
     double eps    = params_.phys_eps_;
-    double kappa  = params_.phys_kappa_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table_);
     
     const double* __restrict clusters_x_ptr    = clusters_.interp_x_ptr();
     const double* __restrict clusters_y_ptr    = clusters_.interp_y_ptr();
@@ -388,17 +843,19 @@ void BoundaryElement::cluster_particle_interact(double* __restrict potential,
     const double* __restrict particles_y_ptr   = particles_.y_ptr();
     const double* __restrict particles_z_ptr   = particles_.z_ptr();
     
-    const double* __restrict sources_q_ptr     = particles_.source_charge_ptr();
-    const double* __restrict sources_q_dx_ptr  = particles_.source_charge_dx_ptr();
-    const double* __restrict sources_q_dy_ptr  = particles_.source_charge_dy_ptr();
-    const double* __restrict sources_q_dz_ptr  = particles_.source_charge_dz_ptr();
+    const double* __restrict particles_nx_ptr  = particles_.nx_ptr();
+    const double* __restrict particles_ny_ptr  = particles_.ny_ptr();
+    const double* __restrict particles_nz_ptr  = particles_.nz_ptr();
+    const double* __restrict particles_a_ptr   = particles_.area_ptr();
+    
+    std::size_t potential_offset = particles_.num();
     
 #ifdef OPENACC_ENABLED
     #pragma acc parallel loop collapse(3) present(clusters_x_ptr, clusters_y_ptr, clusters_z_ptr, \
                     clusters_p_ptr, clusters_p_dx_ptr, clusters_p_dy_ptr, clusters_p_dz_ptr, \
                     particles_x_ptr, particles_y_ptr, particles_z_ptr, \
-                    sources_q_ptr, sources_q_dx_ptr, sources_q_dy_ptr, sources_q_dz_ptr, \
-                    potential)
+                    particles_nx_ptr, particles_ny_ptr, particles_nz_ptr, particles_a_ptr, \
+                    potential, potential_old)
 #endif
     for (int j1 = 0; j1 < num_interp_pts_per_node; ++j1) {
     for (int j2 = 0; j2 < num_interp_pts_per_node; ++j2) {
@@ -427,39 +884,14 @@ void BoundaryElement::cluster_particle_interact(double* __restrict potential,
             double dy = target_y - particles_y_ptr[k];
             double dz = target_z - particles_z_ptr[k];
 
-            double r2    = dx*dx + dy*dy + dz*dz;
-            double r     = std::sqrt(r2);
-            double rinv  = 1. / r;
-            double r3inv = rinv  * rinv * rinv;
-            double r5inv = r3inv * rinv * rinv;
-
-            double expkr   =  std::exp(-kappa * r);
-            double d1term  =  r3inv * expkr * (1. + (kappa * r));
-            double d1term1 = -r3inv + d1term * eps;
-            double d1term2 = -r3inv + d1term / eps;
-            double d2term  =  r5inv * (-3. + expkr * (3. + (3. * kappa * r)
-                                                   + (kappa * kappa * r2)));
-            double d3term  =  r3inv * ( 1. - expkr * (1. + kappa * r));
-
-            pot_comp_    += (rinv * (1. - expkr) * (sources_q_ptr   [k])
-                                      + d1term1 * (sources_q_dx_ptr[k] * dx
-                                                 + sources_q_dy_ptr[k] * dy
-                                                 + sources_q_dz_ptr[k] * dz));
-                                    
-            pot_comp_dx  += (sources_q_ptr   [k]  * (d1term2 * dx)
-                          - (sources_q_dx_ptr[k]  * (dx * dx * d2term + d3term)
-                          +  sources_q_dy_ptr[k]  * (dx * dy * d2term)
-                          +  sources_q_dz_ptr[k]  * (dx * dz * d2term)));
-                         
-            pot_comp_dy  += (sources_q_ptr   [k]  *  d1term2 * dy
-                          - (sources_q_dx_ptr[k]  * (dx * dy * d2term)
-                          +  sources_q_dy_ptr[k]  * (dy * dy * d2term + d3term)
-                          +  sources_q_dz_ptr[k]  * (dy * dz * d2term)));
-                         
-            pot_comp_dz  += (sources_q_ptr   [k]  *  d1term2 * dz
-                          - (sources_q_dx_ptr[k]  * (dx * dz * d2term)
-                          +  sources_q_dy_ptr[k]  * (dy * dz * d2term)
-                          +  sources_q_dz_ptr[k]  * (dz * dz * d2term + d3term)));
+            double source_q    =                       particles_a_ptr[k] * potential_old[k + potential_offset];
+            double source_q_dx = particles_nx_ptr[k] * particles_a_ptr[k] * potential_old[k];
+            double source_q_dy = particles_ny_ptr[k] * particles_a_ptr[k] * potential_old[k];
+            double source_q_dz = particles_nz_ptr[k] * particles_a_ptr[k] * potential_old[k];
+
+            kernel.far_field(dx, dy, dz, eps,
+                             source_q, source_q_dx, source_q_dy, source_q_dz,
+                             pot_comp_, pot_comp_dx, pot_comp_dy, pot_comp_dz);
         }
     
 #ifdef OPENMP_ENABLED
@@ -482,7 +914,6 @@ void BoundaryElement::cluster_particle_interact(double* __restrict potential,
     }
     }
 
-    timers_.cluster_particle_interact.stop();
 }
 
 
@@ -490,19 +921,50 @@ void BoundaryElement::cluster_cluster_interact(double* __restrict potential,
                                         std::size_t target_node_idx,
                                         std::size_t source_node_idx)
 {
-    timers_.cluster_cluster_interact.start();
+    PROFILE_SCOPE(PROFILE_CC);
+
+#ifndef OPENACC_ENABLED
+    ClusterClusterKernel fixed_kernel = BoundaryElement::cluster_cluster_kernel(
+            clusters_.num_interp_pts_per_node(source_node_idx), kernel_policy_);
+    if (fixed_kernel) {
+        (this->*fixed_kernel)(potential, target_node_idx, source_node_idx);
+        return;
+    }
+#endif
+
+    switch (kernel_policy_) {
+        case UNSCREENED:
+            BoundaryElement::cluster_cluster_interact_generic<UnscreenedKernel>(potential,
+                    target_node_idx, source_node_idx);
+            break;
+        case SCREENED:
+            BoundaryElement::cluster_cluster_interact_generic<ScreenedKernel>(potential,
+                    target_node_idx, source_node_idx);
+            break;
+        case TABULATED:
+            BoundaryElement::cluster_cluster_interact_generic<TabulatedKernel>(potential,
+                    target_node_idx, source_node_idx);
+            break;
+    }
+}
 
-    int num_interp_pts_per_node = clusters_.num_interp_pts_per_node();
-    int num_charges_per_node    = clusters_.num_charges_per_node();
 
-    std::size_t target_cluster_interp_pts_begin = target_node_idx * num_interp_pts_per_node;
-    std::size_t target_cluster_potentials_begin = target_node_idx * num_charges_per_node;
+template <class Kernel>
+void BoundaryElement::cluster_cluster_interact_generic(double* __restrict potential,
+                                                std::size_t target_node_idx,
+                                                std::size_t source_node_idx)
+{
+    int num_target_interp_pts = clusters_.num_interp_pts_per_node(target_node_idx);
+    int num_source_interp_pts = clusters_.num_interp_pts_per_node(source_node_idx);
+
+    std::size_t target_cluster_interp_pts_begin = clusters_.cluster_interp_pts_idxs(target_node_idx)[0];
+    std::size_t target_cluster_potentials_begin = clusters_.cluster_potentials_idxs(target_node_idx)[0];
     
-    std::size_t source_cluster_interp_pts_begin = source_node_idx * num_interp_pts_per_node;
-    std::size_t source_cluster_charges_begin    = source_node_idx * num_charges_per_node;
+    std::size_t source_cluster_interp_pts_begin = clusters_.cluster_interp_pts_idxs(source_node_idx)[0];
+    std::size_t source_cluster_charges_begin    = clusters_.cluster_charges_idxs(source_node_idx)[0];
     
     double eps    = params_.phys_eps_;
-    double kappa  = params_.phys_kappa_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table_);
     
     const double* __restrict clusters_x_ptr    = clusters_.interp_x_ptr();
     const double* __restrict clusters_y_ptr    = clusters_.interp_y_ptr();
@@ -524,13 +986,13 @@ void BoundaryElement::cluster_cluster_interact(double* __restrict potential,
                     clusters_q_ptr, clusters_q_dx_ptr, clusters_q_dy_ptr, clusters_q_dz_ptr, \
                     potential)
 #endif
-    for (int j1 = 0; j1 < num_interp_pts_per_node; j1++) {
-    for (int j2 = 0; j2 < num_interp_pts_per_node; j2++) {
-    for (int j3 = 0; j3 < num_interp_pts_per_node; j3++) {
+    for (int j1 = 0; j1 < num_target_interp_pts; j1++) {
+    for (int j2 = 0; j2 < num_target_interp_pts; j2++) {
+    for (int j3 = 0; j3 < num_target_interp_pts; j3++) {
     
         std::size_t jj = target_cluster_potentials_begin
-                       + j1 * num_interp_pts_per_node * num_interp_pts_per_node
-                       + j2 * num_interp_pts_per_node + j3;
+                       + j1 * num_target_interp_pts * num_target_interp_pts
+                       + j2 * num_target_interp_pts + j3;
 
         double target_x = clusters_x_ptr[target_cluster_interp_pts_begin + j1];
         double target_y = clusters_y_ptr[target_cluster_interp_pts_begin + j2];
@@ -545,51 +1007,21 @@ void BoundaryElement::cluster_cluster_interact(double* __restrict potential,
         #pragma acc loop collapse(3) reduction(+:pot_comp_,   pot_comp_dx, \
                                                  pot_comp_dy, pot_comp_dz)
 #endif
-        for (int k1 = 0; k1 < num_interp_pts_per_node; k1++) {
-        for (int k2 = 0; k2 < num_interp_pts_per_node; k2++) {
-        for (int k3 = 0; k3 < num_interp_pts_per_node; k3++) {
+        for (int k1 = 0; k1 < num_source_interp_pts; k1++) {
+        for (int k2 = 0; k2 < num_source_interp_pts; k2++) {
+        for (int k3 = 0; k3 < num_source_interp_pts; k3++) {
             
             std::size_t kk = source_cluster_charges_begin
-                           + k1 * num_interp_pts_per_node * num_interp_pts_per_node
-                           + k2 * num_interp_pts_per_node + k3;
+                           + k1 * num_source_interp_pts * num_source_interp_pts
+                           + k2 * num_source_interp_pts + k3;
 
             double dx = target_x - clusters_x_ptr[source_cluster_interp_pts_begin + k1];
             double dy = target_y - clusters_y_ptr[source_cluster_interp_pts_begin + k2];
             double dz = target_z - clusters_z_ptr[source_cluster_interp_pts_begin + k3];
 
-            double r2    = dx*dx + dy*dy + dz*dz;
-            double r     = std::sqrt(r2);
-            double rinv  = 1.0 / r;
-            double r3inv = rinv  * rinv * rinv;
-            double r5inv = r3inv * rinv * rinv;
-
-            double expkr   =  std::exp(-kappa * r);
-            double d1term  =  r3inv * expkr * (1. + (kappa * r));
-            double d1term1 = -r3inv + d1term * eps;
-            double d1term2 = -r3inv + d1term / eps;
-            double d2term  =  r5inv * (-3. + expkr * (3. + (3. * kappa * r)
-                                                   + (kappa * kappa * r2)));
-            double d3term  =  r3inv * ( 1. - expkr * (1. + kappa * r));
-
-            pot_comp_    += (rinv * (1. - expkr) * (clusters_q_ptr   [kk])
-                                      + d1term1 * (clusters_q_dx_ptr[kk] * dx
-                                                 + clusters_q_dy_ptr[kk] * dy
-                                                 + clusters_q_dz_ptr[kk] * dz));
-                                    
-            pot_comp_dx  += (clusters_q_ptr   [kk]  * (d1term2 * dx)
-                          - (clusters_q_dx_ptr[kk]  * (dx * dx * d2term + d3term)
-                          +  clusters_q_dy_ptr[kk]  * (dx * dy * d2term)
-                          +  clusters_q_dz_ptr[kk]  * (dx * dz * d2term)));
-                         
-            pot_comp_dy  += (clusters_q_ptr   [kk]  *  d1term2 * dy
-                          - (clusters_q_dx_ptr[kk]  * (dx * dy * d2term)
-                          +  clusters_q_dy_ptr[kk]  * (dy * dy * d2term + d3term)
-                          +  clusters_q_dz_ptr[kk]  * (dy * dz * d2term)));
-                         
-            pot_comp_dz  += (clusters_q_ptr   [kk]  *  d1term2 * dz
-                          - (clusters_q_dx_ptr[kk]  * (dx * dz * d2term)
-                          +  clusters_q_dy_ptr[kk]  * (dy * dz * d2term)
-                          +  clusters_q_dz_ptr[kk]  * (dz * dz * d2term + d3term)));
+            kernel.far_field(dx, dy, dz, eps,
+                             clusters_q_ptr[kk], clusters_q_dx_ptr[kk], clusters_q_dy_ptr[kk], clusters_q_dz_ptr[kk],
+                             pot_comp_, pot_comp_dx, pot_comp_dy, pot_comp_dz);
         }
         }
         }
@@ -614,7 +1046,6 @@ void BoundaryElement::cluster_cluster_interact(double* __restrict potential,
     }
     }
 
-    timers_.cluster_cluster_interact.stop();
 }
 
 
@@ -622,7 +1053,7 @@ void BoundaryElement::finalize()
 {
     timers_.finalize.start();
 
-    solvation_energy_ = constants::UNITS_PARA  * particles_.compute_solvation_energy(potential_);
+    solvation_energy_ = constants::UNITS_PARA  * particles_.compute_solvation_energy(potential_, yukawa_table_);
     coulombic_energy_ = constants::UNITS_COEFF * molecule_.coulombic_energy();
     free_energy_      = solvation_energy_ + coulombic_energy_;
     
@@ -648,30 +1079,74 @@ void BoundaryElement::finalize()
 }
 
 
+static double kernel_rate(double amount, double per)
+{
+    return per > 0. ? amount / per : 0.;
+}
+
+
 void Timers_BoundaryElement::print() const
 {
     std::cout.setf(std::ios::fixed, std::ios::floatfield);
     std::cout.precision(5);
     std::cout << "|...BoundaryElement function times (s)...." << std::endl;
+    std::cout << "|   |...time to first matvec.......: ";
+    std::cout << std::setw(12) << std::right << first_matvec               .elapsed_time() << std::endl;
     std::cout << "|   |...ctor.......................: ";
     std::cout << std::setw(12) << std::right << ctor                       .elapsed_time() << std::endl;
     std::cout << "|   |...run_GMRES..................: ";
     std::cout << std::setw(12) << std::right << run_GMRES                  .elapsed_time() << std::endl;
+    std::cout << "|       |...checkpoint.............: ";
+    std::cout << std::setw(12) << std::right << checkpoint                 .elapsed_time() << std::endl;
     std::cout << "|       |...matrix_vector..........: ";
     std::cout << std::setw(12) << std::right << matrix_vector              .elapsed_time() << std::endl;
     std::cout << "|           |...PP interact........: ";
-    std::cout << std::setw(12) << std::right << particle_particle_interact .elapsed_time() << std::endl;
+    std::cout << std::setw(12) << std::right << Profiler::total_time(PROFILE_PP) << std::endl;
     std::cout << "|           |...PC interact........: ";
-    std::cout << std::setw(12) << std::right << particle_cluster_interact  .elapsed_time() << std::endl;
+    std::cout << std::setw(12) << std::right << Profiler::total_time(PROFILE_PC) << std::endl;
     std::cout << "|           |...CP interact........: ";
-    std::cout << std::setw(12) << std::right << cluster_particle_interact  .elapsed_time() << std::endl;
+    std::cout << std::setw(12) << std::right << Profiler::total_time(PROFILE_CP) << std::endl;
     std::cout << "|           |...CC interact........: ";
-    std::cout << std::setw(12) << std::right << cluster_cluster_interact   .elapsed_time() << std::endl;
+    std::cout << std::setw(12) << std::right << Profiler::total_time(PROFILE_CC) << std::endl;
+    std::cout << "|           |...task idle..........: ";
+    std::cout << std::setw(12) << std::right << interact_thread_time - interact_busy_time << std::endl;
+    std::cout << "|           |...direct sum.........: ";
+    std::cout << std::setw(12) << std::right << direct_sum                 .elapsed_time() << std::endl;
     std::cout << "|       |...precondition...........: ";
     std::cout << std::setw(12) << std::right << precondition               .elapsed_time() << std::endl;
     std::cout << "|   |...finalize...................: ";
     std::cout << std::setw(12) << std::right << finalize                   .elapsed_time() << std::endl;
     std::cout << "|" << std::endl;
+    
+    // work per matvec from the cost models, rates from the work of the whole run over the
+    // profiled time; intensities above the machine balance point to compute-bound kernels
+    const std::array<const char*, 6> names {"PP", "PC", "CP", "CC", "upward", "downward"};
+    const std::array<const KernelCount*, 6> matvec {&matvec_counts.pp, &matvec_counts.pc,
+            &matvec_counts.cp, &matvec_counts.cc, &matvec_counts.upward, &matvec_counts.downward};
+    const std::array<const KernelCount*, 6> total {&total_counts.pp, &total_counts.pc,
+            &total_counts.cp, &total_counts.cc, &total_counts.upward, &total_counts.downward};
+    const std::array<double, 6> seconds {Profiler::total_time(PROFILE_PP), Profiler::total_time(PROFILE_PC),
+            Profiler::total_time(PROFILE_CP), Profiler::total_time(PROFILE_CC),
+            Profiler::total_time(PROFILE_UPWARD_PASS), Profiler::total_time(PROFILE_DOWNWARD_PASS)};
+    
+    std::cout << "|...Kernel work per matvec, rates over " << num_matvecs << " matvecs...." << std::endl;
+    std::cout << "|   " << std::left << std::setw(10) << "kernel" << std::right
+              << std::setw(12) << "calls"  << std::setw(14) << "evaluations"
+              << std::setw(12) << "GFLOP"  << std::setw(12) << "GB"     << std::setw(10) << "flop/B"
+              << std::setw(10) << "GFLOP/s" << std::setw(10) << "GB/s" << std::endl;
+    
+    for (std::size_t k = 0; k < names.size(); ++k) {
+        std::cout << "|   " << std::left << std::setw(10) << names[k] << std::right
+                  << std::setw(12) << std::setprecision(0) << matvec[k]->calls
+                  << std::setw(14) << matvec[k]->evaluations << std::setprecision(5)
+                  << std::setw(12) << matvec[k]->flops * 1e-9
+                  << std::setw(12) << matvec[k]->bytes * 1e-9 << std::setprecision(3)
+                  << std::setw(10) << kernel_rate(matvec[k]->flops, matvec[k]->bytes)
+                  << std::setw(10) << kernel_rate(total[k]->flops * 1e-9, seconds[k])
+                  << std::setw(10) << kernel_rate(total[k]->bytes * 1e-9, seconds[k]) << std::endl;
+    }
+    std::cout << "|   (rates are per thread, the kernel times being summed over threads)" << std::endl;
+    std::cout << "|" << std::endl;
 }
 
 
@@ -680,13 +1155,31 @@ std::string Timers_BoundaryElement::get_durations() const
     std::string durations;
     durations.append(std::to_string(ctor                       .elapsed_time())).append(", ");
     durations.append(std::to_string(run_GMRES                  .elapsed_time())).append(", ");
+    durations.append(std::to_string(checkpoint                 .elapsed_time())).append(", ");
     durations.append(std::to_string(matrix_vector              .elapsed_time())).append(", ");
-    durations.append(std::to_string(particle_particle_interact .elapsed_time())).append(", ");
-    durations.append(std::to_string(particle_cluster_interact  .elapsed_time())).append(", ");
-    durations.append(std::to_string(cluster_particle_interact  .elapsed_time())).append(", ");
-    durations.append(std::to_string(cluster_cluster_interact   .elapsed_time())).append(", ");
+    durations.append(std::to_string(Profiler::total_time(PROFILE_PP))).append(", ");
+    durations.append(std::to_string(Profiler::total_time(PROFILE_PC))).append(", ");
+    durations.append(std::to_string(Profiler::total_time(PROFILE_CP))).append(", ");
+    durations.append(std::to_string(Profiler::total_time(PROFILE_CC))).append(", ");
+    durations.append(std::to_string(direct_sum                 .elapsed_time())).append(", ");
     durations.append(std::to_string(precondition               .elapsed_time())).append(", ");
     durations.append(std::to_string(finalize                   .elapsed_time())).append(", ");
+    durations.append(std::to_string(num_matvecs)).append(", ");
+    durations.append(std::to_string(first_matvec               .elapsed_time())).append(", ");
+    
+    auto append_counts = [&](const KernelCount& matvec, const KernelCount& total, const char* region) {
+        durations.append(std::to_string(matvec.calls)).append(", ");
+        durations.append(std::to_string(matvec.evaluations)).append(", ");
+        durations.append(std::to_string(matvec.flops)).append(", ");
+        durations.append(std::to_string(matvec.bytes)).append(", ");
+        durations.append(std::to_string(kernel_rate(total.flops * 1e-9, Profiler::total_time(region)))).append(", ");
+    };
+    append_counts(matvec_counts.pp,       total_counts.pp,       PROFILE_PP);
+    append_counts(matvec_counts.pc,       total_counts.pc,       PROFILE_PC);
+    append_counts(matvec_counts.cp,       total_counts.cp,       PROFILE_CP);
+    append_counts(matvec_counts.cc,       total_counts.cc,       PROFILE_CC);
+    append_counts(matvec_counts.upward,   total_counts.upward,   PROFILE_UPWARD_PASS);
+    append_counts(matvec_counts.downward, total_counts.downward, PROFILE_DOWNWARD_PASS);
     
     return durations;
 }
@@ -697,13 +1190,25 @@ std::string Timers_BoundaryElement::get_headers() const
     std::string headers;
     headers.append("BoundaryElement ctor, ");
     headers.append("BoundaryElement run_GMRES, ");
+    headers.append("BoundaryElement checkpoint, ");
     headers.append("BoundaryElement matrix_vector, ");
     headers.append("BoundaryElement particle_particle_interact, ");
     headers.append("BoundaryElement particle_cluster_interact, ");
     headers.append("BoundaryElement cluster_particle_interact, ");
     headers.append("BoundaryElement cluster_cluster_interact, ");
+    headers.append("BoundaryElement direct_sum, ");
     headers.append("BoundaryElement precondition, ");
     headers.append("BoundaryElement finalize, ");
+    headers.append("BoundaryElement num_matvecs, ");
+    headers.append("BoundaryElement time_to_first_matvec, ");
+    
+    for (const char* kernel : {"PP", "PC", "CP", "CC", "upward", "downward"}) {
+        headers.append("BoundaryElement ").append(kernel).append(" calls, ");
+        headers.append("BoundaryElement ").append(kernel).append(" evaluations, ");
+        headers.append("BoundaryElement ").append(kernel).append(" flops, ");
+        headers.append("BoundaryElement ").append(kernel).append(" bytes, ");
+        headers.append("BoundaryElement ").append(kernel).append(" gflops_per_second, ");
+    }
     
     return headers;
 }
@@ -1,14 +1,56 @@
 #ifndef H_TABIPB_TREECODE_STRUCT_H
 #define H_TABIPB_TREECODE_STRUCT_H
 
+#include <string>
+#include <vector>
+#include <cstdint>
+
 #include "timer.h"
 #include "particles.h"
 #include "clusters.h"
 #include "interaction_list.h"
+#include "telemetry.h"
+#include "yukawa_table.h"
 
 struct Timers_BoundaryElement;
 struct Timers;
 
+/* The work of one kernel, from the cost models in kernel_costs.h. An evaluation is
+ * one target-source pair, where a cluster stands for its interpolation charges. */
+struct KernelCount
+{
+    double calls       = 0.;
+    double evaluations = 0.;
+    double flops       = 0.;
+    double bytes       = 0.;
+    
+    KernelCount& operator+=(const KernelCount& other)
+    {
+        calls       += other.calls;
+        evaluations += other.evaluations;
+        flops       += other.flops;
+        bytes       += other.bytes;
+        return *this;
+    }
+};
+
+struct InteractionCounts
+{
+    KernelCount pp;
+    KernelCount pc;
+    KernelCount cp;
+    KernelCount cc;
+    KernelCount upward;
+    KernelCount downward;
+    
+    InteractionCounts& operator+=(const InteractionCounts& other)
+    {
+        pp += other.pp;  pc += other.pc;  cp += other.cp;  cc += other.cc;
+        upward += other.upward;  downward += other.downward;
+        return *this;
+    }
+};
+
 class BoundaryElement
 {
 private:
@@ -23,6 +65,7 @@ private:
     std::vector<double> potential_;
     
     long int num_iter_;
+    long int restart_iter_;
     double residual_;
     
     double solvation_energy_;
@@ -34,30 +77,121 @@ private:
     double pot_normal_min_;
     double pot_normal_max_;
     
+    double direct_sample_error_;
+    
+    // which kernel_policy.h policy the kernels run: without kappa terms at zero ionic
+    // strength, and with exp(-kappa r) from yukawa_table_ when kernel_exp_tol is set
+    enum KernelPolicy { UNSCREENED, SCREENED, TABULATED };
+    KernelPolicy kernel_policy_;
+    YukawaTable yukawa_table_;
+    
+    class Telemetry telemetry_;
+    
     int gmres_(long int n, const double* b, double* x, long int restrt,
                double* work, long int ldw, double *h, long int ldh,
                long int& iter, double& residual);
     
+    std::uint64_t geometry_hash() const;
+    bool read_checkpoint(const std::string& path);
+    void write_checkpoint(const std::string& path, const double* potential, long int iter, double residual);
+    void write_telemetry(const char* record_type, long int iter, double residual);
+    
+    void count_interactions();
+    KernelCount direct_sum_count() const;
+    
     void matrix_vector(double alpha, const double* __restrict potential_old,
                        double beta,        double* __restrict potential_new);
+    
+    // the upward pass and every interaction of a matvec; with tree_task_graph they
+    // run as a task graph, where the interactions with particle sources overlap the
+    // upward pass
+    void interact(double* __restrict potential, const double* __restrict potential_old);
+    void interact_task_graph(double* __restrict potential, const double* __restrict potential_old);
+    
+    // the interactions of one target node with particle sources, which read no
+    // cluster charges, and with cluster sources, which wait for the upward pass
+    void interact_particle_sources(double* __restrict potential, const double* __restrict potential_old,
+                                   std::size_t target_node_idx);
+    void interact_cluster_sources(double* __restrict potential, std::size_t target_node_idx);
+                       
+    void direct_sum_interact(double* __restrict potential, const double* __restrict potential_old);
+    void direct_sum_rows(const double* potential_old, const std::vector<std::size_t>& rows,
+                         std::vector<double>& result);
                        
     void precondition_diagonal(double* z, double* r);
     void precondition_block(double* z, double* r);
+    template <class Kernel> void precondition_block_leaves(double* z, double* r);
     
     void particle_particle_interact(double* __restrict potential,
                               const double* __restrict potential_old,
             std::array<std::size_t, 2> target_node_particle_idxs,
             std::array<std::size_t, 2> source_node_particle_idxs);
     
+    void particle_particle_interact_packed(double* __restrict potential,
+                                     const double* __restrict potential_old,
+            std::array<std::size_t, 2> target_node_particle_idxs,
+            std::array<std::size_t, 2> source_node_particle_idxs);
+    
     void particle_cluster_interact(double* __restrict potential,
             std::array<std::size_t, 2> target_node_particle_idxs, std::size_t source_node_idx);
                                    
-    void cluster_particle_interact(double* __restrict potential,
+    void cluster_particle_interact(double* __restrict potential, const double* __restrict potential_old,
             std::size_t target_node_idx, std::array<std::size_t, 2> source_node_particle_idxs);
             
     void cluster_cluster_interact(double* __restrict potential,
             std::size_t target_node_idx, std::size_t source_node_idx);
     
+    // the kernels above run these with the policy of kernel_policy_
+    template <class Kernel> void particle_particle_interact_generic(double* __restrict potential,
+                              const double* __restrict potential_old,
+            std::array<std::size_t, 2> target_node_particle_idxs,
+            std::array<std::size_t, 2> source_node_particle_idxs);
+    template <class Kernel> void particle_particle_interact_packed_generic(double* __restrict potential,
+                                     const double* __restrict potential_old,
+            std::array<std::size_t, 2> target_node_particle_idxs,
+            std::array<std::size_t, 2> source_node_particle_idxs);
+    template <class Kernel> void particle_cluster_interact_generic(double* __restrict potential,
+            std::array<std::size_t, 2> target_node_particle_idxs, std::size_t source_node_idx);
+    template <class Kernel> void cluster_particle_interact_generic(double* __restrict potential,
+                                     const double* __restrict potential_old,
+            std::size_t target_node_idx, std::array<std::size_t, 2> source_node_particle_idxs);
+    template <class Kernel> void cluster_cluster_interact_generic(double* __restrict potential,
+            std::size_t target_node_idx, std::size_t source_node_idx);
+    
+    // over the unordered pairs of the mutual interaction lists, adding to both nodes
+    void particle_particle_interact_mutual(double* __restrict potential,
+                                     const double* __restrict potential_old,
+            std::array<std::size_t, 2> node_particle_idxs_a,
+            std::array<std::size_t, 2> node_particle_idxs_b);
+    
+    void cluster_cluster_interact_mutual(double* __restrict potential,
+            std::size_t node_idx_a, std::size_t node_idx_b);
+    
+    template <class Kernel> void particle_particle_interact_mutual_generic(double* __restrict potential,
+                                     const double* __restrict potential_old,
+            std::array<std::size_t, 2> node_particle_idxs_a,
+            std::array<std::size_t, 2> node_particle_idxs_b);
+    template <class Kernel> void cluster_cluster_interact_mutual_generic(double* __restrict potential,
+            std::size_t node_idx_a, std::size_t node_idx_b);
+    
+    // far-field kernels compiled for a fixed number of interpolation points, for degrees
+    // 1 to 8; the kernel lookups return null for any other degree
+    using ParticleClusterKernel = void (BoundaryElement::*)(double*, std::array<std::size_t, 2>, std::size_t);
+    using ClusterParticleKernel = void (BoundaryElement::*)(double*, const double*, std::size_t, std::array<std::size_t, 2>);
+    using ClusterClusterKernel  = void (BoundaryElement::*)(double*, std::size_t, std::size_t);
+    
+    template <class Kernel, int NP> void particle_cluster_interact_fixed(double* __restrict potential,
+            std::array<std::size_t, 2> target_node_particle_idxs, std::size_t source_node_idx);
+    template <class Kernel, int NP> void cluster_particle_interact_fixed(double* __restrict potential,
+                                     const double* __restrict potential_old,
+            std::size_t target_node_idx, std::array<std::size_t, 2> source_node_particle_idxs);
+    template <class Kernel, int NS> void cluster_cluster_interact_fixed(double* __restrict potential,
+            std::size_t target_node_idx, std::size_t source_node_idx);
+    
+    static ParticleClusterKernel particle_cluster_kernel(int num_interp_pts, KernelPolicy policy);
+    static ClusterParticleKernel cluster_particle_kernel(int num_interp_pts, KernelPolicy policy);
+    static ClusterClusterKernel  cluster_cluster_kernel (int num_source_interp_pts, KernelPolicy policy);
+    
 public:
     BoundaryElement(class Particles& particles, class Clusters& clusters,
              const class Tree& tree, const class InteractionList& interaction_list,
@@ -66,9 +200,12 @@ public:
     ~BoundaryElement() = default;
     
     void run_GMRES();
+    void sample_direct_error();
     void finalize();
     
     friend std::array<double, 3> Output(const BoundaryElement&, const Timers&);
+    friend class Tuner;
+    friend class KernelBenchmark;
 };
 
 
@@ -76,14 +213,28 @@ struct Timers_BoundaryElement
 {
     Timer ctor;
     Timer run_GMRES;
+    Timer checkpoint;
     Timer finalize;
 
     Timer matrix_vector;
+    Timer direct_sum;
     Timer precondition;
-    Timer particle_particle_interact;
-    Timer particle_cluster_interact;
-    Timer cluster_particle_interact;
-    Timer cluster_cluster_interact;
+    
+    // from the start of the run to the first matvec; started when the enclosing Timers
+    // is made, and again by main with the total time. The setup pipeline shortens it
+    Timer first_matvec;
+    
+    // the interaction kernels run concurrently, so they are timed by the profiler
+    
+    // over every matvec, the thread time the interaction task graph held, and the
+    // part of it spent in tasks; the rest is idle time its dependencies cost
+    double interact_thread_time = 0.;
+    double interact_busy_time = 0.;
+    
+    // the work of one matvec, and of every matvec and sampled row of the run
+    InteractionCounts matvec_counts;
+    InteractionCounts total_counts;
+    std::size_t num_matvecs = 0;
 
     void print() const;
     std::string get_durations() const;
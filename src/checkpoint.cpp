@@ -0,0 +1,168 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+    #include <process.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "hash.h"
+#include "boundary_element.h"
+
+/*  A GMRES checkpoint is written at restart boundaries, where the iterate and
+ *  the iteration count are the whole solver state. The file is a fixed header
+ *  followed by the particle order and the iterate in that order. The header
+ *  carries a hash of the surface in its original (unsorted) order and of the
+ *  physical parameters, so a checkpoint is accepted by any run on the same
+ *  problem, and mapped onto that run's own particle order. */
+
+static constexpr char          CHECKPOINT_MAGIC[8] = {'T', 'A', 'B', 'I', 'C', 'K', 'P', 'T'};
+static constexpr std::uint32_t CHECKPOINT_VERSION = 1;
+
+struct CheckpointHeader
+{
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t num_particles;
+    std::int64_t  iter;
+    double        residual;
+    std::uint64_t geometry_hash;
+};
+
+
+std::uint64_t BoundaryElement::geometry_hash() const
+{
+    std::size_t num = particles_.num();
+    const std::size_t* order = particles_.order_ptr();
+
+    std::vector<double> geometry(6 * num);
+    for (std::size_t i = 0; i < num; ++i) {
+        double* vertex = &geometry[6 * order[i]];
+        vertex[0] = particles_.x_ptr()[i];
+        vertex[1] = particles_.y_ptr()[i];
+        vertex[2] = particles_.z_ptr()[i];
+        vertex[3] = particles_.nx_ptr()[i];
+        vertex[4] = particles_.ny_ptr()[i];
+        vertex[5] = particles_.nz_ptr()[i];
+    }
+
+    FNV1a hash;
+    hash.add(&num, sizeof(num));
+    hash.add(geometry.data(), geometry.size() * sizeof(double));
+    hash.add(&params_.phys_eps_,   sizeof(params_.phys_eps_));
+    hash.add(&params_.phys_kappa_, sizeof(params_.phys_kappa_));
+
+    return hash.value();
+}
+
+
+bool BoundaryElement::read_checkpoint(const std::string& path)
+{
+    timers_.checkpoint.start();
+
+    std::size_t num = particles_.num();
+    std::ifstream checkpoint_file(path, std::ios::binary);
+
+    CheckpointHeader header;
+    checkpoint_file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    std::string problem;
+    if (!checkpoint_file.good())
+        problem = "could not be read";
+    else if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0
+          || header.version != CHECKPOINT_VERSION)
+        problem = "is not a TABI-PB checkpoint";
+    else if (header.num_particles != num || header.geometry_hash != geometry_hash())
+        problem = "belongs to a different surface or physical parameters";
+
+    std::vector<std::uint64_t> saved_order(num);
+    std::vector<double> saved_potential(2 * num);
+
+    if (problem.empty()) {
+        checkpoint_file.read(reinterpret_cast<char*>(saved_order.data()),     num     * sizeof(std::uint64_t));
+        checkpoint_file.read(reinterpret_cast<char*>(saved_potential.data()), 2 * num * sizeof(double));
+        if (!checkpoint_file.good()) problem = "is truncated";
+    }
+
+    if (!problem.empty()) {
+        std::cout << "Restart file " << path << " " << problem << ". Starting GMRES from zero." << std::endl;
+        timers_.checkpoint.stop();
+        return false;
+    }
+
+    // back to the original order, then into this run's order
+    std::vector<double> original(2 * num);
+    for (std::size_t i = 0; i < num; ++i) {
+        original[saved_order[i]]       = saved_potential[i];
+        original[saved_order[i] + num] = saved_potential[i + num];
+    }
+
+    const std::size_t* order = particles_.order_ptr();
+    for (std::size_t i = 0; i < num; ++i) {
+        potential_[i]       = original[order[i]];
+        potential_[i + num] = original[order[i] + num];
+    }
+
+    restart_iter_ = header.iter;
+
+    std::ostringstream line;
+    line << "Resuming GMRES from " << path << " at iteration " << restart_iter_
+         << ", error = " << std::scientific << header.residual << ".";
+    std::cout << line.str() << std::endl;
+
+    timers_.checkpoint.stop();
+
+    return true;
+}
+
+
+void BoundaryElement::write_checkpoint(const std::string& path, const double* potential,
+                                       long int iter, double residual)
+{
+    timers_.checkpoint.start();
+
+    std::size_t num = particles_.num();
+
+    CheckpointHeader header;
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version       = CHECKPOINT_VERSION;
+    header.reserved      = 0;
+    header.num_particles = num;
+    header.iter          = iter;
+    header.residual      = residual;
+    header.geometry_hash = geometry_hash();
+
+    std::vector<std::uint64_t> order(particles_.order_ptr(), particles_.order_ptr() + num);
+
+    // write to a temporary of this process and rename, so a run killed mid-write keeps the
+    // previous checkpoint and runs checkpointing to the same path never share a file
+#ifdef _WIN32
+    std::string temp_path = path + "." + std::to_string(_getpid()) + ".tmp";
+#else
+    std::string temp_path = path + "." + std::to_string(getpid()) + ".tmp";
+#endif
+    std::ofstream checkpoint_file(temp_path, std::ios::binary);
+
+    checkpoint_file.write(reinterpret_cast<const char*>(&header),      sizeof(header));
+    checkpoint_file.write(reinterpret_cast<const char*>(order.data()), num     * sizeof(std::uint64_t));
+    checkpoint_file.write(reinterpret_cast<const char*>(potential),    2 * num * sizeof(double));
+    checkpoint_file.close();
+
+    if (!checkpoint_file.good() || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        std::cout << "Could not write checkpoint file " << path << "." << std::endl;
+    } else {
+        std::cout << "Wrote GMRES checkpoint " << path << " at iteration " << iter << "." << std::endl;
+    }
+
+    timers_.checkpoint.stop();
+}
@@ -1,25 +1,141 @@
+#include <algorithm>
 #include <array>
 #include <limits>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <cmath>
 #include <cstddef>
 #include <cstring>
 
 #include "constants.h"
+#include "profiler.h"
+#include "task_graph.h"
 #include "clusters.h"
 
-Clusters::Clusters(const class Particles& particles, const class Tree& tree, 
+static constexpr char PROFILE_UPWARD_PASS[] = "run_GMRES/iteration/matrix_vector/upward_pass";
+
+Clusters::Clusters(const class Particles& particles, const class Tree& tree,
+                   const class InteractionList& interaction_list,
                    const struct Params& params, struct Timers_Clusters& timers)
     : particles_(particles), tree_(tree), params_(params), timers_(timers)
 {
     timers_.ctor.start();
 
-    num_interp_pts_per_node_ = params_.tree_degree_ + 1;
-    num_charges_per_node_    = std::pow(num_interp_pts_per_node_, 3);
+    max_num_interp_pts_per_node_ = params_.tree_degree_ + 1;
+    weights_ = Clusters::barycentric_weights();
+    node_num_interp_pts_.assign(tree_.num_nodes(), max_num_interp_pts_per_node_);
+    
+    // With adaptive degrees, tree_degree is the degree a cluster needs at the worst
+    // separation the MAC admits, two equal nodes touching the acceptance sphere. That
+    // sets the error target; every other cluster gets the lowest degree meeting it at
+    // its own worst separation, and never more than tree_degree.
+    if (params_.tree_adaptive_degree_) {
+        
+        double ref_ratio = 0.5 * params_.tree_theta_ / (1. - 0.5 * params_.tree_theta_);
+        double tolerance = std::pow(ref_ratio, params_.tree_degree_ + 1);
+        
+        const std::vector<double>& node_ratio = interaction_list.node_separation_ratio();
+        
+        for (std::size_t node_idx = 0; node_idx < tree_.num_nodes(); ++node_idx) {
+            int degree = 1;
+            while (degree < params_.tree_degree_ && std::pow(node_ratio[node_idx], degree + 1) > tolerance)
+                ++degree;
+            node_num_interp_pts_[node_idx] = degree + 1;
+        }
+    }
+    
+    // the upward pass only feeds particle-cluster and cluster-cluster interactions,
+    // and the downward pass only cluster-particle and cluster-cluster ones
+    std::vector<char> is_source(tree_.num_nodes(), 0);
+    std::vector<char> is_target(tree_.num_nodes(), 0);
+    
+    for (std::size_t node_idx = 0; node_idx < tree_.num_nodes(); ++node_idx) {
+        for (auto partner_idx : interaction_list.particle_cluster(node_idx)) is_source[partner_idx] = 1;
+        
+        if (!interaction_list.cluster_particle(node_idx).empty()) is_target[node_idx] = 1;
+        
+        for (auto partner_idx : interaction_list.cluster_cluster(node_idx)) {
+            is_source[partner_idx] = 1;
+            is_target[node_idx]    = 1;
+        }
+        
+        for (auto partner_idx : interaction_list.mutual_cluster_cluster(node_idx)) {
+            is_source[partner_idx] = is_target[partner_idx] = 1;
+            is_source[node_idx]    = is_target[node_idx]    = 1;
+        }
+    }
+    
+    for (std::size_t node_idx = 0; node_idx < tree_.num_nodes(); ++node_idx) {
+        if (is_source[node_idx]) source_nodes_.push_back(node_idx);
+        if (is_target[node_idx]) target_nodes_.push_back(node_idx);
+        if (!is_source[node_idx] && !is_target[node_idx]) node_num_interp_pts_[node_idx] = 0;
+    }
+    
+    // a node is numbered before its children, so walking up from a leaf and reversing
+    // gives its target nodes in the order the node-by-node downward pass visits them
+    leaf_target_nodes_begin_.reserve(tree_.leaves().size() + 1);
+    leaf_target_nodes_begin_.push_back(0);
+    
+    for (auto leaf_idx : tree_.leaves()) {
+        std::size_t leaf_begin = leaf_target_nodes_.size();
+        std::size_t node_idx = leaf_idx;
+        
+        while (true) {
+            if (is_target[node_idx]) leaf_target_nodes_.push_back(node_idx);
+            if (node_idx == 0) break;
+            node_idx = tree_.node_parent_idx(node_idx);
+        }
+        
+        std::reverse(leaf_target_nodes_.begin() + leaf_begin, leaf_target_nodes_.end());
+        leaf_target_nodes_begin_.push_back(leaf_target_nodes_.size());
+    }
+    
+    // the slot maps: a source node has charges and a target node potentials, each
+    // packed in node order, and any other node gets an empty slot
+    node_interp_pts_begin_.resize(tree_.num_nodes() + 1);
+    node_charges_begin_   .resize(tree_.num_nodes() + 1);
+    node_potentials_begin_.resize(tree_.num_nodes() + 1);
+    
+    node_interp_pts_begin_[0] = 0;
+    node_charges_begin_   [0] = 0;
+    node_potentials_begin_[0] = 0;
+    
+    for (std::size_t node_idx = 0; node_idx < tree_.num_nodes(); ++node_idx) {
+        std::size_t num_interp_pts = node_num_interp_pts_[node_idx];
+        std::size_t num_node_charges = num_interp_pts * num_interp_pts * num_interp_pts;
+        node_interp_pts_begin_[node_idx + 1] = node_interp_pts_begin_[node_idx] + num_interp_pts;
+        node_charges_begin_   [node_idx + 1] = node_charges_begin_   [node_idx]
+                                             + (is_source[node_idx] ? num_node_charges : 0);
+        node_potentials_begin_[node_idx + 1] = node_potentials_begin_[node_idx]
+                                             + (is_target[node_idx] ? num_node_charges : 0);
+    }
     
-    num_interp_pts_ = tree_.num_nodes() * num_interp_pts_per_node_;
-    num_charges_    = tree_.num_nodes() * num_charges_per_node_;
+    num_interp_pts_ = node_interp_pts_begin_[tree_.num_nodes()];
+    num_charges_    = node_charges_begin_   [tree_.num_nodes()];
+    num_potentials_ = node_potentials_begin_[tree_.num_nodes()];
+    
+    if (params_.tree_adaptive_degree_) {
+        std::size_t num_fixed_charges = source_nodes_.size() * max_num_interp_pts_per_node_
+                                      * max_num_interp_pts_per_node_ * max_num_interp_pts_per_node_;
+        std::cout << "Adaptive interpolation degree: " << num_charges_ << " of "
+                  << num_fixed_charges << " fixed-degree cluster charges."
+                  << std::endl;
+    }
+    
+    // against every node at tree_degree, with a charge and a potential per point
+    double num_dense_charges = (double)tree_.num_nodes() * max_num_interp_pts_per_node_
+                             * max_num_interp_pts_per_node_ * max_num_interp_pts_per_node_;
+    double dense_bytes = sizeof(double) * (3. * tree_.num_nodes() * max_num_interp_pts_per_node_
+                                         + 8. * num_dense_charges);
+    
+    std::ostringstream line;
+    line << "Cluster storage: " << std::fixed << std::setprecision(1)
+         << Clusters::memory_bytes() / 1048576. << " MB for " << source_nodes_.size()
+         << " source and " << target_nodes_.size() << " target clusters of "
+         << tree_.num_nodes() << " nodes, against " << dense_bytes / 1048576.
+         << " MB for every node.";
+    std::cout << line.str() << std::endl;
 
     interp_x_.resize(num_interp_pts_);
     interp_y_.resize(num_interp_pts_);
@@ -30,10 +146,10 @@ Clusters::Clusters(const class Particles& particles, const class Tree& tree,
     interp_charge_dy_.resize(num_charges_);
     interp_charge_dz_.resize(num_charges_);
     
-    interp_potential_.resize(num_charges_);
-    interp_potential_dx_.resize(num_charges_);
-    interp_potential_dy_.resize(num_charges_);
-    interp_potential_dz_.resize(num_charges_);
+    interp_potential_.resize(num_potentials_);
+    interp_potential_dx_.resize(num_potentials_);
+    interp_potential_dy_.resize(num_potentials_);
+    interp_potential_dz_.resize(num_potentials_);
 
     timers_.ctor.stop();
 }
@@ -47,11 +163,11 @@ void Clusters::compute_all_interp_pts()
     double* __restrict clusters_y_ptr   = interp_y_.data();
     double* __restrict clusters_z_ptr   = interp_z_.data();
     
-    int degree = params_.tree_degree_;
-    int num_interp_pts_per_node = num_interp_pts_per_node_;
     for (std::size_t node_idx = 0; node_idx < tree_.num_nodes(); ++node_idx) {
     
-        std::size_t node_start = node_idx * num_interp_pts_per_node_;
+        std::size_t node_start = node_interp_pts_begin_[node_idx];
+        int num_interp_pts_per_node = node_num_interp_pts_[node_idx];
+        int degree = num_interp_pts_per_node - 1;
         auto node_bounds = tree_.node_particle_bounds(node_idx);
 
 #ifdef OPENACC_ENABLED
@@ -69,10 +185,68 @@ void Clusters::compute_all_interp_pts()
 }
 
 
-void Clusters::upward_pass()
+void Clusters::upward_pass(const double* __restrict potential)
 {
     timers_.upward_pass.start();
 
+#ifdef OPENACC_ENABLED
+    const double* weights_ptr = weights_.data();
+    int weights_num = weights_.size();
+
+    #pragma acc enter data copyin(weights_ptr[0:weights_num])
+
+    for (auto node_idx : source_nodes_)
+        Clusters::upward_pass_node(node_idx, weights_ptr, potential);
+
+    #pragma acc exit data delete(weights_ptr[0:weights_num])
+#else
+    for (auto node_idx : source_nodes_)
+        Clusters::upward_pass(node_idx, potential);
+#endif
+
+    timers_.upward_pass.stop();
+}
+
+
+std::size_t Clusters::upward_pass(class TaskGraph& graph, const double* __restrict potential)
+{
+    std::size_t upward_begin = graph.add([=]() {
+        timers_.upward_pass.start();
+        upward_perf_scope_.reset(new PerfScope(PerfCounters::UPWARD_PASS));
+    });
+    
+    std::vector<std::size_t> upward_tasks;
+    for (auto node_idx : source_nodes_) {
+        upward_tasks.push_back(graph.add([=]() {
+            PROFILE_SCOPE(PROFILE_UPWARD_PASS);
+            Clusters::upward_pass(node_idx, potential);
+        }));
+        graph.depend(upward_tasks.back(), upward_begin);
+    }
+    
+    std::size_t upward_end = graph.add([=]() {
+        upward_perf_scope_.reset();
+        timers_.upward_pass.stop();
+    });
+    for (auto upward_task : upward_tasks) graph.depend(upward_end, upward_task);
+    
+    return upward_end;
+}
+
+
+void Clusters::upward_pass(std::size_t node_idx, const double* __restrict potential)
+{
+    UpwardNodeKernel upward_node = Clusters::upward_node_kernel(node_num_interp_pts_[node_idx]);
+    if (upward_node)
+        (this->*upward_node)(node_idx, weights_.data(), potential);
+    else
+        Clusters::upward_pass_node(node_idx, weights_.data(), potential);
+}
+
+
+void Clusters::upward_pass_node(std::size_t node_idx, const double* weights_ptr,
+                                const double* __restrict potential)
+{
     const double* __restrict clusters_x_ptr   = interp_x_.data();
     const double* __restrict clusters_y_ptr   = interp_y_.data();
     const double* __restrict clusters_z_ptr   = interp_z_.data();
@@ -86,189 +260,226 @@ void Clusters::upward_pass()
     const double* __restrict particles_y_ptr  = particles_.y_ptr();
     const double* __restrict particles_z_ptr  = particles_.z_ptr();
     
-    const double* __restrict sources_q_ptr    = particles_.source_charge_ptr();
-    const double* __restrict sources_q_dx_ptr = particles_.source_charge_dx_ptr();
-    const double* __restrict sources_q_dy_ptr = particles_.source_charge_dy_ptr();
-    const double* __restrict sources_q_dz_ptr = particles_.source_charge_dz_ptr();
-        
-    std::vector<double> weights (num_interp_pts_per_node_);
-    double* weights_ptr = weights.data();
-    int weights_num = weights.size();
+    const double* __restrict particles_nx_ptr = particles_.nx_ptr();
+    const double* __restrict particles_ny_ptr = particles_.ny_ptr();
+    const double* __restrict particles_nz_ptr = particles_.nz_ptr();
+    const double* __restrict particles_a_ptr  = particles_.area_ptr();
     
-    for (int i = 0; i < weights_num; ++i) {
-        weights[i] = ((i % 2 == 0)? 1 : -1);
-        if (i == 0 || i == weights_num-1) weights[i] = ((i % 2 == 0)? 1 : -1) * 0.5;
-    }
-
-    int num_interp_pts_per_node = num_interp_pts_per_node_;
+    std::size_t potential_offset = particles_.num();
     
-#ifdef OPENACC_ENABLED
-    #pragma acc enter data copyin(weights_ptr[0:weights_num])
-#endif
+    auto particle_idxs = tree_.node_particle_idxs(node_idx);
+    
+    std::size_t node_interp_pts_start = node_interp_pts_begin_[node_idx];
+    std::size_t node_charges_start    = node_charges_begin_[node_idx];
+    
+    int num_interp_pts_per_node = node_num_interp_pts_[node_idx];
+    std::size_t node_weights_start = num_interp_pts_per_node * max_num_interp_pts_per_node_;
+    
+    std::size_t particle_start = particle_idxs[0];
+    std::size_t num_particles  = particle_idxs[1] - particle_idxs[0];
+    
+    std::vector<int> exact_idx_x(num_particles);
+    std::vector<int> exact_idx_y(num_particles);
+    std::vector<int> exact_idx_z(num_particles);
+    std::vector<double> denominator(num_particles);
+    
+    int* exact_idx_x_ptr = exact_idx_x.data();
+    int* exact_idx_y_ptr = exact_idx_y.data();
+    int* exact_idx_z_ptr = exact_idx_z.data();
+    double* denominator_ptr = denominator.data();
     
-    for (std::size_t node_idx = 0; node_idx < tree_.num_nodes(); ++node_idx) {
-        
-        auto particle_idxs = tree_.node_particle_idxs(node_idx);
-        
-        std::size_t node_interp_pts_start = node_idx * num_interp_pts_per_node_;
-        std::size_t node_charges_start    = node_idx * num_charges_per_node_;
-        
-        std::size_t particle_start = particle_idxs[0];
-        std::size_t num_particles  = particle_idxs[1] - particle_idxs[0];
-        
-        std::vector<int> exact_idx_x(num_particles);
-        std::vector<int> exact_idx_y(num_particles);
-        std::vector<int> exact_idx_z(num_particles);
-        std::vector<double> denominator(num_particles);
-        
-        int* exact_idx_x_ptr = exact_idx_x.data();
-        int* exact_idx_y_ptr = exact_idx_y.data();
-        int* exact_idx_z_ptr = exact_idx_z.data();
-        double* denominator_ptr = denominator.data();
-        
 #ifdef OPENACC_ENABLED
 #pragma acc kernels present(particles_x_ptr, particles_y_ptr, particles_z_ptr, \
-                         sources_q_ptr, sources_q_dx_ptr, sources_q_dy_ptr, sources_q_dz_ptr, \
+                         particles_nx_ptr, particles_ny_ptr, particles_nz_ptr, particles_a_ptr, potential, \
                          clusters_x_ptr, clusters_y_ptr, clusters_z_ptr, \
                          clusters_q_ptr, clusters_q_dx_ptr, clusters_q_dy_ptr, clusters_q_dz_ptr, \
                          weights_ptr) \
                   create(exact_idx_x_ptr[0:num_particles], exact_idx_y_ptr[0:num_particles], \
                          exact_idx_z_ptr[0:num_particles], denominator_ptr[0:num_particles])
 #endif
-        {
+    {
 
 #ifdef OPENACC_ENABLED
-        #pragma acc loop vector(32) independent
+    #pragma acc loop vector(32) independent
 #endif
-        for (std::size_t i = 0; i < num_particles; ++i) {
-            exact_idx_x_ptr[i] = -1;
-            exact_idx_y_ptr[i] = -1;
-            exact_idx_z_ptr[i] = -1;
-        }
+    for (std::size_t i = 0; i < num_particles; ++i) {
+        exact_idx_x_ptr[i] = -1;
+        exact_idx_y_ptr[i] = -1;
+        exact_idx_z_ptr[i] = -1;
+    }
 
 #ifdef OPENACC_ENABLED
-        #pragma acc loop independent
+    #pragma acc loop independent
 #endif
-        for (std::size_t i = 0; i < num_particles; ++i) {
+    for (std::size_t i = 0; i < num_particles; ++i) {
+    
+        double denominator_x = 0.;
+        double denominator_y = 0.;
+        double denominator_z = 0.;
         
-            double denominator_x = 0.;
-            double denominator_y = 0.;
-            double denominator_z = 0.;
-            
-            double xx    = particles_x_ptr[particle_start + i];
-            double yy    = particles_y_ptr[particle_start + i];
-            double zz    = particles_z_ptr[particle_start + i];
+        double xx    = particles_x_ptr[particle_start + i];
+        double yy    = particles_y_ptr[particle_start + i];
+        double zz    = particles_z_ptr[particle_start + i];
 
-            // because there's a reduction over exact_idx[i], this loop carries a 
-            // backward dependence and won't actually parallelize
+        // because there's a reduction over exact_idx[i], this loop carries a 
+        // backward dependence and won't actually parallelize
 #ifdef OPENACC_ENABLED
-            #pragma acc loop reduction(+:denominator_x,denominator_y,denominator_z)
+        #pragma acc loop reduction(+:denominator_x,denominator_y,denominator_z)
 #endif
-            for (int j = 0; j < num_interp_pts_per_node; ++j) {
+        for (int j = 0; j < num_interp_pts_per_node; ++j) {
+        
+            double dist_x = xx - clusters_x_ptr[node_interp_pts_start + j];
+            double dist_y = yy - clusters_y_ptr[node_interp_pts_start + j];
+            double dist_z = zz - clusters_z_ptr[node_interp_pts_start + j];
             
-                double dist_x = xx - clusters_x_ptr[node_interp_pts_start + j];
-                double dist_y = yy - clusters_y_ptr[node_interp_pts_start + j];
-                double dist_z = zz - clusters_z_ptr[node_interp_pts_start + j];
-                
-                denominator_x += weights_ptr[j] / dist_x;
-                denominator_y += weights_ptr[j] / dist_y;
-                denominator_z += weights_ptr[j] / dist_z;
-                
-                if (std::abs(dist_x) < std::numeric_limits<double>::min()) exact_idx_x_ptr[i] = j;
-                if (std::abs(dist_y) < std::numeric_limits<double>::min()) exact_idx_y_ptr[i] = j;
-                if (std::abs(dist_z) < std::numeric_limits<double>::min()) exact_idx_z_ptr[i] = j;
-            }
+            denominator_x += weights_ptr[node_weights_start + j] / dist_x;
+            denominator_y += weights_ptr[node_weights_start + j] / dist_y;
+            denominator_z += weights_ptr[node_weights_start + j] / dist_z;
             
-            denominator_ptr[i] = 1.0;
-            if (exact_idx_x_ptr[i] == -1) denominator_ptr[i] /= denominator_x;
-            if (exact_idx_y_ptr[i] == -1) denominator_ptr[i] /= denominator_y;
-            if (exact_idx_z_ptr[i] == -1) denominator_ptr[i] /= denominator_z;
+            if (std::abs(dist_x) < std::numeric_limits<double>::min()) exact_idx_x_ptr[i] = j;
+            if (std::abs(dist_y) < std::numeric_limits<double>::min()) exact_idx_y_ptr[i] = j;
+            if (std::abs(dist_z) < std::numeric_limits<double>::min()) exact_idx_z_ptr[i] = j;
         }
+        
+        denominator_ptr[i] = 1.0;
+        if (exact_idx_x_ptr[i] == -1) denominator_ptr[i] /= denominator_x;
+        if (exact_idx_y_ptr[i] == -1) denominator_ptr[i] /= denominator_y;
+        if (exact_idx_z_ptr[i] == -1) denominator_ptr[i] /= denominator_z;
+    }
 
 #ifdef OPENACC_ENABLED
-        #pragma acc loop collapse(3) independent
+    #pragma acc loop collapse(3) independent
 #endif
-        for (int k1 = 0; k1 < num_interp_pts_per_node; ++k1) {
-        for (int k2 = 0; k2 < num_interp_pts_per_node; ++k2) {
-        for (int k3 = 0; k3 < num_interp_pts_per_node; ++k3) {
+    for (int k1 = 0; k1 < num_interp_pts_per_node; ++k1) {
+    for (int k2 = 0; k2 < num_interp_pts_per_node; ++k2) {
+    for (int k3 = 0; k3 < num_interp_pts_per_node; ++k3) {
+    
+        std::size_t kk = node_charges_start
+               + k1 * num_interp_pts_per_node * num_interp_pts_per_node
+               + k2 * num_interp_pts_per_node + k3;
+               
+        double cx = clusters_x_ptr[node_interp_pts_start + k1];
+        double w1 = weights_ptr[node_weights_start + k1];
+
+        double cy = clusters_y_ptr[node_interp_pts_start + k2];
+        double w2 = weights_ptr[node_weights_start + k2];
+        
+        double cz = clusters_z_ptr[node_interp_pts_start + k3];
+        double w3 = weights_ptr[node_weights_start + k3];
+        
+        double q_temp    = 0.;
+        double q_dx_temp = 0.;
+        double q_dy_temp = 0.;
+        double q_dz_temp = 0.;
         
-            std::size_t kk = node_charges_start
-                   + k1 * num_interp_pts_per_node * num_interp_pts_per_node
-                   + k2 * num_interp_pts_per_node + k3;
-                   
-            double cx = clusters_x_ptr[node_interp_pts_start + k1];
-            double w1 = weights_ptr[k1];
-
-            double cy = clusters_y_ptr[node_interp_pts_start + k2];
-            double w2 = weights_ptr[k2];
-            
-            double cz = clusters_z_ptr[node_interp_pts_start + k3];
-            double w3 = weights_ptr[k3];
-            
-            double q_temp    = 0.;
-            double q_dx_temp = 0.;
-            double q_dy_temp = 0.;
-            double q_dz_temp = 0.;
-            
 #ifdef OPENACC_ENABLED
-            #pragma acc loop reduction(+:q_temp,q_dx_temp,q_dy_temp,q_dz_temp)
+        #pragma acc loop reduction(+:q_temp,q_dx_temp,q_dy_temp,q_dz_temp)
 #endif
-            for (std::size_t i = 0; i < num_particles; i++) {  // loop over source points
+        for (std::size_t i = 0; i < num_particles; i++) {  // loop over source points
+        
+            double dist_x = particles_x_ptr[particle_start + i] - cx;
+            double dist_y = particles_y_ptr[particle_start + i] - cy;
+            double dist_z = particles_z_ptr[particle_start + i] - cz;
             
-                double dist_x = particles_x_ptr[particle_start + i] - cx;
-                double dist_y = particles_y_ptr[particle_start + i] - cy;
-                double dist_z = particles_z_ptr[particle_start + i] - cz;
-                
-                double numerator = 1.;
-
-                // If exact_idx[i] == -1, then no issues.
-                // If exact_idx[i] != -1, then we want to zero out terms EXCEPT when exactInd=k1.
-                if (exact_idx_x_ptr[i] == -1) {
-                    numerator *= w1 / dist_x;
-                } else {
-                    if (exact_idx_x_ptr[i] != k1) numerator *= 0.;
-                }
-
-                if (exact_idx_y_ptr[i] == -1) {
-                    numerator *= w2 / dist_y;
-                } else {
-                    if (exact_idx_y_ptr[i] != k2) numerator *= 0.;
-                }
-
-                if (exact_idx_z_ptr[i] == -1) {
-                    numerator *= w3 / dist_z;
-                } else {
-                    if (exact_idx_z_ptr[i] != k3) numerator *= 0.;
-                }
-
-                q_temp    += sources_q_ptr   [particle_start + i] * numerator * denominator_ptr[i];
-                q_dx_temp += sources_q_dx_ptr[particle_start + i] * numerator * denominator_ptr[i];
-                q_dy_temp += sources_q_dy_ptr[particle_start + i] * numerator * denominator_ptr[i];
-                q_dz_temp += sources_q_dz_ptr[particle_start + i] * numerator * denominator_ptr[i];
+            double numerator = 1.;
+
+            // If exact_idx[i] == -1, then no issues.
+            // If exact_idx[i] != -1, then we want to zero out terms EXCEPT when exactInd=k1.
+            if (exact_idx_x_ptr[i] == -1) {
+                numerator *= w1 / dist_x;
+            } else {
+                if (exact_idx_x_ptr[i] != k1) numerator *= 0.;
+            }
+
+            if (exact_idx_y_ptr[i] == -1) {
+                numerator *= w2 / dist_y;
+            } else {
+                if (exact_idx_y_ptr[i] != k2) numerator *= 0.;
+            }
+
+            if (exact_idx_z_ptr[i] == -1) {
+                numerator *= w3 / dist_z;
+            } else {
+                if (exact_idx_z_ptr[i] != k3) numerator *= 0.;
             }
+
+            std::size_t ii = particle_start + i;
             
-            clusters_q_ptr   [kk] += q_temp;
-            clusters_q_dx_ptr[kk] += q_dx_temp;
-            clusters_q_dy_ptr[kk] += q_dy_temp;
-            clusters_q_dz_ptr[kk] += q_dz_temp;
-        }
-        }
+            double source_q    =                        particles_a_ptr[ii] * potential[ii + potential_offset];
+            double source_q_dx = particles_nx_ptr[ii] * particles_a_ptr[ii] * potential[ii];
+            double source_q_dy = particles_ny_ptr[ii] * particles_a_ptr[ii] * potential[ii];
+            double source_q_dz = particles_nz_ptr[ii] * particles_a_ptr[ii] * potential[ii];
+
+            q_temp    += source_q    * numerator * denominator_ptr[i];
+            q_dx_temp += source_q_dx * numerator * denominator_ptr[i];
+            q_dy_temp += source_q_dy * numerator * denominator_ptr[i];
+            q_dz_temp += source_q_dz * numerator * denominator_ptr[i];
         }
         
-        } // end parallel region
-    } // end loop over nodes
+        clusters_q_ptr   [kk] += q_temp;
+        clusters_q_dx_ptr[kk] += q_dx_temp;
+        clusters_q_dy_ptr[kk] += q_dy_temp;
+        clusters_q_dz_ptr[kk] += q_dz_temp;
+    }
+    }
+    }
+    
+    } // end parallel region
+}
+
+
+void Clusters::downward_pass(const MatvecUpdate& update)
+{
+    timers_.downward_pass.start();
+
+    double* potential = update.interactions;
+    
+    const double* weights_ptr = weights_.data();
+    
 #ifdef OPENACC_ENABLED
-    #pragma acc exit data delete(weights_ptr[0:weights_num])
+    int weights_num = weights_.size();
+
+#pragma acc enter data copyin(weights_ptr[0:weights_num])
+
+    // on the device each node is one kernel, and the matvec applies the update on
+    // the host once the potentials are copied back
+    for (auto node_idx : target_nodes_)
+        Clusters::downward_pass_node(node_idx, tree_.node_particle_idxs(node_idx), weights_ptr, potential);
+
+#pragma acc exit data delete(weights_ptr[0:weights_num])
+#else
+    // leaves hold disjoint particles, so every leaf collects its target nodes and
+    // finishes its particles independently of the others
+    const std::vector<std::size_t>& leaves = tree_.leaves();
+    
+#ifdef OPENMP_ENABLED
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (std::size_t leaf = 0; leaf < leaves.size(); ++leaf) {
+        
+        auto particle_idxs = tree_.node_particle_idxs(leaves[leaf]);
+        
+        for (std::size_t k = leaf_target_nodes_begin_[leaf]; k < leaf_target_nodes_begin_[leaf + 1]; ++k) {
+            std::size_t node_idx = leaf_target_nodes_[k];
+            
+            DownwardNodeKernel downward_node = Clusters::downward_node_kernel(node_num_interp_pts_[node_idx]);
+            if (downward_node)
+                (this->*downward_node)(node_idx, particle_idxs, weights_ptr, potential);
+            else
+                Clusters::downward_pass_node(node_idx, particle_idxs, weights_ptr, potential);
+        }
+        
+        update.apply(particle_idxs[0], particle_idxs[1]);
+    }
 #endif
 
-    timers_.upward_pass.stop();
+    timers_.downward_pass.stop();
 }
 
 
-void Clusters::downward_pass(double* __restrict potential)
+void Clusters::downward_pass_node(std::size_t node_idx, std::array<std::size_t, 2> particle_idxs,
+                                  const double* weights_ptr, double* __restrict potential)
 {
-    timers_.downward_pass.start();
-
     const double* __restrict clusters_x_ptr    = interp_x_.data();
     const double* __restrict clusters_y_ptr    = interp_y_.data();
     const double* __restrict clusters_z_ptr    = interp_z_.data();
@@ -287,146 +498,126 @@ void Clusters::downward_pass(double* __restrict potential)
     const double* __restrict targets_q_dy_ptr  = particles_.target_charge_dy_ptr();
     const double* __restrict targets_q_dz_ptr  = particles_.target_charge_dz_ptr();
     
-    std::vector<double> weights (num_interp_pts_per_node_);
-    double* weights_ptr = weights.data();
-    int weights_num = weights.size();
+    std::size_t potential_offset = particles_.num();
     
-    for (int i = 0; i < weights_num; ++i) {
-        weights[i] = ((i % 2 == 0)? 1 : -1);
-        if (i == 0 || i == weights_num-1) weights[i] = ((i % 2 == 0)? 1 : -1) * 0.5;
-    }
+    std::size_t node_interp_pts_start = node_interp_pts_begin_[node_idx];
+    std::size_t node_potentials_start = node_potentials_begin_[node_idx];
     
-    std::size_t potential_offset = particles_.num();
-    int num_interp_pts_per_node = num_interp_pts_per_node_;
+    int num_interp_pts_per_node = node_num_interp_pts_[node_idx];
+    std::size_t node_weights_start = num_interp_pts_per_node * max_num_interp_pts_per_node_;
     
+    std::size_t particle_start = particle_idxs[0];
+    std::size_t num_particles  = particle_idxs[1] - particle_idxs[0];
+
 #ifdef OPENACC_ENABLED
-#pragma acc enter data copyin(weights_ptr[0:weights_num])
+#pragma acc parallel loop present(particles_x_ptr, particles_y_ptr, particles_z_ptr, \
+                              targets_q_ptr, targets_q_dx_ptr, targets_q_dy_ptr, targets_q_dz_ptr, \
+                              clusters_x_ptr, clusters_y_ptr, clusters_z_ptr, \
+                              clusters_p_ptr, clusters_p_dx_ptr, clusters_p_dy_ptr, clusters_p_dz_ptr, \
+                              potential, weights_ptr)
 #endif
+    for (std::size_t i = 0; i < num_particles; ++i) {
     
-    for (std::size_t node_idx = 0; node_idx < tree_.num_nodes(); ++node_idx) {
+        double denominator_x = 0.;
+        double denominator_y = 0.;
+        double denominator_z = 0.;
         
-        auto particle_idxs = tree_.node_particle_idxs(node_idx);
-        std::size_t node_interp_pts_start = node_idx * num_interp_pts_per_node_;
-        std::size_t node_potentials_start = node_idx * num_charges_per_node_;
+        int exact_idx_x = -1;
+        int exact_idx_y = -1;
+        int exact_idx_z = -1;
+        
+        double xx = particles_x_ptr[particle_start + i];
+        double yy = particles_y_ptr[particle_start + i];
+        double zz = particles_z_ptr[particle_start + i];
         
-        std::size_t particle_start = particle_idxs[0];
-        std::size_t num_particles  = particle_idxs[1] - particle_idxs[0];
-
 #ifdef OPENACC_ENABLED
-#pragma acc parallel loop present(particles_x_ptr, particles_y_ptr, particles_z_ptr, \
-                                  targets_q_ptr, targets_q_dx_ptr, targets_q_dy_ptr, targets_q_dz_ptr, \
-                                  clusters_x_ptr, clusters_y_ptr, clusters_z_ptr, \
-                                  clusters_p_ptr, clusters_p_dx_ptr, clusters_p_dy_ptr, clusters_p_dz_ptr, \
-                                  potential, weights_ptr)
+        #pragma acc loop reduction(+:denominator_x,denominator_y,denominator_z) \
+                         reduction(max:exact_idx_x,exact_idx_y,exact_idx_z)
 #endif
-        for (std::size_t i = 0; i < num_particles; ++i) {
+        for (int j = 0; j < num_interp_pts_per_node; ++j) {
         
-            double denominator_x = 0.;
-            double denominator_y = 0.;
-            double denominator_z = 0.;
+            double dist_x = xx - clusters_x_ptr[node_interp_pts_start + j];
+            double dist_y = yy - clusters_y_ptr[node_interp_pts_start + j];
+            double dist_z = zz - clusters_z_ptr[node_interp_pts_start + j];
             
-            int exact_idx_x = -1;
-            int exact_idx_y = -1;
-            int exact_idx_z = -1;
-            
-            double xx = particles_x_ptr[particle_start + i];
-            double yy = particles_y_ptr[particle_start + i];
-            double zz = particles_z_ptr[particle_start + i];
+            denominator_x += weights_ptr[node_weights_start + j] / dist_x;
+            denominator_y += weights_ptr[node_weights_start + j] / dist_y;
+            denominator_z += weights_ptr[node_weights_start + j] / dist_z;
             
+            if (std::abs(dist_x) < std::numeric_limits<double>::min()) exact_idx_x = j;
+            if (std::abs(dist_y) < std::numeric_limits<double>::min()) exact_idx_y = j;
+            if (std::abs(dist_z) < std::numeric_limits<double>::min()) exact_idx_z = j;
+        }
+        
+        double denominator = 1.;
+        if (exact_idx_x == -1) denominator /= denominator_x;
+        if (exact_idx_y == -1) denominator /= denominator_y;
+        if (exact_idx_z == -1) denominator /= denominator_z;
+
+        double pot_comp_   = 0.;
+        double pot_comp_dx = 0.;
+        double pot_comp_dy = 0.;
+        double pot_comp_dz = 0.;
+        
 #ifdef OPENACC_ENABLED
-            #pragma acc loop reduction(+:denominator_x,denominator_y,denominator_z) \
-                             reduction(max:exact_idx_x,exact_idx_y,exact_idx_z)
+        #pragma acc loop collapse(3) reduction(+:pot_comp_,  pot_comp_dx, \
+                                                 pot_comp_dy,pot_comp_dz)
 #endif
-            for (int j = 0; j < num_interp_pts_per_node; ++j) {
-            
-                double dist_x = xx - clusters_x_ptr[node_interp_pts_start + j];
-                double dist_y = yy - clusters_y_ptr[node_interp_pts_start + j];
-                double dist_z = zz - clusters_z_ptr[node_interp_pts_start + j];
-                
-                denominator_x += weights_ptr[j] / dist_x;
-                denominator_y += weights_ptr[j] / dist_y;
-                denominator_z += weights_ptr[j] / dist_z;
+        for (int k1 = 0; k1 < num_interp_pts_per_node; ++k1) {
+        for (int k2 = 0; k2 < num_interp_pts_per_node; ++k2) {
+        for (int k3 = 0; k3 < num_interp_pts_per_node; ++k3) {
                 
-                if (std::abs(dist_x) < std::numeric_limits<double>::min()) exact_idx_x = j;
-                if (std::abs(dist_y) < std::numeric_limits<double>::min()) exact_idx_y = j;
-                if (std::abs(dist_z) < std::numeric_limits<double>::min()) exact_idx_z = j;
-            }
-            
-            double denominator = 1.;
-            if (exact_idx_x == -1) denominator /= denominator_x;
-            if (exact_idx_y == -1) denominator /= denominator_y;
-            if (exact_idx_z == -1) denominator /= denominator_z;
-
-            double pot_comp_   = 0.;
-            double pot_comp_dx = 0.;
-            double pot_comp_dy = 0.;
-            double pot_comp_dz = 0.;
+            std::size_t kk = node_potentials_start
+                           + k1 * num_interp_pts_per_node * num_interp_pts_per_node
+                           + k2 * num_interp_pts_per_node + k3;
+                           
+            double dist_x = xx - clusters_x_ptr[node_interp_pts_start + k1];
+            double dist_y = yy - clusters_y_ptr[node_interp_pts_start + k2];
+            double dist_z = zz - clusters_z_ptr[node_interp_pts_start + k3];
             
-#ifdef OPENACC_ENABLED
-            #pragma acc loop collapse(3) reduction(+:pot_comp_,  pot_comp_dx, \
-                                                     pot_comp_dy,pot_comp_dz)
-#endif
-            for (int k1 = 0; k1 < num_interp_pts_per_node; ++k1) {
-            for (int k2 = 0; k2 < num_interp_pts_per_node; ++k2) {
-            for (int k3 = 0; k3 < num_interp_pts_per_node; ++k3) {
-                    
-                std::size_t kk = node_potentials_start
-                               + k1 * num_interp_pts_per_node * num_interp_pts_per_node
-                               + k2 * num_interp_pts_per_node + k3;
-                               
-                double dist_x = xx - clusters_x_ptr[node_interp_pts_start + k1];
-                double dist_y = yy - clusters_y_ptr[node_interp_pts_start + k2];
-                double dist_z = zz - clusters_z_ptr[node_interp_pts_start + k3];
-                
-                double numerator = 1.;
-
-                // If exact_idx == -1, then no issues.
-                // If exact_idx != -1, then we want to zero out terms EXCEPT when exactInd=k1.
-                if (exact_idx_x == -1) {
-                    numerator *= weights_ptr[k1] / dist_x;
-                } else {
-                    if (exact_idx_x != k1) numerator *= 0.;
-                }
-
-                if (exact_idx_y == -1) {
-                    numerator *= weights_ptr[k2] / dist_y;
-                } else {
-                    if (exact_idx_y != k2) numerator *= 0.;
-                }
-
-                if (exact_idx_z == -1) {
-                    numerator *= weights_ptr[k3] / dist_z;
-                } else {
-                    if (exact_idx_z != k3) numerator *= 0.;
-                }
-
-                pot_comp_   += numerator * denominator * clusters_p_ptr   [kk];
-                pot_comp_dx += numerator * denominator * clusters_p_dx_ptr[kk];
-                pot_comp_dy += numerator * denominator * clusters_p_dy_ptr[kk];
-                pot_comp_dz += numerator * denominator * clusters_p_dz_ptr[kk];
+            double numerator = 1.;
+
+            // If exact_idx == -1, then no issues.
+            // If exact_idx != -1, then we want to zero out terms EXCEPT when exactInd=k1.
+            if (exact_idx_x == -1) {
+                numerator *= weights_ptr[node_weights_start + k1] / dist_x;
+            } else {
+                if (exact_idx_x != k1) numerator *= 0.;
             }
+
+            if (exact_idx_y == -1) {
+                numerator *= weights_ptr[node_weights_start + k2] / dist_y;
+            } else {
+                if (exact_idx_y != k2) numerator *= 0.;
             }
+
+            if (exact_idx_z == -1) {
+                numerator *= weights_ptr[node_weights_start + k3] / dist_z;
+            } else {
+                if (exact_idx_z != k3) numerator *= 0.;
             }
-            
-            double pot_temp_1 = targets_q_ptr   [particle_start + i] * pot_comp_;
-            double pot_temp_2 = targets_q_dx_ptr[particle_start + i] * pot_comp_dx
-                              + targets_q_dy_ptr[particle_start + i] * pot_comp_dy
-                              + targets_q_dz_ptr[particle_start + i] * pot_comp_dz;
-#ifdef OPENACC_ENABLED
-            #pragma acc atomic update
-#endif
-            potential[particle_start + i]                    += pot_temp_1;
+
+            pot_comp_   += numerator * denominator * clusters_p_ptr   [kk];
+            pot_comp_dx += numerator * denominator * clusters_p_dx_ptr[kk];
+            pot_comp_dy += numerator * denominator * clusters_p_dy_ptr[kk];
+            pot_comp_dz += numerator * denominator * clusters_p_dz_ptr[kk];
+        }
+        }
+        }
+        
+        double pot_temp_1 = targets_q_ptr   [particle_start + i] * pot_comp_;
+        double pot_temp_2 = targets_q_dx_ptr[particle_start + i] * pot_comp_dx
+                          + targets_q_dy_ptr[particle_start + i] * pot_comp_dy
+                          + targets_q_dz_ptr[particle_start + i] * pot_comp_dz;
 #ifdef OPENACC_ENABLED
-            #pragma acc atomic update
+        #pragma acc atomic update
 #endif
-            potential[particle_start + i + potential_offset] += pot_temp_2;
-        }
-    } //end loop over nodes
+        potential[particle_start + i]                    += pot_temp_1;
 #ifdef OPENACC_ENABLED
-    #pragma acc exit data delete(weights_ptr[0:weights_num])
+        #pragma acc atomic update
 #endif
-
-    timers_.downward_pass.stop();
+        potential[particle_start + i + potential_offset] += pot_temp_2;
+    }
 }
 
 
@@ -465,7 +656,7 @@ void Clusters::clear_potentials()
     timers_.clear_potentials.start();
 
 #ifdef OPENACC_ENABLED
-    std::size_t num_potentials = num_charges_;
+    std::size_t num_potentials = num_potentials_;
     double* __restrict clusters_p_ptr    = interp_potential_.data();
     double* __restrict clusters_p_dx_ptr = interp_potential_dx_.data();
     double* __restrict clusters_p_dy_ptr = interp_potential_dy_.data();
@@ -576,15 +767,48 @@ void Clusters::delete_from_device() const
 
 const std::array<std::size_t, 2> Clusters::cluster_interp_pts_idxs(std::size_t node_idx) const
 {
-    return std::array<std::size_t, 2> {num_interp_pts_per_node_ *  node_idx,
-                                       num_interp_pts_per_node_ * (node_idx + 1)};
+    return std::array<std::size_t, 2> {node_interp_pts_begin_[node_idx],
+                                       node_interp_pts_begin_[node_idx + 1]};
 }
 
 
 const std::array<std::size_t, 2> Clusters::cluster_charges_idxs(std::size_t node_idx) const
 {
-    return std::array<std::size_t, 2> {num_charges_per_node_ *  node_idx,
-                                       num_charges_per_node_ * (node_idx + 1)};
+    return std::array<std::size_t, 2> {node_charges_begin_[node_idx],
+                                       node_charges_begin_[node_idx + 1]};
+}
+
+
+const std::array<std::size_t, 2> Clusters::cluster_potentials_idxs(std::size_t node_idx) const
+{
+    return std::array<std::size_t, 2> {node_potentials_begin_[node_idx],
+                                       node_potentials_begin_[node_idx + 1]};
+}
+
+
+double Clusters::memory_bytes() const
+{
+    return sizeof(double) * (3. * num_interp_pts_ + 4. * num_charges_ + 4. * num_potentials_)
+         + sizeof(std::size_t) * 3. * (tree_.num_nodes() + 1)
+         + sizeof(int) * (double)tree_.num_nodes();
+}
+
+
+std::vector<double> Clusters::barycentric_weights() const
+{
+    // row n holds the Chebyshev barycentric weights for n interpolation points
+    int row_length = max_num_interp_pts_per_node_;
+    std::vector<double> weights((row_length + 1) * row_length, 0.);
+    
+    for (int n = 1; n <= row_length; ++n) {
+        double* row = &weights[n * row_length];
+        for (int i = 0; i < n; ++i) {
+            row[i] = ((i % 2 == 0)? 1 : -1);
+            if (i == 0 || i == n-1) row[i] = ((i % 2 == 0)? 1 : -1) * 0.5;
+        }
+    }
+    
+    return weights;
 }
 
 
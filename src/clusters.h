@@ -2,13 +2,44 @@
 #define H_TABIPB_CLUSTERS_STRUCT_H
 
 #include <cstddef>
+#include <memory>
 
 #include "timer.h"
+#include "perf_counters.h"
 #include "particles.h"
 #include "tree.h"
+#include "interaction_list.h"
 #include "params.h"
 
 struct Timers_Clusters;
+class TaskGraph;
+
+/* The update a matrix-vector product ends with, over both halves of the potential:
+ * potential_new = beta * potential_new + alpha * (coeff * potential_old - interactions),
+ * where interactions holds the summed kernels applied to potential_old */
+struct MatvecUpdate
+{
+    double alpha;
+    double beta;
+    double coeff_1;
+    double coeff_2;
+    
+    std::size_t num;
+    const double* potential_old;
+    double* interactions;
+    double* potential_new;
+    
+    void apply(std::size_t begin, std::size_t end) const
+    {
+        for (std::size_t i = begin; i < end; ++i)
+            potential_new[i] = beta * potential_new[i]
+                    + alpha * (coeff_1 * potential_old[i] - interactions[i]);
+        
+        for (std::size_t i = num + begin; i < num + end; ++i)
+            potential_new[i] = beta * potential_new[i]
+                    + alpha * (coeff_2 * potential_old[i] - interactions[i]);
+    }
+};
 
 class Clusters
 {
@@ -18,11 +49,28 @@ private:
     const struct Params& params_;
     struct Timers_Clusters& timers_;
 
-    int num_interp_pts_per_node_;
-    int num_charges_per_node_;
+    int max_num_interp_pts_per_node_;
+    
+    // every node has its own degree; its points, charges and potentials are
+    // stored at these offsets, with one trailing entry for the total
+    std::vector<int> node_num_interp_pts_;
+    std::vector<std::size_t> node_interp_pts_begin_;
+    std::vector<std::size_t> node_charges_begin_;
+    std::vector<std::size_t> node_potentials_begin_;
     
     std::size_t num_interp_pts_;
     std::size_t num_charges_;
+    std::size_t num_potentials_;
+    
+    // the nodes whose charges the interaction lists read, and whose potentials they
+    // update; only these are interpolated, and every other node stores no points
+    std::vector<std::size_t> source_nodes_;
+    std::vector<std::size_t> target_nodes_;
+    
+    // for each leaf, the target nodes that hold it, from the root down; the downward
+    // pass interpolates all of them into the leaf before finishing its particles
+    std::vector<std::size_t> leaf_target_nodes_begin_;
+    std::vector<std::size_t> leaf_target_nodes_;
 
     std::vector<double> interp_x_;
     std::vector<double> interp_y_;
@@ -38,21 +86,65 @@ private:
     std::vector<double> interp_potential_dy_;
     std::vector<double> interp_potential_dz_;
     
+    std::vector<double> barycentric_weights() const;
+    std::vector<double> weights_;
+    
+    // the upward pass into one node, and the downward pass from one node into a
+    // range of its particles
+    void upward_pass_node(std::size_t node_idx, const double* weights,
+                          const double* __restrict potential);
+    void upward_pass(std::size_t node_idx, const double* potential);
+    
+    // counts the upward pass while it runs as tasks of a graph
+    std::unique_ptr<PerfScope> upward_perf_scope_;
+    
+    void downward_pass_node(std::size_t node_idx, std::array<std::size_t, 2> particle_idxs,
+                            const double* weights, double* __restrict potential);
+    
+    // upward and downward passes over one node, compiled for a fixed number of
+    // interpolation points, for degrees 1 to 8; the lookups return null otherwise
+    using UpwardNodeKernel   = void (Clusters::*)(std::size_t, const double*, const double*);
+    using DownwardNodeKernel = void (Clusters::*)(std::size_t, std::array<std::size_t, 2>,
+                                                  const double*, double*);
+    
+    template <int NP> void upward_pass_node_fixed(std::size_t node_idx, const double* weights,
+                                                  const double* __restrict potential);
+    template <int NP> void downward_pass_node_fixed(std::size_t node_idx,
+                                                    std::array<std::size_t, 2> particle_idxs,
+                                                    const double* weights,
+                                                    double* __restrict potential);
+    
+    static UpwardNodeKernel   upward_node_kernel  (int num_interp_pts);
+    static DownwardNodeKernel downward_node_kernel(int num_interp_pts);
     
 public:
-    Clusters(const class Particles&, const class Tree&, const struct Params&, struct Timers_Clusters&);
+    Clusters(const class Particles&, const class Tree&, const class InteractionList&,
+             const struct Params&, struct Timers_Clusters&);
     ~Clusters() = default;
     
-    void upward_pass();
-    void downward_pass(double* potential);
+    // the upward pass forms the source charges from the potential it is given; the
+    // downward pass adds the cluster potentials to the interactions of the update,
+    // and applies the update to each leaf once its particles are complete
+    void upward_pass(const double* potential);
+    
+    // the upward pass added to a graph as one task per source node, which run
+    // concurrently since nodes own their charges; it is timed from the graph's start
+    // to the returned task, which follows every node
+    std::size_t upward_pass(class TaskGraph& graph, const double* potential);
+    void downward_pass(const MatvecUpdate& update);
     
     void clear_charges();
     void clear_potentials();
     
-    std::size_t num_interp_pts_per_node() const { return num_interp_pts_per_node_; };
-    std::size_t num_charges_per_node()    const { return num_charges_per_node_; };
+    int num_interp_pts_per_node(std::size_t node_idx) const { return node_num_interp_pts_[node_idx]; };
+    const std::vector<std::size_t>& source_nodes() const { return source_nodes_; };
+    const std::vector<std::size_t>& target_nodes() const { return target_nodes_; };
     const std::array<std::size_t, 2> cluster_interp_pts_idxs(std::size_t node_idx) const;
     const std::array<std::size_t, 2> cluster_charges_idxs(std::size_t node_idx) const;
+    const std::array<std::size_t, 2> cluster_potentials_idxs(std::size_t node_idx) const;
+    
+    // bytes held for the interpolation points, charges, potentials and slot maps
+    double memory_bytes() const;
     
     const double* interp_x_ptr() const { return interp_x_.data(); };
     const double* interp_y_ptr() const { return interp_y_.data(); };
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <vector>
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+#include "profiler.h"
+#include "kernel_costs.h"
+#include "boundary_element.h"
+
+/*  Direct summation of the boundary integrals, the O(N^2) reference for the
+ *  treecode. Targets are split into small blocks that threads take in turn, and
+ *  each target block sweeps the sources in blocks sized to stay in cache, so a
+ *  source block is loaded once and reused by every target of the block. Each
+ *  block pair goes through the same PP kernel as the near field of a treecode
+ *  matvec, in the particle layout the run is using.
+ *
+ *  The same sweep over a set of sampled rows gives the exact matvec on those
+ *  rows only, which measures the treecode error of any run at O(N) cost per row. */
+
+static constexpr std::size_t DIRECT_TARGET_BLOCK_SIZE = 64;
+static constexpr std::size_t DIRECT_SOURCE_BLOCK_SIZE = 2048;
+
+
+// the PP calls of a sweep of every source block for each block of targets
+static KernelCount direct_sweep_count(std::size_t num_targets, std::size_t target_block_size,
+                                      std::size_t num_sources, std::size_t source_block_size,
+                                      bool screened)
+{
+    KernelCount count;
+
+    for (std::size_t target_begin = 0; target_begin < num_targets; target_begin += target_block_size) {
+        std::size_t block_targets = std::min(target_block_size, num_targets - target_begin);
+
+        for (std::size_t source_begin = 0; source_begin < num_sources; source_begin += source_block_size) {
+            std::size_t block_sources = std::min(source_block_size, num_sources - source_begin);
+
+            count.calls       += 1.;
+            count.evaluations += (double)block_targets * block_sources;
+            count.bytes       += kernel_costs::pp_bytes(block_targets, block_sources);
+        }
+    }
+
+    count.flops = kernel_costs::pp_flops(screened) * count.evaluations;
+    return count;
+}
+
+
+KernelCount BoundaryElement::direct_sum_count() const
+{
+    std::size_t num = particles_.num();
+
+#ifdef OPENACC_ENABLED
+    return direct_sweep_count(num, num, num, num, kernel_policy_ != UNSCREENED);
+#else
+    return direct_sweep_count(num, DIRECT_TARGET_BLOCK_SIZE, num, DIRECT_SOURCE_BLOCK_SIZE, kernel_policy_ != UNSCREENED);
+#endif
+}
+
+
+void BoundaryElement::direct_sum_interact(double* __restrict potential,
+                                    const double* __restrict potential_old)
+{
+    PROFILE_SCOPE("run_GMRES/iteration/matrix_vector/direct_sum");
+    timers_.direct_sum.start();
+
+    std::size_t num = particles_.num();
+
+#ifdef OPENACC_ENABLED
+    // one launch over every pair; the device does its own blocking
+    BoundaryElement::particle_particle_interact(potential, potential_old,
+            std::array<std::size_t, 2> {0, num}, std::array<std::size_t, 2> {0, num});
+#else
+    std::size_t num_target_blocks = (num + DIRECT_TARGET_BLOCK_SIZE - 1) / DIRECT_TARGET_BLOCK_SIZE;
+
+#ifdef OPENMP_ENABLED
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (std::size_t target_block = 0; target_block < num_target_blocks; ++target_block) {
+
+        std::array<std::size_t, 2> target_idxs {target_block * DIRECT_TARGET_BLOCK_SIZE,
+                std::min(num, (target_block + 1) * DIRECT_TARGET_BLOCK_SIZE)};
+
+        for (std::size_t source_begin = 0; source_begin < num; source_begin += DIRECT_SOURCE_BLOCK_SIZE) {
+
+            std::array<std::size_t, 2> source_idxs {source_begin,
+                    std::min(num, source_begin + DIRECT_SOURCE_BLOCK_SIZE)};
+
+            if (params_.particle_layout_ == Params::ParticleLayout::AOSOA)
+                BoundaryElement::particle_particle_interact_packed(potential, potential_old,
+                                                                   target_idxs, source_idxs);
+            else
+                BoundaryElement::particle_particle_interact(potential, potential_old,
+                                                            target_idxs, source_idxs);
+        }
+    }
+#endif
+
+    timers_.direct_sum.stop();
+}
+
+
+void BoundaryElement::direct_sum_rows(const double* potential_old, const std::vector<std::size_t>& rows,
+                                      std::vector<double>& result)
+{
+    PROFILE_SCOPE("direct_sum_rows");
+    timers_.direct_sum.start();
+
+    std::size_t num = particles_.num();
+    std::size_t num_rows = rows.size();
+
+    double potential_coeff_1 = 0.5 * (1. +      params_.phys_eps_);
+    double potential_coeff_2 = 0.5 * (1. + 1. / params_.phys_eps_);
+
+    std::vector<double> direct(2 * num, 0.);
+    double* direct_ptr = direct.data();
+
+#ifdef OPENACC_ENABLED
+    std::size_t direct_num = direct.size();
+    #pragma acc enter data copyin(direct_ptr[0:direct_num], potential_old[0:direct_num])
+
+    for (std::size_t k = 0; k < num_rows; ++k)
+        BoundaryElement::particle_particle_interact(direct_ptr, potential_old,
+                std::array<std::size_t, 2> {rows[k], rows[k] + 1}, std::array<std::size_t, 2> {0, num});
+
+    #pragma acc exit data copyout(direct_ptr[0:direct_num]) delete(potential_old[0:direct_num])
+
+    timers_.total_counts.pp += direct_sweep_count(num_rows, 1, num, num, kernel_policy_ != UNSCREENED);
+#else
+#ifdef OPENMP_ENABLED
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (std::size_t k = 0; k < num_rows; ++k) {
+
+        std::array<std::size_t, 2> target_idxs {rows[k], rows[k] + 1};
+
+        for (std::size_t source_begin = 0; source_begin < num; source_begin += DIRECT_SOURCE_BLOCK_SIZE) {
+
+            std::array<std::size_t, 2> source_idxs {source_begin,
+                    std::min(num, source_begin + DIRECT_SOURCE_BLOCK_SIZE)};
+
+            if (params_.particle_layout_ == Params::ParticleLayout::AOSOA)
+                BoundaryElement::particle_particle_interact_packed(direct_ptr, potential_old,
+                                                                   target_idxs, source_idxs);
+            else
+                BoundaryElement::particle_particle_interact(direct_ptr, potential_old,
+                                                            target_idxs, source_idxs);
+        }
+    }
+
+    timers_.total_counts.pp += direct_sweep_count(num_rows, 1, num, DIRECT_SOURCE_BLOCK_SIZE, kernel_policy_ != UNSCREENED);
+#endif
+
+    // the same affine map matrix_vector applies to the boundary integrals
+    result.resize(2 * num_rows);
+    for (std::size_t k = 0; k < num_rows; ++k) {
+        std::size_t idx = rows[k];
+        result[k]            = potential_coeff_1 * potential_old[idx]       - direct[idx];
+        result[k + num_rows] = potential_coeff_2 * potential_old[idx + num] - direct[idx + num];
+    }
+
+    timers_.direct_sum.stop();
+}
+
+
+void BoundaryElement::sample_direct_error()
+{
+    std::size_t num = particles_.num();
+    std::size_t num_rows = std::min(num, params_.direct_sample_);
+
+    if (num_rows == 0 || params_.engine_ == Params::Engine::DIRECT) return;
+
+    // rows are spread evenly over the tree order, so every region of the surface is sampled
+    std::vector<std::size_t> rows;
+    for (std::size_t k = 0; k < num_rows; ++k) rows.push_back(k * num / num_rows);
+
+    std::vector<double> treecode(2 * num, 0.);
+    BoundaryElement::matrix_vector(1., potential_.data(), 0., treecode.data());
+
+    std::vector<double> reference;
+    BoundaryElement::direct_sum_rows(potential_.data(), rows, reference);
+
+    double error_norm2     = 0.;
+    double reference_norm2 = 0.;
+
+    for (std::size_t k = 0; k < num_rows; ++k) {
+        double diff_1 = treecode[rows[k]]       - reference[k];
+        double diff_2 = treecode[rows[k] + num] - reference[k + num_rows];
+
+        error_norm2     += diff_1 * diff_1 + diff_2 * diff_2;
+        reference_norm2 += reference[k] * reference[k]
+                         + reference[k + num_rows] * reference[k + num_rows];
+    }
+
+    direct_sample_error_ = std::sqrt(error_norm2 / reference_norm2);
+}
@@ -0,0 +1,535 @@
+#include <array>
+#include <limits>
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+#include "kernel_policy.h"
+#include "boundary_element.h"
+#include "clusters.h"
+
+/*  The far-field kernels and the upward and downward passes, compiled once for each
+ *  number of interpolation points from 2 to 9, degrees 1 to 8. With the trip counts
+ *  of the k1/k2/k3 loops known, the compiler unrolls the innermost loop, and a
+ *  cluster's points and barycentric weights are copied once into arrays on the
+ *  stack. The passes also evaluate the barycentric factors of a particle once per
+ *  axis, rather than once per interpolation charge, and the upward pass sums a
+ *  node's charges on the stack. Every sum runs in the same order as in the generic
+ *  kernels, so both give the same results.
+ *
+ *  The generic kernels look these up by degree and kernel policy and fall back to
+ *  their own loops for any other degree, and always in OpenACC builds. A
+ *  cluster-cluster kernel is fixed by the source degree, over which its innermost
+ *  loops run. */
+
+static constexpr int FIXED_MIN_INTERP_PTS = 2;
+static constexpr int FIXED_MAX_INTERP_PTS = 9;
+
+
+// barycentric factors w_j / (x - c_j) along one axis, dividing their sum into the
+// denominator; a point on an interpolation point keeps only that point's factor, as 1
+template <int NP>
+static inline void barycentric_factors(double x, const double* c, const double* w,
+                                       double* factor, double& denominator)
+{
+    double sum = 0.;
+    int exact_idx = -1;
+
+    for (int j = 0; j < NP; ++j) {
+        double dist = x - c[j];
+        factor[j] = w[j] / dist;
+        sum += factor[j];
+        if (std::abs(dist) < std::numeric_limits<double>::min()) exact_idx = j;
+    }
+
+    if (exact_idx == -1) {
+        denominator /= sum;
+        return;
+    }
+
+    for (int j = 0; j < NP; ++j) factor[j] = (j == exact_idx) ? 1. : 0.;
+}
+
+
+template <class Kernel, int NP>
+void BoundaryElement::particle_cluster_interact_fixed(double* __restrict potential,
+                                               std::array<std::size_t, 2> target_node_particle_idxs,
+                                               std::size_t source_node_idx)
+{
+    std::size_t num_particles = particles_.num();
+
+    std::size_t source_cluster_interp_pts_begin = clusters_.cluster_interp_pts_idxs(source_node_idx)[0];
+    std::size_t source_cluster_charges_begin    = clusters_.cluster_charges_idxs(source_node_idx)[0];
+
+    double eps    = params_.phys_eps_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table_);
+
+    const double* __restrict particles_x_ptr   = particles_.x_ptr();
+    const double* __restrict particles_y_ptr   = particles_.y_ptr();
+    const double* __restrict particles_z_ptr   = particles_.z_ptr();
+
+    const double* __restrict targets_q_ptr     = particles_.target_charge_ptr();
+    const double* __restrict targets_q_dx_ptr  = particles_.target_charge_dx_ptr();
+    const double* __restrict targets_q_dy_ptr  = particles_.target_charge_dy_ptr();
+    const double* __restrict targets_q_dz_ptr  = particles_.target_charge_dz_ptr();
+
+    const double* __restrict clusters_q_ptr    = clusters_.interp_charge_ptr()    + source_cluster_charges_begin;
+    const double* __restrict clusters_q_dx_ptr = clusters_.interp_charge_dx_ptr() + source_cluster_charges_begin;
+    const double* __restrict clusters_q_dy_ptr = clusters_.interp_charge_dy_ptr() + source_cluster_charges_begin;
+    const double* __restrict clusters_q_dz_ptr = clusters_.interp_charge_dz_ptr() + source_cluster_charges_begin;
+
+    double source_x[NP], source_y[NP], source_z[NP];
+    for (int k = 0; k < NP; ++k) {
+        source_x[k] = clusters_.interp_x_ptr()[source_cluster_interp_pts_begin + k];
+        source_y[k] = clusters_.interp_y_ptr()[source_cluster_interp_pts_begin + k];
+        source_z[k] = clusters_.interp_z_ptr()[source_cluster_interp_pts_begin + k];
+    }
+
+    for (std::size_t j = target_node_particle_idxs[0]; j < target_node_particle_idxs[1]; ++j) {
+
+        double target_x = particles_x_ptr[j];
+        double target_y = particles_y_ptr[j];
+        double target_z = particles_z_ptr[j];
+
+        double pot_comp_   = 0.;
+        double pot_comp_dx = 0.;
+        double pot_comp_dy = 0.;
+        double pot_comp_dz = 0.;
+
+        for (int k1 = 0; k1 < NP; ++k1) {
+            double dx = target_x - source_x[k1];
+        for (int k2 = 0; k2 < NP; ++k2) {
+            double dy = target_y - source_y[k2];
+        for (int k3 = 0; k3 < NP; ++k3) {
+            double dz = target_z - source_z[k3];
+
+            int kk = (k1 * NP + k2) * NP + k3;
+            kernel.far_field(dx, dy, dz, eps,
+                             clusters_q_ptr[kk], clusters_q_dx_ptr[kk], clusters_q_dy_ptr[kk], clusters_q_dz_ptr[kk],
+                             pot_comp_, pot_comp_dx, pot_comp_dy, pot_comp_dz);
+        }
+        }
+        }
+
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        potential[j]                 += targets_q_ptr   [j] * pot_comp_;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        potential[j + num_particles] += targets_q_dx_ptr[j] * pot_comp_dx
+                                      + targets_q_dy_ptr[j] * pot_comp_dy
+                                      + targets_q_dz_ptr[j] * pot_comp_dz;
+    }
+}
+
+
+template <class Kernel, int NP>
+void BoundaryElement::cluster_particle_interact_fixed(double* __restrict,
+                                               const double* __restrict potential_old,
+                                               std::size_t target_node_idx,
+                                               std::array<std::size_t, 2> source_node_particle_idxs)
+{
+    std::size_t target_cluster_interp_pts_begin = clusters_.cluster_interp_pts_idxs(target_node_idx)[0];
+    std::size_t target_cluster_potentials_begin = clusters_.cluster_potentials_idxs(target_node_idx)[0];
+
+    std::size_t source_node_particle_begin      = source_node_particle_idxs[0];
+    std::size_t source_node_particle_end        = source_node_particle_idxs[1];
+
+    double eps    = params_.phys_eps_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table_);
+
+    double* __restrict clusters_p_ptr          = clusters_.interp_potential_ptr()    + target_cluster_potentials_begin;
+    double* __restrict clusters_p_dx_ptr       = clusters_.interp_potential_dx_ptr() + target_cluster_potentials_begin;
+    double* __restrict clusters_p_dy_ptr       = clusters_.interp_potential_dy_ptr() + target_cluster_potentials_begin;
+    double* __restrict clusters_p_dz_ptr       = clusters_.interp_potential_dz_ptr() + target_cluster_potentials_begin;
+
+    const double* __restrict particles_x_ptr   = particles_.x_ptr();
+    const double* __restrict particles_y_ptr   = particles_.y_ptr();
+    const double* __restrict particles_z_ptr   = particles_.z_ptr();
+
+    const double* __restrict particles_nx_ptr  = particles_.nx_ptr();
+    const double* __restrict particles_ny_ptr  = particles_.ny_ptr();
+    const double* __restrict particles_nz_ptr  = particles_.nz_ptr();
+    const double* __restrict particles_a_ptr   = particles_.area_ptr();
+
+    std::size_t potential_offset = particles_.num();
+
+    double target_x[NP], target_y[NP], target_z[NP];
+    for (int j = 0; j < NP; ++j) {
+        target_x[j] = clusters_.interp_x_ptr()[target_cluster_interp_pts_begin + j];
+        target_y[j] = clusters_.interp_y_ptr()[target_cluster_interp_pts_begin + j];
+        target_z[j] = clusters_.interp_z_ptr()[target_cluster_interp_pts_begin + j];
+    }
+
+    for (int j1 = 0; j1 < NP; ++j1) {
+    for (int j2 = 0; j2 < NP; ++j2) {
+    for (int j3 = 0; j3 < NP; ++j3) {
+
+        int jj = (j1 * NP + j2) * NP + j3;
+
+        double pot_comp_   = 0.;
+        double pot_comp_dx = 0.;
+        double pot_comp_dy = 0.;
+        double pot_comp_dz = 0.;
+
+        for (std::size_t k = source_node_particle_begin; k < source_node_particle_end; ++k) {
+
+            double source_q    =                       particles_a_ptr[k] * potential_old[k + potential_offset];
+            double source_q_dx = particles_nx_ptr[k] * particles_a_ptr[k] * potential_old[k];
+            double source_q_dy = particles_ny_ptr[k] * particles_a_ptr[k] * potential_old[k];
+            double source_q_dz = particles_nz_ptr[k] * particles_a_ptr[k] * potential_old[k];
+
+            kernel.far_field(target_x[j1] - particles_x_ptr[k],
+                             target_y[j2] - particles_y_ptr[k],
+                             target_z[j3] - particles_z_ptr[k], eps,
+                             source_q, source_q_dx, source_q_dy, source_q_dz,
+                             pot_comp_, pot_comp_dx, pot_comp_dy, pot_comp_dz);
+        }
+
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_ptr   [jj] += pot_comp_;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dx_ptr[jj] += pot_comp_dx;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dy_ptr[jj] += pot_comp_dy;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dz_ptr[jj] += pot_comp_dz;
+    }
+    }
+    }
+}
+
+
+template <class Kernel, int NS>
+void BoundaryElement::cluster_cluster_interact_fixed(double* __restrict,
+                                              std::size_t target_node_idx,
+                                              std::size_t source_node_idx)
+{
+    int num_target_interp_pts = clusters_.num_interp_pts_per_node(target_node_idx);
+
+    std::size_t target_cluster_interp_pts_begin = clusters_.cluster_interp_pts_idxs(target_node_idx)[0];
+    std::size_t target_cluster_potentials_begin = clusters_.cluster_potentials_idxs(target_node_idx)[0];
+
+    std::size_t source_cluster_interp_pts_begin = clusters_.cluster_interp_pts_idxs(source_node_idx)[0];
+    std::size_t source_cluster_charges_begin    = clusters_.cluster_charges_idxs(source_node_idx)[0];
+
+    double eps    = params_.phys_eps_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table_);
+
+    const double* __restrict clusters_x_ptr    = clusters_.interp_x_ptr();
+    const double* __restrict clusters_y_ptr    = clusters_.interp_y_ptr();
+    const double* __restrict clusters_z_ptr    = clusters_.interp_z_ptr();
+
+    double* __restrict clusters_p_ptr          = clusters_.interp_potential_ptr()    + target_cluster_potentials_begin;
+    double* __restrict clusters_p_dx_ptr       = clusters_.interp_potential_dx_ptr() + target_cluster_potentials_begin;
+    double* __restrict clusters_p_dy_ptr       = clusters_.interp_potential_dy_ptr() + target_cluster_potentials_begin;
+    double* __restrict clusters_p_dz_ptr       = clusters_.interp_potential_dz_ptr() + target_cluster_potentials_begin;
+
+    const double* __restrict clusters_q_ptr    = clusters_.interp_charge_ptr()    + source_cluster_charges_begin;
+    const double* __restrict clusters_q_dx_ptr = clusters_.interp_charge_dx_ptr() + source_cluster_charges_begin;
+    const double* __restrict clusters_q_dy_ptr = clusters_.interp_charge_dy_ptr() + source_cluster_charges_begin;
+    const double* __restrict clusters_q_dz_ptr = clusters_.interp_charge_dz_ptr() + source_cluster_charges_begin;
+
+    double source_x[NS], source_y[NS], source_z[NS];
+    for (int k = 0; k < NS; ++k) {
+        source_x[k] = clusters_x_ptr[source_cluster_interp_pts_begin + k];
+        source_y[k] = clusters_y_ptr[source_cluster_interp_pts_begin + k];
+        source_z[k] = clusters_z_ptr[source_cluster_interp_pts_begin + k];
+    }
+
+    for (int j1 = 0; j1 < num_target_interp_pts; ++j1) {
+    for (int j2 = 0; j2 < num_target_interp_pts; ++j2) {
+    for (int j3 = 0; j3 < num_target_interp_pts; ++j3) {
+
+        std::size_t jj = j1 * num_target_interp_pts * num_target_interp_pts
+                       + j2 * num_target_interp_pts + j3;
+
+        double target_x = clusters_x_ptr[target_cluster_interp_pts_begin + j1];
+        double target_y = clusters_y_ptr[target_cluster_interp_pts_begin + j2];
+        double target_z = clusters_z_ptr[target_cluster_interp_pts_begin + j3];
+
+        double pot_comp_   = 0.;
+        double pot_comp_dx = 0.;
+        double pot_comp_dy = 0.;
+        double pot_comp_dz = 0.;
+
+        for (int k1 = 0; k1 < NS; ++k1) {
+            double dx = target_x - source_x[k1];
+        for (int k2 = 0; k2 < NS; ++k2) {
+            double dy = target_y - source_y[k2];
+        for (int k3 = 0; k3 < NS; ++k3) {
+            double dz = target_z - source_z[k3];
+
+            int kk = (k1 * NS + k2) * NS + k3;
+            kernel.far_field(dx, dy, dz, eps,
+                             clusters_q_ptr[kk], clusters_q_dx_ptr[kk], clusters_q_dy_ptr[kk], clusters_q_dz_ptr[kk],
+                             pot_comp_, pot_comp_dx, pot_comp_dy, pot_comp_dz);
+        }
+        }
+        }
+
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_ptr   [jj] += pot_comp_;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dx_ptr[jj] += pot_comp_dx;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dy_ptr[jj] += pot_comp_dy;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dz_ptr[jj] += pot_comp_dz;
+    }
+    }
+    }
+}
+
+
+template <int NP>
+void Clusters::upward_pass_node_fixed(std::size_t node_idx, const double* weights,
+                                      const double* __restrict potential)
+{
+    constexpr int NC = NP * NP * NP;
+
+    auto particle_idxs = tree_.node_particle_idxs(node_idx);
+    std::size_t node_interp_pts_start = node_interp_pts_begin_[node_idx];
+    std::size_t node_charges_start    = node_charges_begin_[node_idx];
+
+    const double* __restrict particles_x_ptr  = particles_.x_ptr();
+    const double* __restrict particles_y_ptr  = particles_.y_ptr();
+    const double* __restrict particles_z_ptr  = particles_.z_ptr();
+
+    const double* __restrict particles_nx_ptr = particles_.nx_ptr();
+    const double* __restrict particles_ny_ptr = particles_.ny_ptr();
+    const double* __restrict particles_nz_ptr = particles_.nz_ptr();
+    const double* __restrict particles_a_ptr  = particles_.area_ptr();
+
+    std::size_t potential_offset = particles_.num();
+
+    double cx[NP], cy[NP], cz[NP], w[NP];
+    for (int k = 0; k < NP; ++k) {
+        cx[k] = interp_x_[node_interp_pts_start + k];
+        cy[k] = interp_y_[node_interp_pts_start + k];
+        cz[k] = interp_z_[node_interp_pts_start + k];
+        w [k] = weights[NP * max_num_interp_pts_per_node_ + k];
+    }
+
+    double q[NC] = {}, q_dx[NC] = {}, q_dy[NC] = {}, q_dz[NC] = {};
+
+    for (std::size_t i = particle_idxs[0]; i < particle_idxs[1]; ++i) {
+
+        double ax[NP], ay[NP], az[NP];
+        double denominator = 1.;
+        barycentric_factors<NP>(particles_x_ptr[i], cx, w, ax, denominator);
+        barycentric_factors<NP>(particles_y_ptr[i], cy, w, ay, denominator);
+        barycentric_factors<NP>(particles_z_ptr[i], cz, w, az, denominator);
+
+        double source_q    =                       particles_a_ptr[i] * potential[i + potential_offset];
+        double source_q_dx = particles_nx_ptr[i] * particles_a_ptr[i] * potential[i];
+        double source_q_dy = particles_ny_ptr[i] * particles_a_ptr[i] * potential[i];
+        double source_q_dz = particles_nz_ptr[i] * particles_a_ptr[i] * potential[i];
+
+        for (int k1 = 0; k1 < NP; ++k1) {
+        for (int k2 = 0; k2 < NP; ++k2) {
+        for (int k3 = 0; k3 < NP; ++k3) {
+
+            int kk = (k1 * NP + k2) * NP + k3;
+            double numerator = ax[k1] * ay[k2] * az[k3];
+
+            q   [kk] += source_q    * numerator * denominator;
+            q_dx[kk] += source_q_dx * numerator * denominator;
+            q_dy[kk] += source_q_dy * numerator * denominator;
+            q_dz[kk] += source_q_dz * numerator * denominator;
+        }
+        }
+        }
+    }
+
+    for (int kk = 0; kk < NC; ++kk) {
+        interp_charge_   [node_charges_start + kk] += q   [kk];
+        interp_charge_dx_[node_charges_start + kk] += q_dx[kk];
+        interp_charge_dy_[node_charges_start + kk] += q_dy[kk];
+        interp_charge_dz_[node_charges_start + kk] += q_dz[kk];
+    }
+}
+
+
+template <int NP>
+void Clusters::downward_pass_node_fixed(std::size_t node_idx,
+                                        std::array<std::size_t, 2> particle_idxs,
+                                        const double* weights,
+                                        double* __restrict potential)
+{
+    std::size_t node_interp_pts_start = node_interp_pts_begin_[node_idx];
+    std::size_t node_potentials_start = node_potentials_begin_[node_idx];
+    std::size_t potential_offset      = particles_.num();
+
+    const double* __restrict clusters_p_ptr    = interp_potential_.data()    + node_potentials_start;
+    const double* __restrict clusters_p_dx_ptr = interp_potential_dx_.data() + node_potentials_start;
+    const double* __restrict clusters_p_dy_ptr = interp_potential_dy_.data() + node_potentials_start;
+    const double* __restrict clusters_p_dz_ptr = interp_potential_dz_.data() + node_potentials_start;
+
+    const double* __restrict particles_x_ptr   = particles_.x_ptr();
+    const double* __restrict particles_y_ptr   = particles_.y_ptr();
+    const double* __restrict particles_z_ptr   = particles_.z_ptr();
+
+    const double* __restrict targets_q_ptr     = particles_.target_charge_ptr();
+    const double* __restrict targets_q_dx_ptr  = particles_.target_charge_dx_ptr();
+    const double* __restrict targets_q_dy_ptr  = particles_.target_charge_dy_ptr();
+    const double* __restrict targets_q_dz_ptr  = particles_.target_charge_dz_ptr();
+
+    double cx[NP], cy[NP], cz[NP], w[NP];
+    for (int k = 0; k < NP; ++k) {
+        cx[k] = interp_x_[node_interp_pts_start + k];
+        cy[k] = interp_y_[node_interp_pts_start + k];
+        cz[k] = interp_z_[node_interp_pts_start + k];
+        w [k] = weights[NP * max_num_interp_pts_per_node_ + k];
+    }
+
+    for (std::size_t i = particle_idxs[0]; i < particle_idxs[1]; ++i) {
+
+        double ax[NP], ay[NP], az[NP];
+        double denominator = 1.;
+        barycentric_factors<NP>(particles_x_ptr[i], cx, w, ax, denominator);
+        barycentric_factors<NP>(particles_y_ptr[i], cy, w, ay, denominator);
+        barycentric_factors<NP>(particles_z_ptr[i], cz, w, az, denominator);
+
+        double pot_comp_   = 0.;
+        double pot_comp_dx = 0.;
+        double pot_comp_dy = 0.;
+        double pot_comp_dz = 0.;
+
+        for (int k1 = 0; k1 < NP; ++k1) {
+        for (int k2 = 0; k2 < NP; ++k2) {
+        for (int k3 = 0; k3 < NP; ++k3) {
+
+            int kk = (k1 * NP + k2) * NP + k3;
+            double numerator = ax[k1] * ay[k2] * az[k3];
+
+            pot_comp_   += numerator * denominator * clusters_p_ptr   [kk];
+            pot_comp_dx += numerator * denominator * clusters_p_dx_ptr[kk];
+            pot_comp_dy += numerator * denominator * clusters_p_dy_ptr[kk];
+            pot_comp_dz += numerator * denominator * clusters_p_dz_ptr[kk];
+        }
+        }
+        }
+
+        potential[i]                    += targets_q_ptr   [i] * pot_comp_;
+        potential[i + potential_offset] += targets_q_dx_ptr[i] * pot_comp_dx
+                                         + targets_q_dy_ptr[i] * pot_comp_dy
+                                         + targets_q_dz_ptr[i] * pot_comp_dz;
+    }
+}
+
+
+BoundaryElement::ParticleClusterKernel BoundaryElement::particle_cluster_kernel(int num_interp_pts, KernelPolicy policy)
+{
+    static const std::array<std::array<ParticleClusterKernel, FIXED_MAX_INTERP_PTS - FIXED_MIN_INTERP_PTS + 1>, 3> kernels {{
+        {{
+            &BoundaryElement::particle_cluster_interact_fixed<UnscreenedKernel, 2>, &BoundaryElement::particle_cluster_interact_fixed<UnscreenedKernel, 3>,
+            &BoundaryElement::particle_cluster_interact_fixed<UnscreenedKernel, 4>, &BoundaryElement::particle_cluster_interact_fixed<UnscreenedKernel, 5>,
+            &BoundaryElement::particle_cluster_interact_fixed<UnscreenedKernel, 6>, &BoundaryElement::particle_cluster_interact_fixed<UnscreenedKernel, 7>,
+            &BoundaryElement::particle_cluster_interact_fixed<UnscreenedKernel, 8>, &BoundaryElement::particle_cluster_interact_fixed<UnscreenedKernel, 9>}},
+        {{
+            &BoundaryElement::particle_cluster_interact_fixed<ScreenedKernel, 2>, &BoundaryElement::particle_cluster_interact_fixed<ScreenedKernel, 3>,
+            &BoundaryElement::particle_cluster_interact_fixed<ScreenedKernel, 4>, &BoundaryElement::particle_cluster_interact_fixed<ScreenedKernel, 5>,
+            &BoundaryElement::particle_cluster_interact_fixed<ScreenedKernel, 6>, &BoundaryElement::particle_cluster_interact_fixed<ScreenedKernel, 7>,
+            &BoundaryElement::particle_cluster_interact_fixed<ScreenedKernel, 8>, &BoundaryElement::particle_cluster_interact_fixed<ScreenedKernel, 9>}},
+        {{
+            &BoundaryElement::particle_cluster_interact_fixed<TabulatedKernel, 2>, &BoundaryElement::particle_cluster_interact_fixed<TabulatedKernel, 3>,
+            &BoundaryElement::particle_cluster_interact_fixed<TabulatedKernel, 4>, &BoundaryElement::particle_cluster_interact_fixed<TabulatedKernel, 5>,
+            &BoundaryElement::particle_cluster_interact_fixed<TabulatedKernel, 6>, &BoundaryElement::particle_cluster_interact_fixed<TabulatedKernel, 7>,
+            &BoundaryElement::particle_cluster_interact_fixed<TabulatedKernel, 8>, &BoundaryElement::particle_cluster_interact_fixed<TabulatedKernel, 9>}}}};
+
+    if (num_interp_pts < FIXED_MIN_INTERP_PTS || num_interp_pts > FIXED_MAX_INTERP_PTS) return nullptr;
+    return kernels[policy][num_interp_pts - FIXED_MIN_INTERP_PTS];
+}
+
+
+BoundaryElement::ClusterParticleKernel BoundaryElement::cluster_particle_kernel(int num_interp_pts, KernelPolicy policy)
+{
+    static const std::array<std::array<ClusterParticleKernel, FIXED_MAX_INTERP_PTS - FIXED_MIN_INTERP_PTS + 1>, 3> kernels {{
+        {{
+            &BoundaryElement::cluster_particle_interact_fixed<UnscreenedKernel, 2>, &BoundaryElement::cluster_particle_interact_fixed<UnscreenedKernel, 3>,
+            &BoundaryElement::cluster_particle_interact_fixed<UnscreenedKernel, 4>, &BoundaryElement::cluster_particle_interact_fixed<UnscreenedKernel, 5>,
+            &BoundaryElement::cluster_particle_interact_fixed<UnscreenedKernel, 6>, &BoundaryElement::cluster_particle_interact_fixed<UnscreenedKernel, 7>,
+            &BoundaryElement::cluster_particle_interact_fixed<UnscreenedKernel, 8>, &BoundaryElement::cluster_particle_interact_fixed<UnscreenedKernel, 9>}},
+        {{
+            &BoundaryElement::cluster_particle_interact_fixed<ScreenedKernel, 2>, &BoundaryElement::cluster_particle_interact_fixed<ScreenedKernel, 3>,
+            &BoundaryElement::cluster_particle_interact_fixed<ScreenedKernel, 4>, &BoundaryElement::cluster_particle_interact_fixed<ScreenedKernel, 5>,
+            &BoundaryElement::cluster_particle_interact_fixed<ScreenedKernel, 6>, &BoundaryElement::cluster_particle_interact_fixed<ScreenedKernel, 7>,
+            &BoundaryElement::cluster_particle_interact_fixed<ScreenedKernel, 8>, &BoundaryElement::cluster_particle_interact_fixed<ScreenedKernel, 9>}},
+        {{
+            &BoundaryElement::cluster_particle_interact_fixed<TabulatedKernel, 2>, &BoundaryElement::cluster_particle_interact_fixed<TabulatedKernel, 3>,
+            &BoundaryElement::cluster_particle_interact_fixed<TabulatedKernel, 4>, &BoundaryElement::cluster_particle_interact_fixed<TabulatedKernel, 5>,
+            &BoundaryElement::cluster_particle_interact_fixed<TabulatedKernel, 6>, &BoundaryElement::cluster_particle_interact_fixed<TabulatedKernel, 7>,
+            &BoundaryElement::cluster_particle_interact_fixed<TabulatedKernel, 8>, &BoundaryElement::cluster_particle_interact_fixed<TabulatedKernel, 9>}}}};
+
+    if (num_interp_pts < FIXED_MIN_INTERP_PTS || num_interp_pts > FIXED_MAX_INTERP_PTS) return nullptr;
+    return kernels[policy][num_interp_pts - FIXED_MIN_INTERP_PTS];
+}
+
+
+BoundaryElement::ClusterClusterKernel BoundaryElement::cluster_cluster_kernel(int num_source_interp_pts, KernelPolicy policy)
+{
+    static const std::array<std::array<ClusterClusterKernel, FIXED_MAX_INTERP_PTS - FIXED_MIN_INTERP_PTS + 1>, 3> kernels {{
+        {{
+            &BoundaryElement::cluster_cluster_interact_fixed<UnscreenedKernel, 2>, &BoundaryElement::cluster_cluster_interact_fixed<UnscreenedKernel, 3>,
+            &BoundaryElement::cluster_cluster_interact_fixed<UnscreenedKernel, 4>, &BoundaryElement::cluster_cluster_interact_fixed<UnscreenedKernel, 5>,
+            &BoundaryElement::cluster_cluster_interact_fixed<UnscreenedKernel, 6>, &BoundaryElement::cluster_cluster_interact_fixed<UnscreenedKernel, 7>,
+            &BoundaryElement::cluster_cluster_interact_fixed<UnscreenedKernel, 8>, &BoundaryElement::cluster_cluster_interact_fixed<UnscreenedKernel, 9>}},
+        {{
+            &BoundaryElement::cluster_cluster_interact_fixed<ScreenedKernel, 2>, &BoundaryElement::cluster_cluster_interact_fixed<ScreenedKernel, 3>,
+            &BoundaryElement::cluster_cluster_interact_fixed<ScreenedKernel, 4>, &BoundaryElement::cluster_cluster_interact_fixed<ScreenedKernel, 5>,
+            &BoundaryElement::cluster_cluster_interact_fixed<ScreenedKernel, 6>, &BoundaryElement::cluster_cluster_interact_fixed<ScreenedKernel, 7>,
+            &BoundaryElement::cluster_cluster_interact_fixed<ScreenedKernel, 8>, &BoundaryElement::cluster_cluster_interact_fixed<ScreenedKernel, 9>}},
+        {{
+            &BoundaryElement::cluster_cluster_interact_fixed<TabulatedKernel, 2>, &BoundaryElement::cluster_cluster_interact_fixed<TabulatedKernel, 3>,
+            &BoundaryElement::cluster_cluster_interact_fixed<TabulatedKernel, 4>, &BoundaryElement::cluster_cluster_interact_fixed<TabulatedKernel, 5>,
+            &BoundaryElement::cluster_cluster_interact_fixed<TabulatedKernel, 6>, &BoundaryElement::cluster_cluster_interact_fixed<TabulatedKernel, 7>,
+            &BoundaryElement::cluster_cluster_interact_fixed<TabulatedKernel, 8>, &BoundaryElement::cluster_cluster_interact_fixed<TabulatedKernel, 9>}}}};
+
+    if (num_source_interp_pts < FIXED_MIN_INTERP_PTS || num_source_interp_pts > FIXED_MAX_INTERP_PTS) return nullptr;
+    return kernels[policy][num_source_interp_pts - FIXED_MIN_INTERP_PTS];
+}
+
+
+Clusters::UpwardNodeKernel Clusters::upward_node_kernel(int num_interp_pts)
+{
+    static const std::array<UpwardNodeKernel, FIXED_MAX_INTERP_PTS - FIXED_MIN_INTERP_PTS + 1> kernels {{
+        &Clusters::upward_pass_node_fixed<2>, &Clusters::upward_pass_node_fixed<3>,
+        &Clusters::upward_pass_node_fixed<4>, &Clusters::upward_pass_node_fixed<5>,
+        &Clusters::upward_pass_node_fixed<6>, &Clusters::upward_pass_node_fixed<7>,
+        &Clusters::upward_pass_node_fixed<8>, &Clusters::upward_pass_node_fixed<9>}};
+
+    if (num_interp_pts < FIXED_MIN_INTERP_PTS || num_interp_pts > FIXED_MAX_INTERP_PTS) return nullptr;
+    return kernels[num_interp_pts - FIXED_MIN_INTERP_PTS];
+}
+
+
+Clusters::DownwardNodeKernel Clusters::downward_node_kernel(int num_interp_pts)
+{
+    static const std::array<DownwardNodeKernel, FIXED_MAX_INTERP_PTS - FIXED_MIN_INTERP_PTS + 1> kernels {{
+        &Clusters::downward_pass_node_fixed<2>, &Clusters::downward_pass_node_fixed<3>,
+        &Clusters::downward_pass_node_fixed<4>, &Clusters::downward_pass_node_fixed<5>,
+        &Clusters::downward_pass_node_fixed<6>, &Clusters::downward_pass_node_fixed<7>,
+        &Clusters::downward_pass_node_fixed<8>, &Clusters::downward_pass_node_fixed<9>}};
+
+    if (num_interp_pts < FIXED_MIN_INTERP_PTS || num_interp_pts > FIXED_MAX_INTERP_PTS) return nullptr;
+    return kernels[num_interp_pts - FIXED_MIN_INTERP_PTS];
+}
@@ -2,7 +2,9 @@
 #include <iomanip>
 #include <cmath>
 
+#include "profiler.h"
 #include "boundary_element.h"
+#include "gmres_blas.h"
 
 /*  -- Iterative template routine --
 *     Univ. of Tennessee and Oak Ridge National Laboratory
@@ -91,25 +93,13 @@
 *  ============================================================
 */
 
-static double dnrm2_(long int n, const double* w);
-static void dscal_(long int n, double alpha, double* x);
-static double ddot_(long int n, const double* __restrict x, const double* __restrict y);
-static void daxpy_(long int n, double alpha, const double* __restrict x, double* __restrict y);
-static void drot_(double& dx, double& dy, double c, double s);
-static void drotg_(double da, double db, double& c, double& s);
-static void dtrsv_(long int n, const double* a, long int lda, double* x);
-static void dgemv_(long int m, long int n, const double* a, long int lda,
-                   const double* x, double* y);
-
-static void update_(long int i, long int n, double* x, const double* h, long int ldh,
-                    double* y, const double* s, const double* v, long int ldv);
-static void basis_(long int i, long int n, double* h, double* v, long int ldv, double* w);
-
 //*****************************************************************
 int BoundaryElement::gmres_(long int n, const double *b, double *x, long int restrt,
                      double* work, long int ldw, double* h, long int ldh,
                      long int& iter, double& resid)
 {
+    using namespace gmres_blas;
+
     long int maxit = iter;
     double tol = resid;
 
@@ -133,7 +123,7 @@ int BoundaryElement::gmres_(long int n, const double *b, double *x, long int res
         return 0;
     }
 
-    iter = 0;
+    iter = restart_iter_;
 
     while (true) {
 
@@ -150,6 +140,7 @@ int BoundaryElement::gmres_(long int n, const double *b, double *x, long int res
         for (long int k = 1; k < n; ++k) work[k + ldw] = 0.;
 
         for (long int i = 0; i < restrt; ++i) {
+            PROFILE_SCOPE("run_GMRES/iteration");
             ++iter;
 
             BoundaryElement::matrix_vector(1., &work[(3 + i) * ldw], 0., &work[2 * ldw]);
@@ -190,6 +181,7 @@ int BoundaryElement::gmres_(long int n, const double *b, double *x, long int res
             resid = std::fabs(work[i + 1 + ldw]) / bnrm2;
             std::cout << "GMRES iteration " << std::setw(3) << iter
                       << ": error = " << std::scientific << resid << std::endl;
+            BoundaryElement::write_telemetry("iteration", iter, resid);
 
             if (resid <= tol) {
 
@@ -214,11 +206,19 @@ int BoundaryElement::gmres_(long int n, const double *b, double *x, long int res
 
         work[restrt + ldw] = dnrm2_(n, work);
         resid = work[restrt + ldw] / bnrm2;
+        BoundaryElement::write_telemetry("restart", iter, resid);
 
         if (resid <= tol) {
             return 0;
         }
         
+    /*        At a restart the Krylov basis is discarded, so X and ITER are */
+    /*        the complete solver state. */
+
+        if (!params_.checkpoint_file_.empty() && (iter / restrt) % params_.checkpoint_interval_ == 0) {
+            BoundaryElement::write_checkpoint(params_.checkpoint_file_, x, iter, resid);
+        }
+        
         if (iter == maxit) {
             return 1;
         }
@@ -226,9 +226,11 @@ int BoundaryElement::gmres_(long int n, const double *b, double *x, long int res
 }
 
 
+namespace gmres_blas {
+
 /*     =============================================================== */
-static void update_(long int i, long int n, double* x, const double* h, long int ldh,
-                    double* y, const double* s, const double* v, long int ldv)
+void update_(long int i, long int n, double* x, const double* h, long int ldh,
+             double* y, const double* s, const double* v, long int ldv)
 {
 /*     This routine updates the GMRES iterated solution approximation. */
 /*     Solve H*Y = S for upper triangualar H. */
@@ -242,7 +244,7 @@ static void update_(long int i, long int n, double* x, const double* h, long int
 
 
 /*     ========================================================= */
-static void basis_(long int i, long int n, double* h, double* v, long int ldv, double* w)
+void basis_(long int i, long int n, double* h, double* v, long int ldv, double* w)
 {
 /*     Construct the I-th column of the upper Hessenberg matrix H */
 /*     using the Gram-Schmidt process on V and W. */
@@ -258,7 +260,7 @@ static void basis_(long int i, long int n, double* h, double* v, long int ldv, d
 }
 
 
-static double dnrm2_(long int n, const double* x)
+double dnrm2_(long int n, const double* x)
 {
     double norm = 0.;
     for (long int idx = 0; idx < n; ++idx) {
@@ -268,15 +270,15 @@ static double dnrm2_(long int n, const double* x)
 }
 
 
-static void dscal_(long int n, double alpha, double* x)
+void dscal_(long int n, double alpha, double* x)
 {
     for (long int idx = 0; idx < n; ++idx) {
         x[idx] *= alpha;
     }
 }
 
-static double ddot_(long int n, const double* __restrict x,
-                    const double* __restrict y)
+double ddot_(long int n, const double* __restrict x,
+             const double* __restrict y)
 {
     double ddot = 0.;
     for (long int idx = 0; idx < n; ++idx) {
@@ -286,8 +288,8 @@ static double ddot_(long int n, const double* __restrict x,
 }
 
 
-static void daxpy_(long int n, double alpha, const double* __restrict x,
-                   double* __restrict y)
+void daxpy_(long int n, double alpha, const double* __restrict x,
+            double* __restrict y)
 {
     for (long int idx = 0; idx < n; ++idx) {
         y[idx] += alpha * x[idx];
@@ -295,7 +297,7 @@ static void daxpy_(long int n, double alpha, const double* __restrict x,
 }
 
 
-static void drot_(double& dx, double& dy, double c, double s)
+void drot_(double& dx, double& dy, double c, double s)
 {
 /*  applies a plane rotation. */
     double dtemp = c * dx + s * dy;
@@ -304,7 +306,7 @@ static void drot_(double& dx, double& dy, double c, double s)
 }
 
 
-static void drotg_(double da, double db, double& c, double& s)
+void drotg_(double da, double db, double& c, double& s)
 {
 /*  construct givens plane rotation. */
 
@@ -329,8 +331,8 @@ static void drotg_(double da, double db, double& c, double& s)
 }
 
 
-static void dtrsv_(long int n, const double* a, long int lda,
-                   double* x)
+void dtrsv_(long int n, const double* a, long int lda,
+            double* x)
 {
 /*  solve A*x = b, where A is upper triangular */
 
@@ -346,8 +348,8 @@ static void dtrsv_(long int n, const double* a, long int lda,
 }
 
 
-static void dgemv_(long int m, long int n, const double* a, long int lda,
-                   const double* x, double* y)
+void dgemv_(long int m, long int n, const double* a, long int lda,
+            const double* x, double* y)
 {
 /*  Form  y = A*x + y */
 
@@ -360,3 +362,5 @@ static void dgemv_(long int m, long int n, const double* a, long int lda,
         }
     }
 }
+
+} // namespace gmres_blas
@@ -0,0 +1,23 @@
+#ifndef H_TABIPB_GMRES_BLAS_H
+#define H_TABIPB_GMRES_BLAS_H
+
+/* The BLAS-style helpers used by BoundaryElement::gmres_, in column-major
+ * storage with leading dimensions, as in the reference templates. */
+
+namespace gmres_blas {
+    double dnrm2_(long int n, const double* w);
+    void dscal_(long int n, double alpha, double* x);
+    double ddot_(long int n, const double* __restrict x, const double* __restrict y);
+    void daxpy_(long int n, double alpha, const double* __restrict x, double* __restrict y);
+    void drot_(double& dx, double& dy, double c, double s);
+    void drotg_(double da, double db, double& c, double& s);
+    void dtrsv_(long int n, const double* a, long int lda, double* x);
+    void dgemv_(long int m, long int n, const double* a, long int lda,
+                const double* x, double* y);
+
+    void update_(long int i, long int n, double* x, const double* h, long int ldh,
+                 double* y, const double* s, const double* v, long int ldv);
+    void basis_(long int i, long int n, double* h, double* v, long int ldv, double* w);
+}
+
+#endif
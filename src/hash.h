@@ -0,0 +1,26 @@
+#ifndef H_TABIPB_HASH_H
+#define H_TABIPB_HASH_H
+
+#include <cstdint>
+#include <cstddef>
+
+/* 64-bit FNV-1a, used to key cached and checkpointed data on their inputs */
+class FNV1a
+{
+private:
+    std::uint64_t hash_ = 14695981039346656037ULL;
+
+public:
+    void add(const void* data, std::size_t num_bytes)
+    {
+        auto bytes = static_cast<const unsigned char*>(data);
+        for (std::size_t i = 0; i < num_bytes; ++i) {
+            hash_ ^= bytes[i];
+            hash_ *= 1099511628211ULL;
+        }
+    }
+
+    std::uint64_t value() const { return hash_; }
+};
+
+#endif
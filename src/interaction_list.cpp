@@ -1,14 +1,17 @@
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <cmath>
 #include <cstddef>
 
+#include "perf_counters.h"
 #include "interaction_list.h"
 
 InteractionList::InteractionList(const class Tree& tree,
                                  const struct Params& params, struct Timers_InteractionList& timers)
     : tree_(tree), params_(params), timers_(timers)
 {
+    PERF_SCOPE(INTERACTION_LIST);
     timers_.ctor.start();
 
     size_check_ = std::pow(params_.tree_degree_ + 1, 3);
@@ -16,9 +19,22 @@ InteractionList::InteractionList(const class Tree& tree,
     particle_cluster_ .resize(tree_.num_nodes_);
     cluster_particle_ .resize(tree_.num_nodes_);
     cluster_cluster_  .resize(tree_.num_nodes_);
+    mutual_particle_particle_.resize(tree_.num_nodes_);
+    mutual_cluster_cluster_  .resize(tree_.num_nodes_);
+    
+    // the mutual kernels scatter to both nodes of a pair, so they are host only
+#ifdef OPENACC_ENABLED
+    mutual_ = false;
+#else
+    mutual_ = params_.tree_mutual_;
+#endif
     
     //for (auto batch_idx : tree_.leaves_) InteractionList::build_BLTC_lists(batch_idx, 0);
-    InteractionList::build_BLDTT_lists(0,0);
+    if (mutual_)                  InteractionList::build_mutual_lists(0, 0);
+    else if (tree_.packed_nodes_) InteractionList::build_BLDTT_lists(tree_.packed_nodes_[0], tree_.packed_nodes_[0]);
+    else                          InteractionList::build_BLDTT_lists(0,0);
+    
+    if (params_.tree_adaptive_degree_) InteractionList::compute_separation_ratios();
 
     timers_.ctor.stop();
 }
@@ -110,6 +126,178 @@ void InteractionList::build_BLDTT_lists(std::size_t target_node_idx, std::size_t
 }
 
 
+void InteractionList::build_BLDTT_lists(const TreeNode& target_node, const TreeNode& source_node)
+{
+    // same traversal as above, reading only the packed node records
+    const TreeNode* nodes = tree_.packed_nodes_;
+    
+    double dist_x = target_node.x_mid - source_node.x_mid;
+    double dist_y = target_node.y_mid - source_node.y_mid;
+    double dist_z = target_node.z_mid - source_node.z_mid;
+    
+    double accept_distance = std::sqrt(dist_x*dist_x + dist_y*dist_y + dist_z*dist_z) * params_.tree_theta_;
+    double sum_node_radius = target_node.radius + source_node.radius;
+
+    bool target_node_size_check_passed = target_node.num_particles > (std::uint64_t)size_check_;
+    bool source_node_size_check_passed = source_node.num_particles > (std::uint64_t)size_check_;
+    
+    std::size_t target_node_idx = target_node.node_idx;
+    std::size_t source_node_idx = source_node.node_idx;
+    
+    
+    if (sum_node_radius < accept_distance) {
+    
+        if (!target_node_size_check_passed && !source_node_size_check_passed) {
+            particle_particle_[target_node_idx].push_back(source_node_idx);
+        
+        } else if (!source_node_size_check_passed) {
+            cluster_particle_[target_node_idx].push_back(source_node_idx);
+            
+        } else if (!target_node_size_check_passed) {
+            particle_cluster_[target_node_idx].push_back(source_node_idx);
+            
+        } else {
+            cluster_cluster_[target_node_idx].push_back(source_node_idx);
+        }
+       
+    } else {
+    
+        if (!target_node.num_children && !source_node.num_children) {
+            particle_particle_[target_node_idx].push_back(source_node_idx);
+    
+        } else if (!source_node.num_children) {
+            for (std::uint32_t i = 0; i < target_node.num_children; ++i)
+                InteractionList::build_BLDTT_lists(nodes[target_node.first_child + i], source_node);
+    
+        } else if (!target_node.num_children) {
+            for (std::uint32_t i = 0; i < source_node.num_children; ++i)
+                InteractionList::build_BLDTT_lists(target_node, nodes[source_node.first_child + i]);
+    
+        } else if (source_node.num_particles < target_node.num_particles) {
+            for (std::uint32_t i = 0; i < target_node.num_children; ++i)
+                InteractionList::build_BLDTT_lists(nodes[target_node.first_child + i], source_node);
+    
+        } else {
+            for (std::uint32_t i = 0; i < source_node.num_children; ++i)
+                InteractionList::build_BLDTT_lists(target_node, nodes[source_node.first_child + i]);
+        
+        }
+    }
+}
+
+
+void InteractionList::build_mutual_lists(std::size_t node_idx_a, std::size_t node_idx_b)
+{
+    // The dual tree traversal over unordered pairs: a node meets itself by pairing
+    // its children, each once, and two distinct nodes are accepted by the same tests
+    // as build_BLDTT_lists, or split at the node with more particles. That covers every
+    // pair exactly once, but it is not the split the directed lists make: for two
+    // non-leaf nodes of equal size those split the source, so (a, b) and (b, a) split
+    // different nodes, and mutual energies differ slightly from the directed ones.
+    // Near-field and cluster-cluster pairs go to the mutual lists; a particle-cluster
+    // pair is the cluster-particle pair of the other node, so it goes to both directed
+    // lists.
+    int num_children_a = tree_.node_num_children_[node_idx_a];
+    int num_children_b = tree_.node_num_children_[node_idx_b];
+    
+    if (node_idx_a == node_idx_b) {
+    
+        if (!num_children_a) {
+            particle_particle_[node_idx_a].push_back(node_idx_a);
+            
+        } else {
+            for (int i = 0; i < num_children_a; ++i)
+                for (int j = i; j < num_children_a; ++j)
+                    InteractionList::build_mutual_lists(tree_.node_children_idx_[8*node_idx_a + i],
+                                                        tree_.node_children_idx_[8*node_idx_a + j]);
+        }
+        return;
+    }
+    
+    double dist_x = tree_.node_x_mid_[node_idx_a] - tree_.node_x_mid_[node_idx_b];
+    double dist_y = tree_.node_y_mid_[node_idx_a] - tree_.node_y_mid_[node_idx_b];
+    double dist_z = tree_.node_z_mid_[node_idx_a] - tree_.node_z_mid_[node_idx_b];
+    
+    double accept_distance = std::sqrt(dist_x*dist_x + dist_y*dist_y + dist_z*dist_z) * params_.tree_theta_;
+    double sum_node_radius = tree_.node_radius_[node_idx_a] + tree_.node_radius_[node_idx_b];
+    
+    bool size_check_passed_a = tree_.node_num_particles_[node_idx_a] > (std::size_t)size_check_;
+    bool size_check_passed_b = tree_.node_num_particles_[node_idx_b] > (std::size_t)size_check_;
+    
+    
+    if (sum_node_radius < accept_distance) {
+    
+        if (!size_check_passed_a && !size_check_passed_b) {
+            mutual_particle_particle_[node_idx_a].push_back(node_idx_b);
+            
+        } else if (!size_check_passed_b) {
+            cluster_particle_[node_idx_a].push_back(node_idx_b);
+            particle_cluster_[node_idx_b].push_back(node_idx_a);
+            
+        } else if (!size_check_passed_a) {
+            particle_cluster_[node_idx_a].push_back(node_idx_b);
+            cluster_particle_[node_idx_b].push_back(node_idx_a);
+            
+        } else {
+            mutual_cluster_cluster_[node_idx_a].push_back(node_idx_b);
+        }
+        
+    } else {
+    
+        if (!num_children_a && !num_children_b) {
+            mutual_particle_particle_[node_idx_a].push_back(node_idx_b);
+            
+        } else if (!num_children_b || (num_children_a
+                && tree_.node_num_particles_[node_idx_b] < tree_.node_num_particles_[node_idx_a])) {
+            for (int i = 0; i < num_children_a; ++i)
+                InteractionList::build_mutual_lists(tree_.node_children_idx_[8*node_idx_a + i], node_idx_b);
+                
+        } else {
+            for (int i = 0; i < num_children_b; ++i)
+                InteractionList::build_mutual_lists(node_idx_a, tree_.node_children_idx_[8*node_idx_b + i]);
+        }
+    }
+}
+
+
+void InteractionList::compute_separation_ratios()
+{
+    node_separation_ratio_.assign(tree_.num_nodes_, 0.);
+    
+    // the interpolation error of a cluster decays like the ratio of its radius to
+    // the distance from its center to the nearest point of its partner
+    auto update_ratio = [this](std::size_t node_idx, std::size_t partner_idx) {
+        double dist_x = tree_.node_x_mid_[node_idx] - tree_.node_x_mid_[partner_idx];
+        double dist_y = tree_.node_y_mid_[node_idx] - tree_.node_y_mid_[partner_idx];
+        double dist_z = tree_.node_z_mid_[node_idx] - tree_.node_z_mid_[partner_idx];
+        
+        double dist  = std::sqrt(dist_x*dist_x + dist_y*dist_y + dist_z*dist_z);
+        double ratio = tree_.node_radius_[node_idx] / (dist - tree_.node_radius_[partner_idx]);
+        
+        node_separation_ratio_[node_idx] = std::max(node_separation_ratio_[node_idx], ratio);
+    };
+    
+    for (std::size_t target_node_idx = 0; target_node_idx < tree_.num_nodes_; ++target_node_idx) {
+    
+        for (auto source_node_idx : particle_cluster_[target_node_idx])
+            update_ratio(source_node_idx, target_node_idx);
+            
+        for (auto source_node_idx : cluster_particle_[target_node_idx])
+            update_ratio(target_node_idx, source_node_idx);
+            
+        for (auto source_node_idx : cluster_cluster_[target_node_idx]) {
+            update_ratio(source_node_idx, target_node_idx);
+            update_ratio(target_node_idx, source_node_idx);
+        }
+        
+        for (auto source_node_idx : mutual_cluster_cluster_[target_node_idx]) {
+            update_ratio(source_node_idx, target_node_idx);
+            update_ratio(target_node_idx, source_node_idx);
+        }
+    }
+}
+
+
 void Timers_InteractionList::print() const
 {
     std::cout.setf(std::ios::fixed, std::ios::floatfield);
@@ -23,8 +23,18 @@ private:
     std::vector<std::vector<std::size_t>> cluster_particle_;
     std::vector<std::vector<std::size_t>> cluster_cluster_;
     
+    // unordered node pairs, each kept in the list of one node and evaluated for both
+    std::vector<std::vector<std::size_t>> mutual_particle_particle_;
+    std::vector<std::vector<std::size_t>> mutual_cluster_cluster_;
+    bool mutual_;
+    
+    std::vector<double> node_separation_ratio_;
+    
     void build_BLTC_lists(std::size_t batch_idx, std::size_t node_idx);
     void build_BLDTT_lists(std::size_t target_node_idx, std::size_t source_node_idx);
+    void build_BLDTT_lists(const TreeNode& target_node, const TreeNode& source_node);
+    void build_mutual_lists(std::size_t node_idx_a, std::size_t node_idx_b);
+    void compute_separation_ratios();
     
 public:
     InteractionList(const class Tree&, const struct Params&, struct Timers_InteractionList&);
@@ -34,6 +44,14 @@ public:
     const std::vector<std::size_t>& particle_cluster (std::size_t idx) const { return particle_cluster_ [idx]; }
     const std::vector<std::size_t>& cluster_particle (std::size_t idx) const { return cluster_particle_ [idx]; }
     const std::vector<std::size_t>& cluster_cluster  (std::size_t idx) const { return cluster_cluster_  [idx]; }
+    
+    const std::vector<std::size_t>& mutual_particle_particle(std::size_t idx) const { return mutual_particle_particle_[idx]; }
+    const std::vector<std::size_t>& mutual_cluster_cluster  (std::size_t idx) const { return mutual_cluster_cluster_  [idx]; }
+    bool mutual() const { return mutual_; }
+    
+    // largest r_node / (dist - r_partner) over the far-field partners of each node acting
+    // as a cluster, zero for nodes never interpolated; only set for adaptive degrees
+    const std::vector<double>& node_separation_ratio() const { return node_separation_ratio_; }
 };
 
 
@@ -0,0 +1,141 @@
+#ifndef H_TABIPB_KERNEL_COSTS_H
+#define H_TABIPB_KERNEL_COSTS_H
+
+#include <cstddef>
+
+/* Operation and memory-traffic models for the treecode kernels. Flops are counted
+ * from the kernel bodies, with every add, multiply, divide, sqrt and exp as one.
+ * Bytes are the compulsory traffic of one call: every array element the call reads
+ * is loaded once, and every element it updates is loaded and stored once. */
+
+namespace kernel_costs {
+
+    /* per target-source pair */
+    constexpr double PP_FLOPS      = 65.;
+    constexpr double CLUSTER_FLOPS = 97.;   // PC, CP and CC share one kernel body
+
+    /* the same at zero ionic strength, where the kernels drop their kappa terms */
+    constexpr double UNSCREENED_PP_FLOPS      = 38.;
+    constexpr double UNSCREENED_CLUSTER_FLOPS = 32.;
+
+    inline double pp_flops(bool screened)      { return screened ? PP_FLOPS      : UNSCREENED_PP_FLOPS; }
+    inline double cluster_flops(bool screened) { return screened ? CLUSTER_FLOPS : UNSCREENED_CLUSTER_FLOPS; }
+
+    /* per unordered pair in the mutual kernels, which count two evaluations */
+    constexpr double MUTUAL_PP_FLOPS = 79.;
+    constexpr double MUTUAL_CC_FLOPS = 150.;
+    constexpr double UNSCREENED_MUTUAL_PP_FLOPS = 48.;
+    constexpr double UNSCREENED_MUTUAL_CC_FLOPS = 50.;
+
+    inline double mutual_pp_flops(bool screened) { return screened ? MUTUAL_PP_FLOPS : UNSCREENED_MUTUAL_PP_FLOPS; }
+    inline double mutual_cc_flops(bool screened) { return screened ? MUTUAL_CC_FLOPS : UNSCREENED_MUTUAL_CC_FLOPS; }
+
+    /* per particle and interpolation point, for the barycentric denominators */
+    constexpr double INTERP_DENOMINATOR_FLOPS = 9.;
+
+    /* per particle and interpolation charge, in the upward and downward passes */
+    constexpr double INTERP_CHARGE_FLOPS = 21.;
+
+    /* per particle pair in a leaf block of the block preconditioner */
+    constexpr double PRECONDITION_PAIR_FLOPS = 71.;
+    constexpr double UNSCREENED_PRECONDITION_PAIR_FLOPS = 48.;
+
+    constexpr double DOUBLE_BYTES = 8.;
+
+    /* particle-particle: targets read x, y, z, normal and update two potentials;
+     * sources read x, y, z, normal, area and two potentials */
+    inline double pp_bytes(std::size_t num_targets, std::size_t num_sources)
+    {
+        return DOUBLE_BYTES * (10. * num_targets + 9. * num_sources);
+    }
+
+    /* particle-cluster: targets read x, y, z, four charges and update two potentials;
+     * the source cluster reads its points and four charges per interpolation charge */
+    inline double pc_bytes(std::size_t num_targets, std::size_t num_interp_pts)
+    {
+        double num_charges = (double)num_interp_pts * num_interp_pts * num_interp_pts;
+        return DOUBLE_BYTES * (11. * num_targets + 3. * num_interp_pts + 4. * num_charges);
+    }
+
+    /* cluster-particle: the target cluster updates four potentials per charge;
+     * sources read x, y, z, the normal, area and two potentials they form charges from */
+    inline double cp_bytes(std::size_t num_interp_pts, std::size_t num_sources)
+    {
+        double num_charges = (double)num_interp_pts * num_interp_pts * num_interp_pts;
+        return DOUBLE_BYTES * (3. * num_interp_pts + 8. * num_charges + 9. * num_sources);
+    }
+
+    inline double cc_bytes(std::size_t num_target_interp_pts, std::size_t num_source_interp_pts)
+    {
+        double num_target_charges = (double)num_target_interp_pts * num_target_interp_pts * num_target_interp_pts;
+        double num_source_charges = (double)num_source_interp_pts * num_source_interp_pts * num_source_interp_pts;
+        return DOUBLE_BYTES * (3. * num_target_interp_pts + 8. * num_target_charges
+                             + 3. * num_source_interp_pts + 4. * num_source_charges);
+    }
+
+    /* mutual particle-particle: both nodes read x, y, z, normal, area and two
+     * potentials, and update two potentials */
+    inline double mutual_pp_bytes(std::size_t num_particles_a, std::size_t num_particles_b)
+    {
+        return DOUBLE_BYTES * 13. * (num_particles_a + num_particles_b);
+    }
+
+    /* mutual cluster-cluster: both clusters read their points and four charges,
+     * and update four potentials per interpolation charge */
+    inline double mutual_cc_bytes(std::size_t num_interp_pts_a, std::size_t num_interp_pts_b)
+    {
+        double num_charges_a = (double)num_interp_pts_a * num_interp_pts_a * num_interp_pts_a;
+        double num_charges_b = (double)num_interp_pts_b * num_interp_pts_b * num_interp_pts_b;
+        return DOUBLE_BYTES * (3. * num_interp_pts_a + 12. * num_charges_a
+                             + 3. * num_interp_pts_b + 12. * num_charges_b);
+    }
+
+    /* upward pass over one node: particles read x, y, z, the normal, area and two
+     * potentials, form their four charges from them in 7 flops, and the node updates
+     * four charges per interpolation charge */
+    inline double upward_flops(std::size_t num_particles, std::size_t num_interp_pts)
+    {
+        double num_charges = (double)num_interp_pts * num_interp_pts * num_interp_pts;
+        return num_particles * (INTERP_DENOMINATOR_FLOPS * num_interp_pts + 3. + 7.
+                              + INTERP_CHARGE_FLOPS * num_charges);
+    }
+
+    inline double upward_bytes(std::size_t num_particles, std::size_t num_interp_pts)
+    {
+        double num_charges = (double)num_interp_pts * num_interp_pts * num_interp_pts;
+        return DOUBLE_BYTES * (9. * num_particles + 3. * num_interp_pts + 8. * num_charges);
+    }
+
+    /* downward pass over one node: particles read x, y, z, four charges and update
+     * two potentials, the node reads four potentials per interpolation charge */
+    inline double downward_flops(std::size_t num_particles, std::size_t num_interp_pts)
+    {
+        double num_charges = (double)num_interp_pts * num_interp_pts * num_interp_pts;
+        return num_particles * (INTERP_DENOMINATOR_FLOPS * num_interp_pts + 3.
+                              + INTERP_CHARGE_FLOPS * num_charges + 7.);
+    }
+
+    inline double downward_bytes(std::size_t num_particles, std::size_t num_interp_pts)
+    {
+        double num_charges = (double)num_interp_pts * num_interp_pts * num_interp_pts;
+        return DOUBLE_BYTES * (11. * num_particles + 3. * num_interp_pts + 4. * num_charges);
+    }
+
+    /* block preconditioner on one leaf: fill the 2m x 2m block, LU factor and solve */
+    inline double precondition_flops(std::size_t num_particles, bool screened)
+    {
+        double m = (double)num_particles;
+        double n = 2. * m;
+        double pair_flops = screened ? PRECONDITION_PAIR_FLOPS : UNSCREENED_PRECONDITION_PAIR_FLOPS;
+        return pair_flops * m * (m - 1.) / 2. + 2. / 3. * n * n * n + 2. * n * n;
+    }
+
+    /* leaf geometry and two halves of r and z, plus the block written and factored in place */
+    inline double precondition_bytes(std::size_t num_particles)
+    {
+        double m = (double)num_particles;
+        return DOUBLE_BYTES * (7. * m + 4. * m + 4. * m * m);
+    }
+}
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef H_TABIPB_KERNEL_POLICY_H
+#define H_TABIPB_KERNEL_POLICY_H
+
+#include <cmath>
+
+#include "yukawa_table.h"
+
+/* The kappa-dependent parts of the kernels, as policy classes the kernels are compiled
+ * against. Each kernel makes one policy object from kappa, kappa^2 and the table of
+ * exp(-kappa r), and calls it for every pair.
+ *
+ * ScreenedKernel is the linearized Poisson-Boltzmann kernel with exp(-kappa r) from
+ * std::exp, and TabulatedKernel the same with it from a YukawaTable. UnscreenedKernel is
+ * the kernel at zero ionic strength: with kappa = 0, exp(-kappa r) and (1 + kappa r) are
+ * both 1, so Gk = G0 and G4 = G3, the differences L2 and L3 vanish, and the far-field
+ * expansion keeps only its dipole terms. */
+
+struct LibmExponential
+{
+    explicit LibmExponential(const YukawaTable&) {}
+
+#ifdef OPENACC_ENABLED
+    #pragma acc routine seq
+#endif
+    inline double operator()(double x) const { return std::exp(-x); }
+};
+
+
+template <class Exponential>
+struct Screened
+{
+    double kappa;
+    double kappa2;
+    Exponential exp_neg;
+
+    Screened(double kappa, double kappa2, const YukawaTable& table)
+        : kappa(kappa), kappa2(kappa2), exp_neg(table) {}
+
+    /* For a target-source pair at distance r: tp2 = (1 + kappa r) exp(-kappa r), and
+     * the differences L2 = G0 - Gk and L3 = G4 - G3 of the boundary integrals */
+#ifdef OPENACC_ENABLED
+    #pragma acc routine seq
+#endif
+    inline void boundary_terms(double r, double one_over_r, double G0, double tp1,
+                               double source_cos, double target_cos, double dot_tqsq,
+                               double& tp2, double& L2, double& L3) const
+    {
+        double kappa_r = kappa * r;
+        double exp_kappa_r = exp_neg(kappa_r);
+        double Gk = exp_kappa_r * G0;
+
+        tp2 = (1. + kappa_r) * exp_kappa_r;
+
+        double G3 = (dot_tqsq - 3. * target_cos * source_cos) * one_over_r * tp1;
+        double G4 = tp2 * G3 - kappa2 * target_cos * source_cos * Gk;
+
+        L2 = G0 - Gk;
+        L3 = G4 - G3;
+    }
+
+    /* The far-field expansion between a target point and a source point or
+     * interpolation charge, added to the four target potentials */
+#ifdef OPENACC_ENABLED
+    #pragma acc routine seq
+#endif
+    inline void far_field(double dx, double dy, double dz, double eps,
+                          double q, double q_dx, double q_dy, double q_dz,
+                          double& pot_comp_, double& pot_comp_dx,
+                          double& pot_comp_dy, double& pot_comp_dz) const
+    {
+        double r2    = dx*dx + dy*dy + dz*dz;
+        double r     = std::sqrt(r2);
+        double rinv  = 1. / r;
+        double r3inv = rinv  * rinv * rinv;
+        double r5inv = r3inv * rinv * rinv;
+
+        double expkr   =  exp_neg(kappa * r);
+        double d1term  =  r3inv * expkr * (1. + (kappa * r));
+        double d1term1 = -r3inv + d1term * eps;
+        double d1term2 = -r3inv + d1term / eps;
+        double d2term  =  r5inv * (-3. + expkr * (3. + (3. * kappa * r)
+                                               + (kappa * kappa * r2)));
+        double d3term  =  r3inv * ( 1. - expkr * (1. + kappa * r));
+
+        pot_comp_    += (rinv * (1. - expkr) * (q)
+                                  + d1term1 * (q_dx * dx
+                                             + q_dy * dy
+                                             + q_dz * dz));
+
+        pot_comp_dx  += (q     * (d1term2 * dx)
+                      - (q_dx  * (dx * dx * d2term + d3term)
+                      +  q_dy  * (dx * dy * d2term)
+                      +  q_dz  * (dx * dz * d2term)));
+
+        pot_comp_dy  += (q     *  d1term2 * dy
+                      - (q_dx  * (dx * dy * d2term)
+                      +  q_dy  * (dy * dy * d2term + d3term)
+                      +  q_dz  * (dy * dz * d2term)));
+
+        pot_comp_dz  += (q     *  d1term2 * dz
+                      - (q_dx  * (dx * dz * d2term)
+                      +  q_dy  * (dy * dz * d2term)
+                      +  q_dz  * (dz * dz * d2term + d3term)));
+    }
+
+    /* far_field both ways over one pair: the target point gets the expansion of the
+     * source charges, and the source point that of the target charges. Reversing the
+     * pair flips the sign of (dx, dy, dz), so only the odd terms change sign. */
+    inline void far_field_mutual(double dx, double dy, double dz, double eps,
+                                 double q_s, double q_s_dx, double q_s_dy, double q_s_dz,
+                                 double& pot_t_, double& pot_t_dx, double& pot_t_dy, double& pot_t_dz,
+                                 double q_t, double q_t_dx, double q_t_dy, double q_t_dz,
+                                 double& pot_s_, double& pot_s_dx, double& pot_s_dy, double& pot_s_dz) const
+    {
+        double r2    = dx*dx + dy*dy + dz*dz;
+        double r     = std::sqrt(r2);
+        double rinv  = 1. / r;
+        double r3inv = rinv  * rinv * rinv;
+        double r5inv = r3inv * rinv * rinv;
+
+        double expkr   =  exp_neg(kappa * r);
+        double d1term  =  r3inv * expkr * (1. + (kappa * r));
+        double d1term1 = -r3inv + d1term * eps;
+        double d1term2 = -r3inv + d1term / eps;
+        double d2term  =  r5inv * (-3. + expkr * (3. + (3. * kappa * r)
+                                               + (kappa * kappa * r2)));
+        double d3term  =  r3inv * ( 1. - expkr * (1. + kappa * r));
+        double d0term  =  rinv * (1. - expkr);
+
+        double dxx = dx * dx * d2term + d3term;
+        double dyy = dy * dy * d2term + d3term;
+        double dzz = dz * dz * d2term + d3term;
+        double dxy = dx * dy * d2term;
+        double dxz = dx * dz * d2term;
+        double dyz = dy * dz * d2term;
+
+        pot_t_   += d0term * q_s + d1term1 * (q_s_dx * dx + q_s_dy * dy + q_s_dz * dz);
+        pot_t_dx += q_s * d1term2 * dx - (q_s_dx * dxx + q_s_dy * dxy + q_s_dz * dxz);
+        pot_t_dy += q_s * d1term2 * dy - (q_s_dx * dxy + q_s_dy * dyy + q_s_dz * dyz);
+        pot_t_dz += q_s * d1term2 * dz - (q_s_dx * dxz + q_s_dy * dyz + q_s_dz * dzz);
+
+        pot_s_   += d0term * q_t - d1term1 * (q_t_dx * dx + q_t_dy * dy + q_t_dz * dz);
+        pot_s_dx -= q_t * d1term2 * dx + (q_t_dx * dxx + q_t_dy * dxy + q_t_dz * dxz);
+        pot_s_dy -= q_t * d1term2 * dy + (q_t_dx * dxy + q_t_dy * dyy + q_t_dz * dyz);
+        pot_s_dz -= q_t * d1term2 * dz + (q_t_dx * dxz + q_t_dy * dyz + q_t_dz * dzz);
+    }
+
+    /* The integrals L1 and L2 between an element and an atom, for the solvation energy */
+#ifdef OPENACC_ENABLED
+    #pragma acc routine seq
+#endif
+    inline void energy_terms(double dist, double G0, double G1, double eps,
+                             double& L1, double& L2) const
+    {
+        double kappa_r     = kappa * dist;
+        double exp_kappa_r = exp_neg(kappa_r);
+
+        double Gk = exp_kappa_r * G0;
+        double G2 = G1 * (1.0 + kappa_r) * exp_kappa_r;
+
+        L1 = G1 - eps * G2;
+        L2 = G0 - Gk;
+    }
+};
+
+
+using ScreenedKernel  = Screened<LibmExponential>;
+
+#ifdef OPENACC_ENABLED
+// the table stays on the host; device kernels take exp(-kappa r) from std::exp
+using TabulatedKernel = Screened<LibmExponential>;
+#else
+using TabulatedKernel = Screened<YukawaTable::Lookup>;
+#endif
+
+
+struct UnscreenedKernel
+{
+    UnscreenedKernel(double, double, const YukawaTable&) {}
+
+#ifdef OPENACC_ENABLED
+    #pragma acc routine seq
+#endif
+    inline void boundary_terms(double, double, double, double,
+                               double, double, double,
+                               double& tp2, double& L2, double& L3) const
+    {
+        tp2 = 1.;
+        L2  = 0.;
+        L3  = 0.;
+    }
+
+#ifdef OPENACC_ENABLED
+    #pragma acc routine seq
+#endif
+    inline void far_field(double dx, double dy, double dz, double eps,
+                          double q, double q_dx, double q_dy, double q_dz,
+                          double& pot_comp_, double& pot_comp_dx,
+                          double& pot_comp_dy, double& pot_comp_dz) const
+    {
+        double r2    = dx*dx + dy*dy + dz*dz;
+        double rinv  = 1. / std::sqrt(r2);
+        double r3inv = rinv  * rinv * rinv;
+
+        double d1term1 = -r3inv + r3inv * eps;
+        double d1term2 = -r3inv + r3inv / eps;
+
+        pot_comp_    += d1term1 * (q_dx * dx + q_dy * dy + q_dz * dz);
+
+        pot_comp_dx  += q * (d1term2 * dx);
+        pot_comp_dy  += q *  d1term2 * dy;
+        pot_comp_dz  += q *  d1term2 * dz;
+    }
+
+    inline void far_field_mutual(double dx, double dy, double dz, double eps,
+                                 double q_s, double q_s_dx, double q_s_dy, double q_s_dz,
+                                 double& pot_t_, double& pot_t_dx, double& pot_t_dy, double& pot_t_dz,
+                                 double q_t, double q_t_dx, double q_t_dy, double q_t_dz,
+                                 double& pot_s_, double& pot_s_dx, double& pot_s_dy, double& pot_s_dz) const
+    {
+        double r2    = dx*dx + dy*dy + dz*dz;
+        double rinv  = 1. / std::sqrt(r2);
+        double r3inv = rinv  * rinv * rinv;
+
+        double d1term1 = -r3inv + r3inv * eps;
+        double d1term2 = -r3inv + r3inv / eps;
+
+        pot_t_   += d1term1 * (q_s_dx * dx + q_s_dy * dy + q_s_dz * dz);
+        pot_t_dx += q_s * d1term2 * dx;
+        pot_t_dy += q_s * d1term2 * dy;
+        pot_t_dz += q_s * d1term2 * dz;
+
+        pot_s_   -= d1term1 * (q_t_dx * dx + q_t_dy * dy + q_t_dz * dz);
+        pot_s_dx -= q_t * d1term2 * dx;
+        pot_s_dy -= q_t * d1term2 * dy;
+        pot_s_dz -= q_t * d1term2 * dz;
+    }
+
+#ifdef OPENACC_ENABLED
+    #pragma acc routine seq
+#endif
+    inline void energy_terms(double, double, double G1, double eps,
+                             double& L1, double& L2) const
+    {
+        L1 = G1 - eps * G1;
+        L2 = 0.;
+    }
+};
+
+#endif /* H_TABIPB_KERNEL_POLICY_H */
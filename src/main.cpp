@@ -1,6 +1,7 @@
 #include <iostream>
 #include <iomanip>
 #include <cstdlib>
+#include <memory>
 
 #include "params.h"
 #include "molecule.h"
@@ -11,6 +12,10 @@
 #include "boundary_element.h"
 #include "tabipb_timers.h"
 #include "output.h"
+#include "tuner.h"
+#include "task_graph.h"
+#include "profiler.h"
+#include "perf_counters.h"
 
 
 int main(int argc, char* argv[])
@@ -23,47 +28,112 @@ int main(int argc, char* argv[])
     struct Params params(argv[1]);
     struct Timers timers;
     
+    Profiler::set_tracing(params.output_trace_);
+    
+    // opened before any worker thread starts, so that every thread is counted
+    if (params.output_perf_counters_) PerfCounters::open();
+    
     timers.tabipb.start();
+    timers.boundary_element.first_matvec.start();
     
-    //construct the biomolecule from the provided pqr file
+    //construct the biomolecule from the provided pqr file and any synthetic point charges
     class Molecule molecule(params, timers.molecule);
     
     molecule.copyin_to_device();
-    molecule.compute_coulombic_energy();
-    molecule.build_xyzr_file();
     
-    // build particles from a NanoShaper surface generated by xyzr file
-    // then build a tree on the particles, partitioning them
-    class Particles particles(molecule, params, timers.particles);
-    class Tree tree(particles, params, timers.tree);
+    // the rest of setup runs as stages on a pool of threads, each stage waiting only on
+    // the stages it reads from: the Coulomb energy overlaps building the mesh, and the
+    // source term overlaps the interaction lists and clusters. Device data is moved
+    // from one thread at a time, so OpenACC builds run the stages in order
+    std::unique_ptr<class Particles> particles;
+    std::unique_ptr<class Tree> tree;
+    std::unique_ptr<class InteractionList> interaction_list;
+    std::unique_ptr<class Clusters> clusters;
     
-    particles.copyin_to_device();
-    particles.compute_source_term();
+    TaskGraph setup;
     
-    // build clusters and set interpolation points for the tree constructed above
-    class Clusters clusters(particles, tree, params, timers.clusters);
+    setup.add([&]() {
+        molecule.compute_coulombic_energy();
+        molecule.compute_kirkwood_energy();
+    });
     
-    clusters.copyin_to_device();
-    clusters.compute_all_interp_pts();
+    // build particles from a NanoShaper surface generated by xyzr file, from synthetic spheres,
+    // or from the mesh cache
+    std::size_t build_particles = setup.add([&]() {
+        particles.reset(new Particles(molecule, params, timers.particles));
+    });
+    
+    // tuning mode builds trees of its own on the particles
+    if (params.tune_file_.empty()) {
+        
+        // build a tree on the particles, partitioning and reordering them
+        std::size_t build_tree = setup.add([&]() {
+            tree.reset(new Tree(*particles, params, timers.tree));
+        });
+        setup.depend(build_tree, build_particles);
+        
+        // nothing after the tree moves the particles, so the source term on them is
+        // independent of the stages that build on the tree
+        std::size_t source_term = setup.add([&]() {
+            particles->copyin_to_device();
+            particles->compute_source_term();
+        });
+        setup.depend(source_term, build_tree);
+        
+        // build interaction lists from the tree constructed above
+        std::size_t build_interaction_list = setup.add([&]() {
+            interaction_list.reset(new InteractionList(*tree, params, timers.interaction_list));
+        });
+        setup.depend(build_interaction_list, build_tree);
+        
+        // build clusters and set interpolation points for the tree constructed above,
+        // with degrees fitted to the interaction lists if adaptive degrees are on
+        std::size_t build_clusters = setup.add([&]() {
+            clusters.reset(new Clusters(*particles, *tree, *interaction_list, params, timers.clusters));
+            clusters->copyin_to_device();
+            clusters->compute_all_interp_pts();
+        });
+        setup.depend(build_clusters, build_interaction_list);
+    }
     
-    // build interaction lists from the tree constructed above
-    class InteractionList interaction_list(tree, params, timers.interaction_list);
+#ifdef OPENACC_ENABLED
+    setup.run_on_threads(1);
+#else
+    setup.run_on_threads(params.setup_threads_);
+#endif
+    
+    // in tuning mode, search for the fastest tree parameters meeting tune_tol,
+    // write them to a params file, and stop
+    if (!params.tune_file_.empty()) {
+        class Tuner tuner(*particles, molecule, params, timers.tuner);
+        tuner.run();
+        tuner.write_params(argv[1]);
+        
+        molecule.delete_from_device();
+        if (params.output_timers_) timers.tuner.print();
+        
+        return 0;
+    }
     
     // initialize the boundary element method and construct the potential output array
-    class BoundaryElement boundary_element(particles, clusters,
-                                   tree, interaction_list, molecule,
+    class BoundaryElement boundary_element(*particles, *clusters,
+                                   *tree, *interaction_list, molecule,
                                    params, timers.boundary_element);
     
     boundary_element.run_GMRES();
+    
+    // measure the treecode matvec error on sampled rows, if direct_sample is set
+    boundary_element.sample_direct_error();
     boundary_element.finalize();
 
     molecule.delete_from_device();
-    particles.delete_from_device();
-    clusters.delete_from_device();
+    particles->delete_from_device();
+    clusters->delete_from_device();
     
     timers.tabipb.stop();
 
     auto energies = Output(boundary_element, timers);
+    FlushOutput();
     
     return 0;
 }
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <direct.h>
+    #include <process.h>
+#else
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <utime.h>
+    #include <sys/mman.h>
+#endif
+
+#include "hash.h"
+#include "particles.h"
+
+/*  Cached meshes are stored one per file, named by a 64-bit FNV-1a hash of
+ *  everything that determines the generated surface: atom coordinates and
+ *  radii, mesh type and generator, mesh density and probe radius. The file is a fixed
+ *  header followed by the raw vertex, normal, area and face arrays. */
+
+static constexpr char          MESH_CACHE_MAGIC[8] = {'T', 'A', 'B', 'I', 'M', 'E', 'S', 'H'};
+static constexpr std::uint32_t MESH_CACHE_VERSION = 1;
+
+struct MeshCacheHeader
+{
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t num_vertices;
+    std::uint64_t num_faces;
+    double        surface_area;
+};
+
+static std::size_t mesh_cache_file_size(std::size_t num_vertices, std::size_t num_faces)
+{
+    return sizeof(MeshCacheHeader) + 7 * num_vertices * sizeof(double)
+                                   + 3 * num_faces    * sizeof(std::uint64_t);
+}
+
+
+static void evict_mesh_cache(const std::string& cache_dir, double max_size_mb)
+{
+#ifndef _WIN32
+    DIR* dir = opendir(cache_dir.c_str());
+    if (dir == nullptr) return;
+
+    struct CacheEntry { std::string path; off_t size; time_t last_used; };
+    std::vector<CacheEntry> entries;
+    double total_size = 0.;
+
+    const std::string suffix = ".tabimesh";
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() <= suffix.size()
+         || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) continue;
+
+        std::string path = cache_dir + "/" + name;
+        struct stat file_stat;
+        if (stat(path.c_str(), &file_stat) != 0) continue;
+
+        entries.push_back(CacheEntry{path, file_stat.st_size, file_stat.st_mtime});
+        total_size += file_stat.st_size;
+    }
+    closedir(dir);
+
+    // hits touch their file, so the oldest modification time is the least recently used
+    std::sort(entries.begin(), entries.end(),
+              [](const CacheEntry& a, const CacheEntry& b) { return a.last_used < b.last_used; });
+
+    double max_size = max_size_mb * 1024. * 1024.;
+    for (const auto& entry : entries) {
+        if (total_size <= max_size) break;
+        if (std::remove(entry.path.c_str()) == 0) total_size -= entry.size;
+    }
+#endif
+}
+
+
+std::string Particles::mesh_cache_path() const
+{
+    // synthetic spheres are cheaper to triangulate than to read back
+    if (params_.mesh_cache_dir_.empty()
+     || params_.mesh_generator_ == Params::MeshGenerator::SPHERE) return std::string();
+
+    FNV1a hash;
+
+    std::size_t num_atoms = molecule_.num_atoms();
+    hash.add(&num_atoms, sizeof(num_atoms));
+    hash.add(molecule_.coords_ptr(), 3 * num_atoms * sizeof(double));
+    hash.add(molecule_.radius_ptr(),     num_atoms * sizeof(double));
+
+    int mesh = static_cast<int>(params_.mesh_);
+    int mesh_generator = static_cast<int>(params_.mesh_generator_);
+    hash.add(&mesh,                      sizeof(mesh));
+    hash.add(&mesh_generator,            sizeof(mesh_generator));
+    hash.add(&params_.mesh_density_,      sizeof(params_.mesh_density_));
+    hash.add(&params_.mesh_probe_radius_, sizeof(params_.mesh_probe_radius_));
+
+    std::ostringstream path;
+    path << params_.mesh_cache_dir_ << "/" << std::hex << std::setw(16) << std::setfill('0')
+         << hash.value() << ".tabimesh";
+
+    return path.str();
+}
+
+
+bool Particles::read_mesh_cache(const std::string& path)
+{
+    timers_.mesh_cache.start();
+
+    std::vector<char> buffer;
+    const char* data = nullptr;
+    std::size_t data_size = 0;
+
+#ifdef _WIN32
+    std::ifstream cache_file(path, std::ios::binary | std::ios::ate);
+    if (!cache_file.good()) {
+        timers_.mesh_cache.stop();
+        return false;
+    }
+
+    data_size = cache_file.tellg();
+    buffer.resize(data_size);
+    cache_file.seekg(0);
+    cache_file.read(buffer.data(), data_size);
+    data = buffer.data();
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        timers_.mesh_cache.stop();
+        return false;
+    }
+
+    struct stat file_stat;
+    void* mapped = MAP_FAILED;
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+        data_size = file_stat.st_size;
+        mapped = mmap(nullptr, data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (mapped == MAP_FAILED) {
+        timers_.mesh_cache.stop();
+        return false;
+    }
+    data = static_cast<const char*>(mapped);
+#endif
+
+    MeshCacheHeader header;
+    bool valid = data_size >= sizeof(header);
+
+    if (valid) {
+        std::memcpy(&header, data, sizeof(header));
+        valid = std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0
+             && header.version == MESH_CACHE_VERSION
+             && data_size == mesh_cache_file_size(header.num_vertices, header.num_faces);
+    }
+
+    if (valid) {
+        num_       = header.num_vertices;
+        num_faces_ = header.num_faces;
+        surface_area_ = header.surface_area;
+
+        auto vertex_data = reinterpret_cast<const double*>(data + sizeof(header));
+        x_   .assign(vertex_data + 0 * num_, vertex_data + 1 * num_);
+        y_   .assign(vertex_data + 1 * num_, vertex_data + 2 * num_);
+        z_   .assign(vertex_data + 2 * num_, vertex_data + 3 * num_);
+        nx_  .assign(vertex_data + 3 * num_, vertex_data + 4 * num_);
+        ny_  .assign(vertex_data + 4 * num_, vertex_data + 5 * num_);
+        nz_  .assign(vertex_data + 5 * num_, vertex_data + 6 * num_);
+        area_.assign(vertex_data + 6 * num_, vertex_data + 7 * num_);
+
+        auto face_data = reinterpret_cast<const std::uint64_t*>(vertex_data + 7 * num_);
+        face_x_.assign(face_data + 0 * num_faces_, face_data + 1 * num_faces_);
+        face_y_.assign(face_data + 1 * num_faces_, face_data + 2 * num_faces_);
+        face_z_.assign(face_data + 2 * num_faces_, face_data + 3 * num_faces_);
+    }
+
+#ifndef _WIN32
+    munmap(const_cast<char*>(data), data_size);
+
+    // mark the entry as recently used for eviction
+    if (valid) utime(path.c_str(), nullptr);
+#endif
+
+    if (valid) std::cout << "Read surface mesh from cache " << path << "." << std::endl;
+    else       std::cout << "Ignoring invalid mesh cache file " << path << "." << std::endl;
+
+    timers_.mesh_cache.stop();
+
+    return valid;
+}
+
+
+void Particles::write_mesh_cache(const std::string& path) const
+{
+    timers_.mesh_cache.start();
+
+#ifdef _WIN32
+    _mkdir(params_.mesh_cache_dir_.c_str());
+#else
+    mkdir(params_.mesh_cache_dir_.c_str(), 0755);
+#endif
+
+    MeshCacheHeader header;
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+    header.version      = MESH_CACHE_VERSION;
+    header.reserved     = 0;
+    header.num_vertices = num_;
+    header.num_faces    = num_faces_;
+    header.surface_area = surface_area_;
+
+    std::vector<std::uint64_t> faces;
+    faces.reserve(3 * num_faces_);
+    faces.insert(faces.end(), face_x_.begin(), face_x_.end());
+    faces.insert(faces.end(), face_y_.begin(), face_y_.end());
+    faces.insert(faces.end(), face_z_.begin(), face_z_.end());
+
+    // write to a temporary of this process and rename, so concurrent runs meshing the
+    // same molecule neither share a file nor ever see a partial one
+#ifdef _WIN32
+    std::string temp_path = path + "." + std::to_string(_getpid()) + ".tmp";
+#else
+    std::string temp_path = path + "." + std::to_string(getpid()) + ".tmp";
+#endif
+    std::ofstream cache_file(temp_path, std::ios::binary);
+
+    if (!cache_file.good()) {
+        std::cout << "Could not write mesh cache file " << path << "." << std::endl;
+        timers_.mesh_cache.stop();
+        return;
+    }
+
+    std::size_t vertex_bytes = num_ * sizeof(double);
+    cache_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    cache_file.write(reinterpret_cast<const char*>(x_.data()),    vertex_bytes);
+    cache_file.write(reinterpret_cast<const char*>(y_.data()),    vertex_bytes);
+    cache_file.write(reinterpret_cast<const char*>(z_.data()),    vertex_bytes);
+    cache_file.write(reinterpret_cast<const char*>(nx_.data()),   vertex_bytes);
+    cache_file.write(reinterpret_cast<const char*>(ny_.data()),   vertex_bytes);
+    cache_file.write(reinterpret_cast<const char*>(nz_.data()),   vertex_bytes);
+    cache_file.write(reinterpret_cast<const char*>(area_.data()), vertex_bytes);
+    cache_file.write(reinterpret_cast<const char*>(faces.data()), faces.size() * sizeof(std::uint64_t));
+    cache_file.close();
+
+    if (!cache_file.good() || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        std::cout << "Could not write mesh cache file " << path << "." << std::endl;
+    }
+
+    evict_mesh_cache(params_.mesh_cache_dir_, params_.mesh_cache_size_);
+
+    timers_.mesh_cache.stop();
+}
@@ -5,12 +5,17 @@
 #include <sstream>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <utility>
 
 #include "params.h"
 #include "molecule.h"
 
+static constexpr int    KIRKWOOD_MAX_TERMS = 400;
+static constexpr double KIRKWOOD_TOL       = 1e-14;
+
 
 Molecule::Molecule(struct Params& params, struct Timers_Molecule& timers)
     : params_(params), timers_(timers)
@@ -33,12 +38,30 @@ Molecule::Molecule(struct Params& params, struct Timers_Molecule& timers)
         }
     }
     
+    // point charges for the synthetic sphere geometry, with no radius of their own
+    for (std::size_t i = 0; i < params.sphere_charges_.size() / 4; ++i) {
+        coords_.insert(coords_.end(), &params.sphere_charges_[4*i], &params.sphere_charges_[4*i + 3]);
+        charge_.push_back(params.sphere_charges_[4*i + 3]);
+        radius_.push_back(0.);
+    }
+    
     num_atoms_ = radius_.size();
+    kirkwood_energy_ = std::nan("");
 
     timers_.ctor.stop();
 }
 
 
+Molecule::Molecule(std::vector<double> coords, std::vector<double> charge, std::vector<double> radius,
+                   struct Params& params, struct Timers_Molecule& timers)
+    : params_(params), timers_(timers),
+      coords_(std::move(coords)), charge_(std::move(charge)), radius_(std::move(radius))
+{
+    num_atoms_ = radius_.size();
+    kirkwood_energy_ = std::nan("");
+}
+
+
 void Molecule::build_xyzr_file() const
 {
     timers_.build_xyzr_file.start();
@@ -97,6 +120,113 @@ void Molecule::compute_coulombic_energy()
 }
 
 
+/*  Kirkwood's series for the solvation energy of point charges inside a single
+ *  sphere of radius a, with the ion exclusion surface on the dielectric boundary:
+ *
+ *    E = 1/2 sum_ij q_i q_j sum_n B_n (r_i r_j)^n / a^(2n+1) P_n(cos g_ij),
+ *    B_n = (eps_out h_n + eps_in (n+1)) / (eps_in (eps_in n - eps_out h_n)),
+ *
+ *  where h_n = -x + x K_n'(x) / K_n(x) - (n+1) at x = kappa a, K_n is Kirkwood's
+ *  polynomial for the modified spherical Bessel function of the second kind, and
+ *  r_i, g_ij are taken from the sphere center. It is NaN unless the geometry is one
+ *  sphere containing every charge. */
+
+void Molecule::compute_kirkwood_energy()
+{
+    timers_.compute_kirkwood_energy.start();
+
+    kirkwood_energy_ = std::nan("");
+
+    if (params_.mesh_generator_ != Params::MeshGenerator::SPHERE || params_.spheres_.size() != 4) {
+        timers_.compute_kirkwood_energy.stop();
+        return;
+    }
+
+    const double* sphere = params_.spheres_.data();
+    double a = sphere[3];
+    double eps_in  = params_.phys_eps_solute_;
+    double eps_out = params_.phys_eps_solvent_;
+    double x = params_.phys_kappa_ * a;
+
+    std::vector<double> rel_coords(3 * num_atoms_);
+    std::vector<double> rel_radius(num_atoms_);
+
+    for (std::size_t i = 0; i < num_atoms_; ++i) {
+        for (int d = 0; d < 3; ++d) rel_coords[3*i + d] = coords_[3*i + d] - sphere[d];
+        rel_radius[i] = std::sqrt(rel_coords[3*i] * rel_coords[3*i]
+                                + rel_coords[3*i + 1] * rel_coords[3*i + 1]
+                                + rel_coords[3*i + 2] * rel_coords[3*i + 2]);
+
+        if (rel_radius[i] >= a) {
+            std::cout << "Charge " << i << " is not inside the sphere, "
+                      << "skipping the Kirkwood energy." << std::endl;
+            timers_.compute_kirkwood_energy.stop();
+            return;
+        }
+    }
+
+    // B_n for every term, stopping where (r_max / a)^(2n) no longer matters
+    double r_max = *std::max_element(rel_radius.begin(), rel_radius.end());
+    double ratio2 = (r_max / a) * (r_max / a);
+    std::vector<double> coeffs;
+    double decay = 1.;
+
+    for (int n = 0; n < KIRKWOOD_MAX_TERMS && decay > KIRKWOOD_TOL; ++n, decay *= ratio2) {
+
+        // K_n(x) = sum_s c_s x^s, with c_0 = 1 and c_(s+1) / c_s = 2 (n - s) / ((s + 1) (2n - s))
+        double c = 1., x_s = 1., K = 0., dK = 0.;
+        for (int s = 0; s <= n; ++s) {
+            K += c * x_s;
+            if (s < n) {
+                double c_next = c * 2. * (n - s) / ((s + 1.) * (2. * n - s));
+                dK += (s + 1.) * c_next * x_s;
+                c = c_next;
+            }
+            x_s *= x;
+        }
+
+        double h = -x + x * dK / K - (n + 1.);
+        coeffs.push_back((eps_out * h + eps_in * (n + 1.)) / (eps_in * (eps_in * n - eps_out * h)));
+    }
+
+    double kirkwood_energy = 0.;
+
+    for (std::size_t i = 0; i < num_atoms_; ++i) {
+        for (std::size_t j = 0; j < num_atoms_; ++j) {
+
+            double rr = rel_radius[i] * rel_radius[j];
+            double cos_g = 1.;
+            if (rr > 0.) {
+                cos_g = (rel_coords[3*i]     * rel_coords[3*j]
+                       + rel_coords[3*i + 1] * rel_coords[3*j + 1]
+                       + rel_coords[3*i + 2] * rel_coords[3*j + 2]) / rr;
+                cos_g = std::max(-1., std::min(1., cos_g));
+            }
+
+            // Legendre polynomials by the three-term recurrence
+            double P_prev = 1., P = cos_g;
+            double scale = 1. / a;
+            double sum = coeffs[0] * scale;
+
+            for (std::size_t n = 1; n < coeffs.size(); ++n) {
+                scale *= rr / (a * a);
+                sum += coeffs[n] * scale * P;
+
+                double P_next = ((2. * n + 1.) * cos_g * P - n * P_prev) / (n + 1.);
+                P_prev = P;
+                P = P_next;
+            }
+
+            kirkwood_energy += 0.5 * charge_[i] * charge_[j] * sum;
+        }
+    }
+
+    kirkwood_energy_ = kirkwood_energy;
+
+    timers_.compute_kirkwood_energy.stop();
+}
+
+
 void Molecule::copyin_to_device() const
 {
     timers_.copyin_to_device.start();
@@ -140,6 +270,8 @@ void Timers_Molecule::print() const
     std::cout << std::setw(12) << std::right << ctor.elapsed_time() << std::endl;
     std::cout << "|   |...compute_coulombic_energy...: ";
     std::cout << std::setw(12) << std::right << compute_coulombic_energy.elapsed_time() << std::endl;
+    std::cout << "|   |...compute_kirkwood_energy....: ";
+    std::cout << std::setw(12) << std::right << compute_kirkwood_energy.elapsed_time() << std::endl;
     std::cout << "|   |...build_xyzr_file............: ";
     std::cout << std::setw(12) << std::right << build_xyzr_file.elapsed_time() << std::endl;
 #ifdef OPENACC_ENABLED
@@ -157,6 +289,7 @@ std::string Timers_Molecule::get_durations() const
     std::string durations;
     durations.append(std::to_string(ctor                     .elapsed_time())).append(", ");
     durations.append(std::to_string(compute_coulombic_energy .elapsed_time())).append(", ");
+    durations.append(std::to_string(compute_kirkwood_energy  .elapsed_time())).append(", ");
     durations.append(std::to_string(build_xyzr_file          .elapsed_time())).append(", ");
     durations.append(std::to_string(copyin_to_device         .elapsed_time())).append(", ");
     durations.append(std::to_string(delete_from_device       .elapsed_time())).append(", ");
@@ -170,6 +303,7 @@ std::string Timers_Molecule::get_headers() const
     std::string headers;
     headers.append("Molecule ctor, ");
     headers.append("Molecule compute_coulombic_energy, ");
+    headers.append("Molecule compute_kirkwood_energy, ");
     headers.append("Molecule build_xyzr_file, ");
     headers.append("Molecule copyin_to_device, ");
     headers.append("Molecule delete_from_device, ");
@@ -27,9 +27,12 @@ private:
     std::vector<double> radius_;
 
     double coulombic_energy_;
+    double kirkwood_energy_;
 
 public:
     Molecule(struct Params&, struct Timers_Molecule&);
+    Molecule(std::vector<double> coords, std::vector<double> charge, std::vector<double> radius,
+             struct Params&, struct Timers_Molecule&);
     ~Molecule() = default;
     
 #ifdef TABIPB_APBS
@@ -40,11 +43,13 @@ public:
     
     std::size_t num_atoms() const { return num_atoms_; };
     double coulombic_energy() const { return coulombic_energy_; };
+    double kirkwood_energy() const { return kirkwood_energy_; };
     const double* coords_ptr() const { return coords_.data(); };
     const double* charge_ptr() const { return charge_.data(); };
     const double* radius_ptr() const { return radius_.data(); };
     
     void compute_coulombic_energy();
+    void compute_kirkwood_energy();
     void copyin_to_device() const;
     void delete_from_device() const;
 };
@@ -54,6 +59,7 @@ struct Timers_Molecule
 {
     Timer ctor;
     Timer compute_coulombic_energy;
+    Timer compute_kirkwood_energy;
     Timer build_xyzr_file;
     Timer copyin_to_device;
     Timer delete_from_device;
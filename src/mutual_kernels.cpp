@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+#include "constants.h"
+#include "profiler.h"
+#include "kernel_policy.h"
+#include "boundary_element.h"
+#include "clusters.h"
+
+/*  The near-field and cluster-cluster kernels over the unordered node pairs of the
+ *  mutual interaction lists. Each pair of points is evaluated once and its terms
+ *  are added to both sides: G0 and Gk are symmetric, so L2 and L3 are the same
+ *  either way, while exchanging target and source turns L1 and L4 into
+ *  -target_cos and -source_cos times the same factors. In the far field, the
+ *  expansion of one side's charges at the other only changes sign in its odd
+ *  terms. The second side is summed into a buffer and added once per call, so
+ *  the kernels run under the same OpenMP loop over first nodes as the others.
+ *
+ *  Host only; OpenACC builds never build the mutual lists. */
+
+static constexpr char PROFILE_PP[] = "run_GMRES/iteration/matrix_vector/interact/PP";
+static constexpr char PROFILE_CC[] = "run_GMRES/iteration/matrix_vector/interact/CC";
+
+
+// the second side's buffer, one per thread and only ever grown, so that the kernels
+// allocate once per thread rather than once per pair; a call zeroes what it uses
+static double* mutual_buffer(std::size_t num)
+{
+    static thread_local std::vector<double> buffer;
+
+    if (buffer.size() < num) buffer.resize(num);
+    std::fill(buffer.begin(), buffer.begin() + num, 0.);
+
+    return buffer.data();
+}
+
+
+void BoundaryElement::particle_particle_interact_mutual(      double* __restrict potential,
+                                                 const double* __restrict potential_old,
+                                                 std::array<std::size_t, 2> node_particle_idxs_a,
+                                                 std::array<std::size_t, 2> node_particle_idxs_b)
+{
+    PROFILE_SCOPE(PROFILE_PP);
+
+    switch (kernel_policy_) {
+        case UNSCREENED:
+            BoundaryElement::particle_particle_interact_mutual_generic<UnscreenedKernel>(potential, potential_old,
+                    node_particle_idxs_a, node_particle_idxs_b);
+            break;
+        case SCREENED:
+            BoundaryElement::particle_particle_interact_mutual_generic<ScreenedKernel>(potential, potential_old,
+                    node_particle_idxs_a, node_particle_idxs_b);
+            break;
+        case TABULATED:
+            BoundaryElement::particle_particle_interact_mutual_generic<TabulatedKernel>(potential, potential_old,
+                    node_particle_idxs_a, node_particle_idxs_b);
+            break;
+    }
+}
+
+
+template <class Kernel>
+void BoundaryElement::particle_particle_interact_mutual_generic(      double* __restrict potential,
+                                                         const double* __restrict potential_old,
+                                                         std::array<std::size_t, 2> node_particle_idxs_a,
+                                                         std::array<std::size_t, 2> node_particle_idxs_b)
+{
+    std::size_t target_node_particle_begin = node_particle_idxs_a[0];
+    std::size_t target_node_particle_end   = node_particle_idxs_a[1];
+
+    std::size_t source_node_particle_begin = node_particle_idxs_b[0];
+    std::size_t source_node_particle_end   = node_particle_idxs_b[1];
+    std::size_t num_sources = source_node_particle_end - source_node_particle_begin;
+
+    double eps    = params_.phys_eps_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table_);
+
+    const double* __restrict particles_x_ptr    = particles_.x_ptr();
+    const double* __restrict particles_y_ptr    = particles_.y_ptr();
+    const double* __restrict particles_z_ptr    = particles_.z_ptr();
+
+    const double* __restrict particles_nx_ptr   = particles_.nx_ptr();
+    const double* __restrict particles_ny_ptr   = particles_.ny_ptr();
+    const double* __restrict particles_nz_ptr   = particles_.nz_ptr();
+
+    const double* __restrict particles_area_ptr = particles_.area_ptr();
+
+    std::size_t num_particles = particles_.num();
+
+    // the potentials of the second node, as targets of the first
+    double* source_pot = mutual_buffer(2 * num_sources);
+    double* __restrict source_pot_1 = source_pot;
+    double* __restrict source_pot_2 = source_pot + num_sources;
+
+    for (std::size_t j = target_node_particle_begin; j < target_node_particle_end; ++j) {
+
+        double target_x = particles_x_ptr[j];
+        double target_y = particles_y_ptr[j];
+        double target_z = particles_z_ptr[j];
+
+        double target_nx = particles_nx_ptr[j];
+        double target_ny = particles_ny_ptr[j];
+        double target_nz = particles_nz_ptr[j];
+        double target_area = particles_area_ptr[j];
+
+        double target_potential_old_0 = potential_old[j];
+        double target_potential_old_1 = potential_old[j + num_particles];
+
+        double pot_temp_1 = 0.;
+        double pot_temp_2 = 0.;
+
+        for (std::size_t k = source_node_particle_begin; k < source_node_particle_end; ++k) {
+
+            double source_x = particles_x_ptr[k];
+            double source_y = particles_y_ptr[k];
+            double source_z = particles_z_ptr[k];
+
+            double source_nx = particles_nx_ptr[k];
+            double source_ny = particles_ny_ptr[k];
+            double source_nz = particles_nz_ptr[k];
+            double source_area = particles_area_ptr[k];
+
+            double potential_old_0 = potential_old[k];
+            double potential_old_1 = potential_old[k + num_particles];
+
+            double dist_x = source_x - target_x;
+            double dist_y = source_y - target_y;
+            double dist_z = source_z - target_z;
+            double r = std::sqrt(dist_x * dist_x + dist_y * dist_y + dist_z * dist_z);
+
+            if (r > 0) {
+                double one_over_r = 1. / r;
+                double G0 = constants::ONE_OVER_4PI * one_over_r;
+
+                double source_cos  = (source_nx * dist_x + source_ny * dist_y + source_nz * dist_z) * one_over_r;
+                double target_cos = (target_nx * dist_x + target_ny * dist_y + target_nz * dist_z) * one_over_r;
+
+                double tp1 = G0 * one_over_r;
+                double dot_tqsq = source_nx * target_nx + source_ny * target_ny + source_nz * target_nz;
+
+                double tp2, L2, L3;
+                kernel.boundary_terms(r, one_over_r, G0, tp1, source_cos, target_cos, dot_tqsq,
+                                      tp2, L2, L3);
+
+                double L1_factor = tp1 * (1. - tp2 * eps);
+                double L4_factor = tp1 * (1. - tp2 / eps);
+
+                pot_temp_1 += ( source_cos * L1_factor * potential_old_0 + L2 * potential_old_1) * source_area;
+                pot_temp_2 += ( L3 * potential_old_0 + target_cos * L4_factor * potential_old_1) * source_area;
+
+                source_pot_1[k - source_node_particle_begin]
+                    += (-target_cos * L1_factor * target_potential_old_0 + L2 * target_potential_old_1) * target_area;
+                source_pot_2[k - source_node_particle_begin]
+                    += ( L3 * target_potential_old_0 - source_cos * L4_factor * target_potential_old_1) * target_area;
+            }
+        }
+
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        potential[j]                 += pot_temp_1;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        potential[j + num_particles] += pot_temp_2;
+    }
+
+    for (std::size_t k = 0; k < num_sources; ++k) {
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        potential[source_node_particle_begin + k]                 += source_pot_1[k];
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        potential[source_node_particle_begin + k + num_particles] += source_pot_2[k];
+    }
+}
+
+
+void BoundaryElement::cluster_cluster_interact_mutual(double* __restrict potential,
+                                               std::size_t node_idx_a,
+                                               std::size_t node_idx_b)
+{
+    PROFILE_SCOPE(PROFILE_CC);
+
+    switch (kernel_policy_) {
+        case UNSCREENED:
+            BoundaryElement::cluster_cluster_interact_mutual_generic<UnscreenedKernel>(potential,
+                    node_idx_a, node_idx_b);
+            break;
+        case SCREENED:
+            BoundaryElement::cluster_cluster_interact_mutual_generic<ScreenedKernel>(potential,
+                    node_idx_a, node_idx_b);
+            break;
+        case TABULATED:
+            BoundaryElement::cluster_cluster_interact_mutual_generic<TabulatedKernel>(potential,
+                    node_idx_a, node_idx_b);
+            break;
+    }
+}
+
+
+template <class Kernel>
+void BoundaryElement::cluster_cluster_interact_mutual_generic(double* __restrict,
+                                                       std::size_t node_idx_a,
+                                                       std::size_t node_idx_b)
+{
+    int num_target_interp_pts = clusters_.num_interp_pts_per_node(node_idx_a);
+    int num_source_interp_pts = clusters_.num_interp_pts_per_node(node_idx_b);
+    std::size_t num_source_charges = (std::size_t)num_source_interp_pts * num_source_interp_pts
+                                                                        * num_source_interp_pts;
+
+    std::size_t target_cluster_interp_pts_begin = clusters_.cluster_interp_pts_idxs(node_idx_a)[0];
+    std::size_t target_cluster_charges_begin    = clusters_.cluster_charges_idxs(node_idx_a)[0];
+    std::size_t target_cluster_potentials_begin = clusters_.cluster_potentials_idxs(node_idx_a)[0];
+
+    std::size_t source_cluster_interp_pts_begin = clusters_.cluster_interp_pts_idxs(node_idx_b)[0];
+    std::size_t source_cluster_charges_begin    = clusters_.cluster_charges_idxs(node_idx_b)[0];
+    std::size_t source_cluster_potentials_begin = clusters_.cluster_potentials_idxs(node_idx_b)[0];
+
+    double eps    = params_.phys_eps_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table_);
+
+    const double* __restrict clusters_x_ptr    = clusters_.interp_x_ptr();
+    const double* __restrict clusters_y_ptr    = clusters_.interp_y_ptr();
+    const double* __restrict clusters_z_ptr    = clusters_.interp_z_ptr();
+
+    double* __restrict clusters_p_ptr          = clusters_.interp_potential_ptr();
+    double* __restrict clusters_p_dx_ptr       = clusters_.interp_potential_dx_ptr();
+    double* __restrict clusters_p_dy_ptr       = clusters_.interp_potential_dy_ptr();
+    double* __restrict clusters_p_dz_ptr       = clusters_.interp_potential_dz_ptr();
+
+    const double* __restrict clusters_q_ptr    = clusters_.interp_charge_ptr();
+    const double* __restrict clusters_q_dx_ptr = clusters_.interp_charge_dx_ptr();
+    const double* __restrict clusters_q_dy_ptr = clusters_.interp_charge_dy_ptr();
+    const double* __restrict clusters_q_dz_ptr = clusters_.interp_charge_dz_ptr();
+
+    // the four potentials of the second cluster, as targets of the first
+    double* source_pot = mutual_buffer(4 * num_source_charges);
+    double* __restrict source_p_ptr    = source_pot;
+    double* __restrict source_p_dx_ptr = source_pot + 1 * num_source_charges;
+    double* __restrict source_p_dy_ptr = source_pot + 2 * num_source_charges;
+    double* __restrict source_p_dz_ptr = source_pot + 3 * num_source_charges;
+
+    for (int j1 = 0; j1 < num_target_interp_pts; j1++) {
+    for (int j2 = 0; j2 < num_target_interp_pts; j2++) {
+    for (int j3 = 0; j3 < num_target_interp_pts; j3++) {
+
+        std::size_t j  = j1 * num_target_interp_pts * num_target_interp_pts
+                       + j2 * num_target_interp_pts + j3;
+        std::size_t jj = target_cluster_potentials_begin + j;
+
+        double target_x = clusters_x_ptr[target_cluster_interp_pts_begin + j1];
+        double target_y = clusters_y_ptr[target_cluster_interp_pts_begin + j2];
+        double target_z = clusters_z_ptr[target_cluster_interp_pts_begin + j3];
+
+        double target_q    = clusters_q_ptr   [target_cluster_charges_begin + j];
+        double target_q_dx = clusters_q_dx_ptr[target_cluster_charges_begin + j];
+        double target_q_dy = clusters_q_dy_ptr[target_cluster_charges_begin + j];
+        double target_q_dz = clusters_q_dz_ptr[target_cluster_charges_begin + j];
+
+        double pot_comp_   = 0.;
+        double pot_comp_dx = 0.;
+        double pot_comp_dy = 0.;
+        double pot_comp_dz = 0.;
+
+        for (int k1 = 0; k1 < num_source_interp_pts; k1++) {
+        for (int k2 = 0; k2 < num_source_interp_pts; k2++) {
+        for (int k3 = 0; k3 < num_source_interp_pts; k3++) {
+
+            std::size_t k  = k1 * num_source_interp_pts * num_source_interp_pts
+                           + k2 * num_source_interp_pts + k3;
+            std::size_t kk = source_cluster_charges_begin + k;
+
+            double dx = target_x - clusters_x_ptr[source_cluster_interp_pts_begin + k1];
+            double dy = target_y - clusters_y_ptr[source_cluster_interp_pts_begin + k2];
+            double dz = target_z - clusters_z_ptr[source_cluster_interp_pts_begin + k3];
+
+            kernel.far_field_mutual(dx, dy, dz, eps,
+                    clusters_q_ptr[kk], clusters_q_dx_ptr[kk], clusters_q_dy_ptr[kk], clusters_q_dz_ptr[kk],
+                    pot_comp_, pot_comp_dx, pot_comp_dy, pot_comp_dz,
+                    target_q, target_q_dx, target_q_dy, target_q_dz,
+                    source_p_ptr[k], source_p_dx_ptr[k], source_p_dy_ptr[k], source_p_dz_ptr[k]);
+        }
+        }
+        }
+
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_ptr   [jj] += pot_comp_;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dx_ptr[jj] += pot_comp_dx;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dy_ptr[jj] += pot_comp_dy;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dz_ptr[jj] += pot_comp_dz;
+    }
+    }
+    }
+
+    for (std::size_t k = 0; k < num_source_charges; ++k) {
+        std::size_t kk = source_cluster_potentials_begin + k;
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_ptr   [kk] += source_p_ptr   [k];
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dx_ptr[kk] += source_p_dx_ptr[k];
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dy_ptr[kk] += source_p_dy_ptr[k];
+#ifdef OPENMP_ENABLED
+        #pragma omp atomic update
+#endif
+        clusters_p_dz_ptr[kk] += source_p_dz_ptr[k];
+    }
+}
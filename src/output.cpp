@@ -1,10 +1,93 @@
 #include <iostream>
 #include <iomanip>
+#include <iterator>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <deque>
 #include <array>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cmath>
+#include <cstdint>
 
+#include "constants.h"
+#include "profiler.h"
 #include "boundary_element.h"
 #include "tabipb_timers.h"
+#include "output.h"
+
+/*  Everything the file writers need, copied out of the solver so that the caller
+ *  can go on to the next run, and free or reuse its arrays, while the files are
+ *  still being written. */
+
+struct OutputSnapshot
+{
+    std::string csv_headers;
+    std::string csv_line;
+
+    bool vtk = false;
+    bool vtp = false;
+    bool vtp_float32 = false;
+
+    std::size_t num = 0;
+    std::size_t num_faces = 0;
+
+    std::vector<double> x, y, z;
+    std::vector<double> nx, ny, nz;
+    std::vector<std::size_t> face_x, face_y, face_z;
+    std::vector<double> potential;
+};
+
+
+struct Timers_Output
+{
+    Timer write;
+    Timer flush;
+
+    void print() const;
+};
+
+
+class OutputWriter
+{
+private:
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable job_ready_;
+    std::condition_variable jobs_done_;
+
+    std::deque<std::shared_ptr<const OutputSnapshot>> jobs_;
+    bool busy_ = false;
+    bool stop_ = false;
+    bool print_timers_ = false;
+
+    Timers_Output timers_;
+
+    void run();
+
+public:
+    void submit(std::shared_ptr<const OutputSnapshot> job, bool print_timers);
+    void flush();
+
+    OutputWriter() = default;
+    ~OutputWriter();
+};
+
+
+static void write_files(const OutputSnapshot& output);
+static void write_VTK(const OutputSnapshot& output);
+static void write_VTP(const OutputSnapshot& output);
+
+template <typename T, typename Function>
+static void write_VTP_block(std::ofstream& file, std::size_t num_values, Function&& value);
+
+// the writer thread starts with the first submitted job; destruction at exit writes out anything still queued
+static OutputWriter output_writer;
+
 
 std::array<double, 3> Output(const BoundaryElement& bem, const Timers& timers)
 {
@@ -14,6 +97,21 @@ std::array<double, 3> Output(const BoundaryElement& bem, const Timers& timers)
                                                << " kJ/mol";
     std::cout << "\n         Free energy = "   << bem.free_energy_
                                                << " kJ/mol";
+
+    // the analytic reference is only there for a single synthetic sphere
+    if (!std::isnan(bem.molecule_.kirkwood_energy())) {
+        double kirkwood_energy = constants::UNITS_COEFF * bem.molecule_.kirkwood_energy();
+        std::cout << "\n     Kirkwood energy = " << kirkwood_energy << " kJ/mol";
+        std::cout << "\n      Relative error = " << std::scientific << std::setprecision(6)
+                  << std::abs(bem.solvation_energy_ - kirkwood_energy) / std::abs(kirkwood_energy)
+                  << std::fixed;
+    }
+
+    if (!std::isnan(bem.direct_sample_error_)) {
+        std::cout << "\n\nTreecode matvec error on " << bem.params_.direct_sample_ << " sampled rows = "
+                  << std::scientific << std::setprecision(6) << bem.direct_sample_error_ << std::fixed;
+    }
+
     std::cout << "\n\nThe max and min potential and normal derivatives on vertices:";
     std::cout << "\n        Potential min: " << bem.pot_min_ << ", "
                                      "max: " << bem.pot_max_;
@@ -21,9 +119,11 @@ std::array<double, 3> Output(const BoundaryElement& bem, const Timers& timers)
                                      "max: " << bem.pot_normal_max_ << "\n" << std::endl << std::endl;
 
     if (bem.params_.output_timers_) timers.print();
+    if (bem.params_.output_trace_) Profiler::write_trace("tabipb_trace.json");
+
+    auto output = std::make_shared<OutputSnapshot>();
 
     if (bem.params_.output_csv_headers_) {
-        std::ofstream csv_headers("headers.csv");
         std::string headers;
         headers.append("num_atoms, ")            .append("mesh, ")
                .append("mesh_density, ")         .append("mesh_probe_radius, ")
@@ -36,13 +136,12 @@ std::array<double, 3> Output(const BoundaryElement& bem, const Timers& timers)
                .append("potential_min, ")        .append("potential_max, ")
                .append("potential_normal_min, ") .append("potential_normal_max, ")
                .append(timers.get_headers());
-        csv_headers << headers << std::endl;
-        csv_headers.close();
+        output->csv_headers = headers;
     }
 
     if (bem.params_.output_csv_) {
-        std::ofstream csv_file("output.csv");
-        csv_file << std::scientific << std::setprecision(12)
+        std::ostringstream csv_line;
+        csv_line << std::scientific << std::setprecision(12)
                  << bem.molecule_.num_atoms()      << ", " << bem.params_.mesh_              << ", "
                  << bem.params_.mesh_density_      << ", " << bem.params_.mesh_probe_radius_ << ", "
                  << bem.params_.tree_degree_       << ", " << bem.params_.tree_theta_        << ", "
@@ -53,11 +152,296 @@ std::array<double, 3> Output(const BoundaryElement& bem, const Timers& timers)
                  << bem.free_energy_               << ", "
                  << bem.pot_min_                   << ", " << bem.pot_max_                   << ", "
                  << bem.pot_normal_min_            << ", " << bem.pot_normal_max_            << ", "
-                 << timers.get_durations()         << std::endl;
-        csv_file.close();
+                 << timers.get_durations();
+        output->csv_line = csv_line.str();
     }
 
-    if (bem.params_.output_vtk_) bem.particles_.output_VTK(bem.potential_);
+    output->vtk = bem.params_.output_vtk_;
+    output->vtp = bem.params_.output_vtp_;
+    output->vtp_float32 = bem.params_.output_vtp_float32_;
+
+    if (output->vtk || output->vtp) {
+        const Particles& particles = bem.particles_;
+        std::size_t num = particles.num();
+        std::size_t num_faces = particles.num_faces();
+
+        output->num = num;
+        output->num_faces = num_faces;
+
+        output->x .assign(particles.x_ptr(),  particles.x_ptr()  + num);
+        output->y .assign(particles.y_ptr(),  particles.y_ptr()  + num);
+        output->z .assign(particles.z_ptr(),  particles.z_ptr()  + num);
+        output->nx.assign(particles.nx_ptr(), particles.nx_ptr() + num);
+        output->ny.assign(particles.ny_ptr(), particles.ny_ptr() + num);
+        output->nz.assign(particles.nz_ptr(), particles.nz_ptr() + num);
+
+        output->face_x.assign(particles.face_x_ptr(), particles.face_x_ptr() + num_faces);
+        output->face_y.assign(particles.face_y_ptr(), particles.face_y_ptr() + num_faces);
+        output->face_z.assign(particles.face_z_ptr(), particles.face_z_ptr() + num_faces);
+
+        output->potential = bem.potential_;
+    }
+
+    if (!output->csv_headers.empty() || !output->csv_line.empty() || output->vtk || output->vtp)
+        output_writer.submit(output, bem.params_.output_timers_);
 
     return std::array<double, 3> {bem.solvation_energy_, bem.coulombic_energy_, bem.free_energy_};
 }
+
+
+void FlushOutput()
+{
+    output_writer.flush();
+}
+
+
+void OutputWriter::submit(std::shared_ptr<const OutputSnapshot> job, bool print_timers)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!thread_.joinable()) thread_ = std::thread(&OutputWriter::run, this);
+
+    jobs_.push_back(std::move(job));
+    print_timers_ = print_timers_ || print_timers;
+    job_ready_.notify_one();
+}
+
+
+void OutputWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!thread_.joinable()) return;
+
+    // only the time spent waiting here is exposed, the rest overlapped the caller's work
+    timers_.flush.start();
+    jobs_done_.wait(lock, [this] { return jobs_.empty() && !busy_; });
+    timers_.flush.stop();
+
+    if (print_timers_) timers_.print();
+    print_timers_ = false;
+}
+
+
+void OutputWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        job_ready_.wait(lock, [this] { return !jobs_.empty() || stop_; });
+        if (jobs_.empty()) break;
+
+        auto job = std::move(jobs_.front());
+        jobs_.pop_front();
+        busy_ = true;
+
+        lock.unlock();
+        timers_.write.start();
+        write_files(*job);
+        timers_.write.stop();
+        job.reset();
+        lock.lock();
+
+        busy_ = false;
+        if (jobs_.empty()) jobs_done_.notify_all();
+    }
+}
+
+
+OutputWriter::~OutputWriter()
+{
+    flush();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        job_ready_.notify_one();
+    }
+
+    if (thread_.joinable()) thread_.join();
+}
+
+
+void Timers_Output::print() const
+{
+    double overlapped = std::max(0., write.elapsed_time() - flush.elapsed_time());
+
+    std::cout.setf(std::ios::fixed, std::ios::floatfield);
+    std::cout.precision(5);
+    std::cout << "|...Output function times (s)......." << std::endl;
+    std::cout << "|   |...write (background).........: ";
+    std::cout << std::setw(12) << std::right << write.elapsed_time() << std::endl;
+    std::cout << "|   |...flush (blocking)...........: ";
+    std::cout << std::setw(12) << std::right << flush.elapsed_time() << std::endl;
+    std::cout << "|   |...overlapped with compute....: ";
+    std::cout << std::setw(12) << std::right << overlapped << std::endl;
+    std::cout << "|" << std::endl;
+}
+
+
+static void write_files(const OutputSnapshot& output)
+{
+    if (!output.csv_headers.empty()) {
+        std::ofstream csv_headers("headers.csv");
+        csv_headers << output.csv_headers << std::endl;
+        csv_headers.close();
+    }
+
+    if (!output.csv_line.empty()) {
+        std::ofstream csv_file("output.csv");
+        csv_file << output.csv_line << std::endl;
+        csv_file.close();
+    }
+
+    if (output.vtk) write_VTK(output);
+    if (output.vtp) write_VTP(output);
+}
+
+
+static void write_VTK(const OutputSnapshot& output)
+{
+    std::size_t num = output.num;
+    std::size_t num_faces = output.num_faces;
+
+    std::ofstream vtk_file("output.vtk");
+    vtk_file << "# vtk DataFile Version 1.0\n";
+    vtk_file << "vtk file output.vtk\n";
+    vtk_file << "ASCII\n";
+    vtk_file << "DATASET POLYDATA\n\n";
+
+    vtk_file << "POINTS " << num << " double\n";
+    vtk_file << std::fixed << std::setprecision(6);
+    for (std::size_t i = 0; i < num; ++i)
+        vtk_file << output.x[i] << " " << output.y[i] << " " << output.z[i] << "\n";
+
+    vtk_file << "POLYGONS " << num_faces << " " << num_faces * 4 << "\n";
+    for (std::size_t i = 0; i < num_faces; ++i)
+        vtk_file << "3 " << output.face_x[i]-1 << " " << output.face_y[i]-1 << " " << output.face_z[i]-1 << "\n";
+
+    // These are in KCAL. Multiplying by KCAL_TO_KJ would make them KJ.
+    vtk_file << "\nPOINT_DATA " << num << "\n";
+    vtk_file << "SCALARS Potential double\n";
+    vtk_file << "LOOKUP_TABLE default\n";
+    std::copy(output.potential.begin(), output.potential.begin() + num,
+              std::ostream_iterator<double>(vtk_file, "\n"));
+
+    // If we want induced surface charges, we can multiply NormalPotential by (1/eps + 1)
+    vtk_file << "SCALARS NormalPotential double\n";
+    vtk_file << "LOOKUP_TABLE default\n";
+    std::copy(output.potential.begin() + num, output.potential.end(),
+              std::ostream_iterator<double>(vtk_file, "\n"));
+
+    vtk_file << "\nNORMALS Normals double\n";
+    for (std::size_t i = 0; i < num; ++i)
+        vtk_file << output.nx[i] << " " << output.ny[i] << " " << output.nz[i] << "\n";
+
+    vtk_file << std::endl;
+    vtk_file.close();
+}
+
+
+static void write_VTP(const OutputSnapshot& output)
+{
+    std::size_t num = output.num;
+    std::size_t num_faces = output.num_faces;
+    bool float32 = output.vtp_float32;
+
+    // XML PolyData with all arrays in a single raw appended block; each array is
+    // preceded by its size in bytes and written in large chunks
+    std::size_t real_size = float32 ? sizeof(float) : sizeof(double);
+    std::string real_type = float32 ? "Float32" : "Float64";
+
+    std::array<std::size_t, 6> offsets;
+    offsets[0] = 0;
+    offsets[1] = offsets[0] + sizeof(std::uint64_t) +     num       * real_size;
+    offsets[2] = offsets[1] + sizeof(std::uint64_t) +     num       * real_size;
+    offsets[3] = offsets[2] + sizeof(std::uint64_t) + 3 * num       * real_size;
+    offsets[4] = offsets[3] + sizeof(std::uint64_t) + 3 * num       * real_size;
+    offsets[5] = offsets[4] + sizeof(std::uint64_t) + 3 * num_faces * sizeof(std::int64_t);
+
+    const std::uint16_t endian_test = 1;
+    bool little_endian = *reinterpret_cast<const unsigned char*>(&endian_test) == 1;
+
+    std::ofstream vtp_file("output.vtp", std::ios::binary);
+    vtp_file << "<?xml version=\"1.0\"?>\n"
+             << "<VTKFile type=\"PolyData\" version=\"1.0\" byte_order=\""
+             << (little_endian ? "LittleEndian" : "BigEndian") << "\" header_type=\"UInt64\">\n"
+             << "  <PolyData>\n"
+             << "    <Piece NumberOfPoints=\"" << num << "\" NumberOfVerts=\"0\" NumberOfLines=\"0\" "
+             << "NumberOfStrips=\"0\" NumberOfPolys=\"" << num_faces << "\">\n"
+             << "      <PointData Scalars=\"Potential\" Normals=\"Normals\">\n"
+             << "        <DataArray type=\"" << real_type << "\" Name=\"Potential\" "
+             << "format=\"appended\" offset=\"" << offsets[0] << "\"/>\n"
+             << "        <DataArray type=\"" << real_type << "\" Name=\"NormalPotential\" "
+             << "format=\"appended\" offset=\"" << offsets[1] << "\"/>\n"
+             << "        <DataArray type=\"" << real_type << "\" Name=\"Normals\" NumberOfComponents=\"3\" "
+             << "format=\"appended\" offset=\"" << offsets[2] << "\"/>\n"
+             << "      </PointData>\n"
+             << "      <Points>\n"
+             << "        <DataArray type=\"" << real_type << "\" NumberOfComponents=\"3\" "
+             << "format=\"appended\" offset=\"" << offsets[3] << "\"/>\n"
+             << "      </Points>\n"
+             << "      <Polys>\n"
+             << "        <DataArray type=\"Int64\" Name=\"connectivity\" "
+             << "format=\"appended\" offset=\"" << offsets[4] << "\"/>\n"
+             << "        <DataArray type=\"Int64\" Name=\"offsets\" "
+             << "format=\"appended\" offset=\"" << offsets[5] << "\"/>\n"
+             << "      </Polys>\n"
+             << "    </Piece>\n"
+             << "  </PolyData>\n"
+             << "  <AppendedData encoding=\"raw\">\n"
+             << "   _";
+
+    // These are in KCAL, as in the legacy VTK output
+    const double* potential_ptr = output.potential.data();
+    const double* potential_normal_ptr = output.potential.data() + num;
+
+    auto point_component = [](const std::vector<double>& x, const std::vector<double>& y,
+                              const std::vector<double>& z, std::size_t i) {
+        return (i % 3 == 0) ? x[i / 3] : (i % 3 == 1) ? y[i / 3] : z[i / 3];
+    };
+
+    auto face_vertex = [&output](std::size_t i) {
+        return static_cast<std::int64_t>((i % 3 == 0) ? output.face_x[i / 3] - 1 :
+                                         (i % 3 == 1) ? output.face_y[i / 3] - 1 : output.face_z[i / 3] - 1);
+    };
+
+    if (float32) {
+        write_VTP_block<float>(vtp_file, num, [=](std::size_t i) { return potential_ptr[i]; });
+        write_VTP_block<float>(vtp_file, num, [=](std::size_t i) { return potential_normal_ptr[i]; });
+        write_VTP_block<float>(vtp_file, 3 * num,
+            [&](std::size_t i) { return point_component(output.nx, output.ny, output.nz, i); });
+        write_VTP_block<float>(vtp_file, 3 * num,
+            [&](std::size_t i) { return point_component(output.x, output.y, output.z, i); });
+    } else {
+        write_VTP_block<double>(vtp_file, num, [=](std::size_t i) { return potential_ptr[i]; });
+        write_VTP_block<double>(vtp_file, num, [=](std::size_t i) { return potential_normal_ptr[i]; });
+        write_VTP_block<double>(vtp_file, 3 * num,
+            [&](std::size_t i) { return point_component(output.nx, output.ny, output.nz, i); });
+        write_VTP_block<double>(vtp_file, 3 * num,
+            [&](std::size_t i) { return point_component(output.x, output.y, output.z, i); });
+    }
+
+    write_VTP_block<std::int64_t>(vtp_file, 3 * num_faces, face_vertex);
+    write_VTP_block<std::int64_t>(vtp_file, num_faces, [](std::size_t i) { return 3 * (std::int64_t)(i + 1); });
+
+    vtp_file << "\n  </AppendedData>\n"
+             << "</VTKFile>\n";
+    vtp_file.close();
+}
+
+
+template <typename T, typename Function>
+static void write_VTP_block(std::ofstream& file, std::size_t num_values, Function&& value)
+{
+    const std::size_t chunk_size = 1 << 16;
+
+    std::uint64_t num_bytes = num_values * sizeof(T);
+    file.write(reinterpret_cast<const char*>(&num_bytes), sizeof(num_bytes));
+
+    std::vector<T> chunk(std::min(num_values, chunk_size));
+    for (std::size_t begin = 0; begin < num_values; begin += chunk_size) {
+        std::size_t end = std::min(num_values, begin + chunk_size);
+        for (std::size_t i = begin; i < end; ++i) chunk[i - begin] = static_cast<T>(value(i));
+        file.write(reinterpret_cast<const char*>(chunk.data()), (end - begin) * sizeof(T));
+    }
+}
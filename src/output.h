@@ -8,4 +8,8 @@
 
 std::array<double, 3> Output(const BoundaryElement& bem, const Timers& timers);
 
+// Output prints synchronously but writes its files on a background thread;
+// this blocks until every queued file is written. It also runs at exit.
+void FlushOutput();
+
 #endif
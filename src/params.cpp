@@ -11,20 +11,43 @@
 #include "constants.h"
 #include "params.h"
 
-Params::Params(char* infile)
+Params::Params()
 {
-    std::ifstream paramfile (infile, std::ifstream::in);
-    if (!paramfile.good()) {
-        std::cout << "param file is not readable. exiting. " << std::endl;
-        std::exit(1);
-    }
-
     output_vtk_ = false;
+    output_vtp_ = false;
+    output_vtp_float32_ = false;
     output_csv_ = false;
     output_csv_headers_ = false;
     output_timers_ = false;
+    output_trace_ = false;
+    output_perf_counters_ = false;
     precondition_ = false;
     
+    mesh_generator_ = MeshGenerator::NANOSHAPER;
+    mesh_cache_size_ = 1024.;
+    setup_threads_ = 2;
+    sphere_vertices_ = 2562;
+    checkpoint_interval_ = 1;
+    engine_ = Engine::TREECODE;
+    direct_sample_ = 0;
+    tree_adaptive_degree_ = false;
+    tree_mutual_ = false;
+    tree_task_graph_ = false;
+    tree_node_layout_ = TreeNodeLayout::ARRAYS;
+    particle_layout_ = ParticleLayout::SOA;
+    kernel_exp_tol_ = 0.;
+    tune_tol_ = 1e-3;
+}
+
+
+Params::Params(char* infile) : Params()
+{
+    std::ifstream paramfile (infile, std::ifstream::in);
+    if (!paramfile.good()) {
+        std::cout << "param file is not readable. exiting. " << std::endl;
+        std::exit(1);
+    }
+    
     std::string line;
     
     while (std::getline(paramfile, line)) {
@@ -61,6 +84,21 @@ Params::Params(char* infile)
         } else if (param_token == "temp") {
             phys_temp_ = std::stod(param_value);
 
+        } else if (param_token == "engine") {
+            auto it = engine_table_.find(param_value);
+            if (it == engine_table_.end()) {
+                std::cout << "invalid engine value. exiting. " << std::endl;
+                std::exit(1);
+            }
+            engine_ = it->second;
+            
+        } else if (param_token == "direct_sample") {
+            if (std::stol(param_value) < 0) {
+                std::cout << "invalid direct_sample value. exiting. " << std::endl;
+                std::exit(1);
+            }
+            direct_sample_ = std::stoul(param_value);
+
         } else if (param_token == "tree_degree") {
             tree_degree_ = std::stoi(param_value);
             if (tree_degree_ <= 0) {
@@ -68,6 +106,15 @@ Params::Params(char* infile)
                 std::exit(1);
             }
 
+        } else if (param_token == "tree_adaptive_degree") {
+            if (param_value == "true" || param_value == "on") tree_adaptive_degree_ = true;
+
+        } else if (param_token == "tree_mutual") {
+            if (param_value == "true" || param_value == "on") tree_mutual_ = true;
+
+        } else if (param_token == "tree_task_graph") {
+            if (param_value == "true" || param_value == "on") tree_task_graph_ = true;
+
         } else if (param_token == "tree_theta") {
             tree_theta_ = std::stod(param_value);
             if (tree_theta_ < 0. || tree_theta_ > 1.) {
@@ -82,6 +129,29 @@ Params::Params(char* infile)
                 std::exit(1);
             }
         
+        } else if (param_token == "tree_node_layout") {
+            auto it = tree_node_layout_table_.find(param_value);
+            if (it == tree_node_layout_table_.end()) {
+                std::cout << "invalid tree_node_layout value. exiting. " << std::endl;
+                std::exit(1);
+            }
+            tree_node_layout_ = it->second;
+            
+        } else if (param_token == "particle_layout") {
+            auto it = particle_layout_table_.find(param_value);
+            if (it == particle_layout_table_.end()) {
+                std::cout << "invalid particle_layout value. exiting. " << std::endl;
+                std::exit(1);
+            }
+            particle_layout_ = it->second;
+            
+        } else if (param_token == "kernel_exp_tol") {
+            kernel_exp_tol_ = std::stod(param_value);
+            if (kernel_exp_tol_ < 0.) {
+                std::cout << "invalid kernel_exp_tol value. exiting. " << std::endl;
+                std::exit(1);
+            }
+            
         } else if (param_token == "mesh") {
             auto it = mesh_table_.find(param_value);
             if (it == mesh_table_.end()) {
@@ -90,9 +160,17 @@ Params::Params(char* infile)
             }
             mesh_ = it->second;
             
+        } else if (param_token == "mesh_generator") {
+            auto it = mesh_generator_table_.find(param_value);
+            if (it == mesh_generator_table_.end()) {
+                std::cout << "invalid mesh_generator value. exiting. " << std::endl;
+                std::exit(1);
+            }
+            mesh_generator_ = it->second;
+            
         } else if (param_token == "sdens") {
             mesh_density_ = std::stod(param_value);
-            if (mesh_density_ < 0) {
+            if (mesh_density_ <= 0) {
                 std::cout << "invalid density value. exiting. " << std::endl;
                 std::exit(1);
             }
@@ -104,6 +182,70 @@ Params::Params(char* infile)
                 std::exit(1);
             }
         
+        } else if (param_token == "sphere" || param_token == "sphere_charge") {
+            if (tokenized_line.size() < 5) {
+                std::cout << "invalid " << param_token << " value. exiting. " << std::endl;
+                std::exit(1);
+            }
+            std::vector<double>& values = (param_token == "sphere") ? spheres_ : sphere_charges_;
+            for (int i = 1; i < 5; ++i) values.push_back(std::stod(tokenized_line[i]));
+            
+            if (param_token == "sphere" && spheres_.back() <= 0) {
+                std::cout << "invalid sphere radius. exiting. " << std::endl;
+                std::exit(1);
+            }
+            
+        } else if (param_token == "sphere_vertices") {
+            if (std::stol(param_value) < 12) {
+                std::cout << "invalid sphere_vertices value. exiting. " << std::endl;
+                std::exit(1);
+            }
+            sphere_vertices_ = std::stoul(param_value);
+        
+        } else if (param_token == "mesh_cache_dir") {
+            // directory names are case sensitive, so use the raw token
+            mesh_cache_dir_ = tokenized_line[1];
+            
+        } else if (param_token == "mesh_cache_size") {
+            mesh_cache_size_ = std::stod(param_value);
+            if (mesh_cache_size_ < 0) {
+                std::cout << "invalid mesh_cache_size value. exiting. " << std::endl;
+                std::exit(1);
+            }
+        
+        } else if (param_token == "setup_threads") {
+            setup_threads_ = std::stoi(param_value);
+            if (setup_threads_ < 1) {
+                std::cout << "invalid setup_threads value. exiting. " << std::endl;
+                std::exit(1);
+            }
+        
+        } else if (param_token == "checkpoint_file") {
+            checkpoint_file_ = tokenized_line[1];
+            
+        } else if (param_token == "checkpoint_interval") {
+            checkpoint_interval_ = std::stoi(param_value);
+            if (checkpoint_interval_ < 1) {
+                std::cout << "invalid checkpoint_interval value. exiting. " << std::endl;
+                std::exit(1);
+            }
+            
+        } else if (param_token == "restart_file") {
+            restart_file_ = tokenized_line[1];
+            
+        } else if (param_token == "telemetry") {
+            telemetry_file_ = tokenized_line[1];
+            
+        } else if (param_token == "tune") {
+            tune_file_ = tokenized_line[1];
+            
+        } else if (param_token == "tune_tol") {
+            tune_tol_ = std::stod(param_value);
+            if (tune_tol_ <= 0.) {
+                std::cout << "invalid tune_tol value. exiting. " << std::endl;
+                std::exit(1);
+            }
+            
         } else if (param_token == "precondition") {
             if (param_value == "true" || param_value == "on") precondition_ = true;
         
@@ -112,15 +254,30 @@ Params::Params(char* infile)
         
         } else if (param_token == "outdata") {
              if (param_value == "vtk") output_vtk_ = true;
+             if (param_value == "vtp") output_vtp_ = true;
+             if (param_value == "vtp32") output_vtp_ = output_vtp_float32_ = true;
              if (param_value == "csv") output_csv_ = true;
              if (param_value == "csv_headers") output_csv_headers_ = true;
              if (param_value == "timers") output_timers_ = true;
+             if (param_value == "trace") output_trace_ = true;
+             if (param_value == "perf") output_perf_counters_ = true;
         
         } else {
             std::cout << "Skipping undefined token: " << param_token << std::endl;
         }
     }
     
+    if (mesh_generator_ == MeshGenerator::SPHERE && spheres_.empty()) {
+        std::cout << "mesh_generator sphere needs at least one sphere. exiting. " << std::endl;
+        std::exit(1);
+    }
+    
+    Params::compute_derived_params();
+}
+
+
+void Params::compute_derived_params()
+{
     phys_eps_    = phys_eps_solvent_ / phys_eps_solute_;
     phys_kappa2_ = constants::BULK_COEFF * phys_bulk_strength_ / phys_eps_solvent_ / phys_temp_;
     phys_kappa_  = std::sqrt(phys_kappa2_);
@@ -2,6 +2,8 @@
 #define H_TABIPB_PARAMS_STRUCT_H
 
 #include <string>
+#include <vector>
+#include <cstddef>
 #include <fstream>
 #include <unordered_map>
 
@@ -18,14 +20,63 @@ struct Params
     
     std::unordered_map<std::string,enum Mesh> const mesh_table_
         = { {"ses",Mesh::SES}, {"skin",Mesh::SKIN} };
+    
+    enum MeshGenerator {
+        NANOSHAPER,
+        NATIVE,
+        SPHERE
+    };
+    
+    std::unordered_map<std::string,enum MeshGenerator> const mesh_generator_table_
+        = { {"nanoshaper",MeshGenerator::NANOSHAPER}, {"native",MeshGenerator::NATIVE},
+            {"sphere",MeshGenerator::SPHERE} };
+    
+    enum Engine {
+        TREECODE,
+        DIRECT
+    };
+    
+    std::unordered_map<std::string,enum Engine> const engine_table_
+        = { {"treecode",Engine::TREECODE}, {"direct",Engine::DIRECT} };
+    
+    enum TreeNodeLayout {
+        ARRAYS,
+        PACKED_BFS,
+        PACKED_DFS
+    };
+    
+    std::unordered_map<std::string,enum TreeNodeLayout> const tree_node_layout_table_
+        = { {"arrays",TreeNodeLayout::ARRAYS}, {"bfs",TreeNodeLayout::PACKED_BFS},
+            {"dfs",TreeNodeLayout::PACKED_DFS} };
+    
+    enum ParticleLayout {
+        SOA,
+        AOSOA
+    };
+    
+    std::unordered_map<std::string,enum ParticleLayout> const particle_layout_table_
+        = { {"soa",ParticleLayout::SOA}, {"aosoa",ParticleLayout::AOSOA} };
    
     /* pqr file location */
     std::ifstream pqr_file_;
     
     /* mesh settings */
     enum Mesh mesh_;
+    enum MeshGenerator mesh_generator_;
     double mesh_density_;
     double mesh_probe_radius_;
+    
+    /* synthetic sphere geometry: x, y, z, radius per sphere and x, y, z, charge per point charge */
+    std::vector<double> spheres_;
+    std::vector<double> sphere_charges_;
+    std::size_t sphere_vertices_;
+    
+    /* surface mesh cache, disabled if the directory is empty */
+    std::string mesh_cache_dir_;
+    double mesh_cache_size_;
+    
+    /* threads the setup stages run on, so that stages independent of each other overlap */
+    int setup_threads_;
 
     /* physical parameters */
     double phys_temp_;
@@ -39,9 +90,31 @@ struct Params
     double phys_kappa2_;
 
    /* boundary_element parameters */
+    enum Engine engine_;
+    std::size_t direct_sample_;
     int tree_degree_;
+    bool tree_adaptive_degree_;
+    bool tree_mutual_;
+    bool tree_task_graph_;
     int tree_max_per_leaf_;
     double tree_theta_;
+    enum TreeNodeLayout tree_node_layout_;
+    enum ParticleLayout particle_layout_;
+    
+    // relative error bound of the tabulated exp(-kappa r) in the kernels; 0 uses std::exp
+    double kernel_exp_tol_;
+    
+   /* GMRES checkpointing, disabled if the file names are empty */
+    std::string checkpoint_file_;
+    int checkpoint_interval_;
+    std::string restart_file_;
+    
+   /* per-iteration GMRES telemetry, as newline-delimited JSON, disabled if the file name is empty */
+    std::string telemetry_file_;
+    
+   /* tuning mode, disabled if the output file name is empty */
+    std::string tune_file_;
+    double tune_tol_;
     
    /* preconditioning */
     bool precondition_;
@@ -51,13 +124,21 @@ struct Params
 
    /* output of potential data */
     bool output_vtk_;
+    bool output_vtp_;
+    bool output_vtp_float32_;
     bool output_csv_;
     bool output_csv_headers_;
     bool output_timers_;
+    bool output_trace_;
+    bool output_perf_counters_;
     
+    // defaults only; the physical, mesh and tree settings are left to the caller
+    Params();
     Params(char* paramfile);
     ~Params() = default;
     
+    void compute_derived_params();
+    
 #ifdef TABIPB_APBS
     Params(TABIPBInput tabipbIn);
 #endif
@@ -13,6 +13,7 @@
 
 #include "partition.h"
 #include "constants.h"
+#include "kernel_policy.h"
 #include "particles.h"
 
 
@@ -29,12 +30,16 @@ Particles::Particles(const class Molecule& mol, const struct Params& params, str
 {
     timers_.ctor.start();
 
-    Particles::generate_particles(params_.mesh_, params_.mesh_density_, params_.mesh_probe_radius_);
+    // a cached mesh for this molecule and these mesh settings skips NanoShaper entirely
+    std::string cache_path = Particles::mesh_cache_path();
     
-    source_charge_.assign(num_, 0.);
-    source_charge_dx_.assign(num_, 0.);
-    source_charge_dy_.assign(num_, 0.);
-    source_charge_dz_.assign(num_, 0.);
+    if (cache_path.empty() || !Particles::read_mesh_cache(cache_path)) {
+        Particles::generate_particles(params_.mesh_, params_.mesh_density_, params_.mesh_probe_radius_);
+        if (!cache_path.empty()) Particles::write_mesh_cache(cache_path);
+    }
+    
+    std::cout << "Surface area of triangulated mesh is " << surface_area_ 
+              << ". " << std::endl << std::endl;
     
     target_charge_.assign(num_, 0.);
     target_charge_dx_.assign(num_, 0.);
@@ -52,6 +57,41 @@ Particles::Particles(const class Molecule& mol, const struct Params& params, str
 
 void Particles::generate_particles(Params::Mesh mesh, double mesh_density, double probe_radius)
 {
+    if (params_.mesh_generator_ == Params::MeshGenerator::SPHERE)
+        triangulate_spheres();
+    else if (params_.mesh_generator_ == Params::MeshGenerator::NATIVE)
+        triangulate_surface(mesh, mesh_density, probe_radius);
+    else
+        run_NanoShaper(mesh, mesh_density, probe_radius);
+
+    area_.assign(num_, 0.);
+    
+    for (std::size_t i = 0; i < num_faces_; ++i) {
+    
+        std::array<std::size_t, 3> iface {face_x_[i], face_y_[i], face_z_[i]};
+        std::array<std::array<double, 3>, 3> r; 
+        
+        for (int ii = 0; ii < 3; ++ii) {
+            r[0][ii] = x_[iface[ii]-1];
+            r[1][ii] = y_[iface[ii]-1];
+            r[2][ii] = z_[iface[ii]-1];
+        }
+
+        for (int j = 0; j < 3; ++j) {
+            area_[iface[j]-1] += triangle_area(r);
+        }
+    }
+    
+    std::transform(area_.begin(), area_.end(), area_.begin(),
+                   [=](double x) { return x / 3.; } );
+    surface_area_ = std::accumulate(area_.begin(), area_.end(), decltype(area_)::value_type(0));
+}
+
+
+void Particles::run_NanoShaper(Params::Mesh mesh, double mesh_density, double probe_radius)
+{
+    molecule_.build_xyzr_file();
+    
     std::ofstream NS_param_file("surfaceConfiguration.prm");
     
     NS_param_file << "Grid_scale = "                                 << mesh_density     << std::endl;
@@ -155,30 +195,6 @@ void Particles::generate_particles(Params::Mesh mesh, double mesh_density, doubl
     std::remove("molecule.xyzr");
     std::remove("triangulatedSurf.vert");
     std::remove("triangulatedSurf.face");
-
-    area_.assign(num_, 0.);
-    
-    for (std::size_t i = 0; i < num_faces_; ++i) {
-    
-        std::array<std::size_t, 3> iface {face_x_[i], face_y_[i], face_z_[i]};
-        std::array<std::array<double, 3>, 3> r; 
-        
-        for (int ii = 0; ii < 3; ++ii) {
-            r[0][ii] = x_[iface[ii]-1];
-            r[1][ii] = y_[iface[ii]-1];
-            r[2][ii] = z_[iface[ii]-1];
-        }
-
-        for (int j = 0; j < 3; ++j) {
-            area_[iface[j]-1] += triangle_area(r);
-        }
-    }
-    
-    std::transform(area_.begin(), area_.end(), area_.begin(),
-                   [=](double x) { return x / 3.; } );
-    surface_area_ = std::accumulate(area_.begin(), area_.end(), decltype(area_)::value_type(0));
-    std::cout << "Surface area of triangulated mesh is " << surface_area_ 
-              << ". " << std::endl << std::endl;
 }
 
 
@@ -257,12 +273,31 @@ void Particles::compute_source_term()
 }
 
 
-double Particles::compute_solvation_energy(std::vector<double>& potential) const
+double Particles::compute_solvation_energy(std::vector<double>& potential,
+                                           const YukawaTable& yukawa_table) const
 {
     timers_.compute_solvation_energy.start();
 
+    double solvation_energy;
+    if (!(params_.phys_kappa_ > 0.))
+        solvation_energy = Particles::solvation_energy_sum<UnscreenedKernel>(potential, yukawa_table);
+    else if (yukawa_table.empty())
+        solvation_energy = Particles::solvation_energy_sum<ScreenedKernel>  (potential, yukawa_table);
+    else
+        solvation_energy = Particles::solvation_energy_sum<TabulatedKernel> (potential, yukawa_table);
+
+    timers_.compute_solvation_energy.stop();
+
+    return solvation_energy;
+}
+
+
+template <class Kernel>
+double Particles::solvation_energy_sum(const std::vector<double>& potential,
+                                       const YukawaTable& yukawa_table) const
+{
     double eps = params_.phys_eps_;
-    double kappa = params_.phys_kappa_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table);
     double solvation_energy = 0.;
     std::size_t num_atoms = molecule_.num_atoms();
     std::size_t num = num_;
@@ -307,16 +342,11 @@ double Particles::compute_solvation_energy(std::vector<double>& potential) const
                                 + particles_ny_ptr[i] * y_dist
                                 + particles_nz_ptr[i] * z_dist) / dist;
 
-            double kappa_r     = kappa * dist;
-            double exp_kappa_r = std::exp(-kappa_r);
-
             double G0 = constants::ONE_OVER_4PI / dist;
-            double Gk = exp_kappa_r * G0;
             double G1 = cos_theta * G0 / dist;
-            double G2 = G1 * (1.0 + kappa_r) * exp_kappa_r;
         
-            double L1 = G1 - eps * G2;
-            double L2 = G0 - Gk;
+            double L1, L2;
+            kernel.energy_terms(dist, G0, G1, eps, L1, L2);
 
             solvation_energy += molecule_charge_ptr[j] * particles_area_ptr[i]
                               * (L1 * potential_ptr[i] + L2 * potential_ptr[num + i]);
@@ -326,8 +356,6 @@ double Particles::compute_solvation_energy(std::vector<double>& potential) const
     #pragma acc exit data delete(potential_ptr[0:potential_num])
 #endif
 
-    timers_.compute_solvation_energy.stop();
-
     return solvation_energy;
 }
 
@@ -458,6 +486,29 @@ void Particles::reorder()
     apply_order(order_.begin(), order_.end(), area_.begin());
     apply_order(order_.begin(), order_.end(), source_term_.begin());
     apply_order(order_.begin(), order_.end(), source_term_.begin() + num_);
+    
+    if (params_.particle_layout_ == Params::ParticleLayout::AOSOA) Particles::pack_geometry();
+}
+
+
+void Particles::pack_geometry()
+{
+    std::size_t num_blocks = (num_ + PACKED_BLOCK_SIZE - 1) / PACKED_BLOCK_SIZE;
+    std::size_t block_size = PACKED_BLOCK_SIZE * PACKED_NUM_FIELDS;
+    
+    // padding lanes of the last block have zero area, so they never contribute
+    packed_geometry_.assign(num_blocks * block_size, 0.);
+    
+    for (std::size_t i = 0; i < num_; ++i) {
+        double* lane = &packed_geometry_[(i / PACKED_BLOCK_SIZE) * block_size + i % PACKED_BLOCK_SIZE];
+        lane[0 * PACKED_BLOCK_SIZE] = x_[i];
+        lane[1 * PACKED_BLOCK_SIZE] = y_[i];
+        lane[2 * PACKED_BLOCK_SIZE] = z_[i];
+        lane[3 * PACKED_BLOCK_SIZE] = nx_[i];
+        lane[4 * PACKED_BLOCK_SIZE] = ny_[i];
+        lane[5 * PACKED_BLOCK_SIZE] = nz_[i];
+        lane[6 * PACKED_BLOCK_SIZE] = area_[i];
+    }
 }
 
 
@@ -480,7 +531,7 @@ void Particles::unorder(std::vector<double>& potential)
 }
 
 
-void Particles::compute_charges(const double* __restrict potential_ptr)
+void Particles::compute_target_charges()
 {
     timers_.compute_charges.start();
 
@@ -489,22 +540,15 @@ void Particles::compute_charges(const double* __restrict potential_ptr)
     const double* __restrict nx_ptr = nx_.data();
     const double* __restrict ny_ptr = ny_.data();
     const double* __restrict nz_ptr = nz_.data();
-    const double* __restrict area_ptr = area_.data();
 
     double* __restrict target_q_ptr    = target_charge_.data();
     double* __restrict target_q_dx_ptr = target_charge_dx_.data();
     double* __restrict target_q_dy_ptr = target_charge_dy_.data();
     double* __restrict target_q_dz_ptr = target_charge_dz_.data();
 
-    double* __restrict source_q_ptr    = source_charge_.data();
-    double* __restrict source_q_dx_ptr = source_charge_dx_.data();
-    double* __restrict source_q_dy_ptr = source_charge_dy_.data();
-    double* __restrict source_q_dz_ptr = source_charge_dz_.data();
-
 #ifdef OPENACC_ENABLED
-    #pragma acc parallel loop present(nx_ptr, ny_ptr, nz_ptr, area_ptr, potential_ptr, \
-                target_q_ptr, target_q_dx_ptr, target_q_dy_ptr, target_q_dz_ptr, \
-                source_q_ptr, source_q_dx_ptr, source_q_dy_ptr, source_q_dz_ptr)
+    #pragma acc parallel loop present(nx_ptr, ny_ptr, nz_ptr, \
+                target_q_ptr, target_q_dx_ptr, target_q_dy_ptr, target_q_dz_ptr)
 
 #elif OPENMP_ENABLED
     #pragma omp parallel for
@@ -514,58 +558,12 @@ void Particles::compute_charges(const double* __restrict potential_ptr)
         target_q_dx_ptr[i] = constants::ONE_OVER_4PI * nx_ptr[i];
         target_q_dy_ptr[i] = constants::ONE_OVER_4PI * ny_ptr[i];
         target_q_dz_ptr[i] = constants::ONE_OVER_4PI * nz_ptr[i];
-        
-        source_q_ptr   [i] =             area_ptr[i] * potential_ptr[num + i];
-        source_q_dx_ptr[i] = nx_ptr[i] * area_ptr[i] * potential_ptr[i];
-        source_q_dy_ptr[i] = ny_ptr[i] * area_ptr[i] * potential_ptr[i];
-        source_q_dz_ptr[i] = nz_ptr[i] * area_ptr[i] * potential_ptr[i];
     }
 
     timers_.compute_charges.stop();
 }
 
 
-void Particles::output_VTK(const std::vector<double>& potential) const
-{
-    timers_.output_VTK.start();
-
-    std::ofstream vtk_file("output.vtk");
-    vtk_file << "# vtk DataFile Version 1.0\n";
-    vtk_file << "vtk file output.vtk\n";
-    vtk_file << "ASCII\n";
-    vtk_file << "DATASET POLYDATA\n\n";
-    
-    vtk_file << "POINTS " << num_ << " double\n";
-    vtk_file << std::fixed << std::setprecision(6);
-    for (std::size_t i = 0; i < num_; ++i)
-        vtk_file << x_[i] << " " << y_[i] << " " << z_[i] << "\n";
-        
-    vtk_file << "POLYGONS " << num_faces_ << " " << num_faces_ * 4 << "\n";
-    for (std::size_t i = 0; i < num_faces_; ++i)
-        vtk_file << "3 " << face_x_[i]-1 << " " << face_y_[i]-1 << " " << face_z_[i]-1 << "\n";
-
-    // These are in KCAL. Multiplying by KCAL_TO_KJ would make them KJ.
-    vtk_file << "\nPOINT_DATA " << num_ << "\n";
-    vtk_file << "SCALARS Potential double\n";
-    vtk_file << "LOOKUP_TABLE default\n";
-    std::copy(potential.begin(), potential.begin() + num_, std::ostream_iterator<double>(vtk_file, "\n"));
-    
-    // If we want induced surface charges, we can multiply NormalPotential by (1/eps + 1)
-    vtk_file << "SCALARS NormalPotential double\n";
-    vtk_file << "LOOKUP_TABLE default\n";
-    std::copy(potential.begin() + num_, potential.end(), std::ostream_iterator<double>(vtk_file, "\n"));
-
-    vtk_file << "\nNORMALS Normals double\n";
-    for (std::size_t i = 0; i < num_; ++i)
-        vtk_file << nx_[i] << " " << ny_[i] << " " << nz_[i] << "\n";
-        
-    vtk_file << std::endl;
-    vtk_file.close();
-
-    timers_.output_VTK.stop();
-}
-
-
 void Particles::copyin_to_device() const
 {
     timers_.copyin_to_device.start();
@@ -603,21 +601,10 @@ void Particles::copyin_to_device() const
     std::size_t tq_dy_num = target_charge_dy_.size();
     std::size_t tq_dz_num = target_charge_dz_.size();
 
-    const double* sq_ptr    = source_charge_.data();
-    const double* sq_dx_ptr = source_charge_dx_.data();
-    const double* sq_dy_ptr = source_charge_dy_.data();
-    const double* sq_dz_ptr = source_charge_dz_.data();
-
-    std::size_t sq_num    = source_charge_.size();
-    std::size_t sq_dx_num = source_charge_dx_.size();
-    std::size_t sq_dy_num = source_charge_dy_.size();
-    std::size_t sq_dz_num = source_charge_dz_.size();
-
     #pragma acc enter data copyin(x_ptr[0:x_num],  y_ptr[0:y_num], z_ptr[0:z_num], \
                 nx_ptr[0:nx_num], ny_ptr[0:ny_num], nz_ptr[0:nz_num], area_ptr[0:area_num])
     #pragma acc enter data create(source_term_ptr[0:source_term_num], \
-                tq_ptr[0:tq_num], tq_dx_ptr[0:tq_dx_num], tq_dy_ptr[0:tq_dy_num], tq_dz_ptr[0:tq_dz_num], \
-                sq_ptr[0:sq_num], sq_dx_ptr[0:sq_dx_num], sq_dy_ptr[0:sq_dy_num], sq_dz_ptr[0:sq_dz_num])
+                tq_ptr[0:tq_num], tq_dx_ptr[0:tq_dx_num], tq_dy_ptr[0:tq_dy_num], tq_dz_ptr[0:tq_dz_num])
 #endif
 
     timers_.copyin_to_device.stop();
@@ -672,21 +659,10 @@ void Particles::delete_from_device() const
     std::size_t tq_dy_num = target_charge_dy_.size();
     std::size_t tq_dz_num = target_charge_dz_.size();
 
-    const double* sq_ptr    = source_charge_.data();
-    const double* sq_dx_ptr = source_charge_dx_.data();
-    const double* sq_dy_ptr = source_charge_dy_.data();
-    const double* sq_dz_ptr = source_charge_dz_.data();
-
-    std::size_t sq_num    = source_charge_.size();
-    std::size_t sq_dx_num = source_charge_dx_.size();
-    std::size_t sq_dy_num = source_charge_dy_.size();
-    std::size_t sq_dz_num = source_charge_dz_.size();
-
     #pragma acc exit data delete(x_ptr[0:x_num],  y_ptr[0:y_num], z_ptr[0:z_num], \
                 nx_ptr[0:nx_num], ny_ptr[0:ny_num], nz_ptr[0:nz_num], area_ptr[0:area_num])
     #pragma acc exit data delete(source_term_ptr[0:source_term_num], \
-                tq_ptr[0:tq_num], tq_dx_ptr[0:tq_dx_num], tq_dy_ptr[0:tq_dy_num], tq_dz_ptr[0:tq_dz_num], \
-                sq_ptr[0:sq_num], sq_dx_ptr[0:sq_dx_num], sq_dy_ptr[0:sq_dy_num], sq_dz_ptr[0:sq_dz_num])
+                tq_ptr[0:tq_num], tq_dx_ptr[0:tq_dx_num], tq_dy_ptr[0:tq_dy_num], tq_dz_ptr[0:tq_dz_num])
 #endif
 
     timers_.delete_from_device.stop();
@@ -718,7 +694,7 @@ static void apply_order(order_iterator order_begin, order_iterator order_end, va
     using value_t = typename std::iterator_traits< value_iterator >::value_type;
     using index_t = typename std::iterator_traits< order_iterator >::value_type;
     
-    auto v_end = v_begin + std::distance(order_begin, order_end) + 1;
+    auto v_end = v_begin + std::distance(order_begin, order_end);
     std::vector<value_t> tmp(v_begin, v_end);
 
     std::for_each(order_begin, order_end,
@@ -750,6 +726,8 @@ void Timers_Particles::print() const
     std::cout << "|...Particles function times (s)...." << std::endl;
     std::cout << "|   |...ctor.......................: ";
     std::cout << std::setw(12) << std::right << ctor.elapsed_time() << std::endl;
+    std::cout << "|       |...mesh_cache.............: ";
+    std::cout << std::setw(12) << std::right << mesh_cache.elapsed_time() << std::endl;
     std::cout << "|   |...compute_source_term........: ";
     std::cout << std::setw(12) << std::right << compute_source_term.elapsed_time() << std::endl;
     std::cout << "|   |...compute_charges............: ";
@@ -770,6 +748,7 @@ std::string Timers_Particles::get_durations() const
 {
     std::string durations;
     durations.append(std::to_string(ctor                     .elapsed_time())).append(", ");
+    durations.append(std::to_string(mesh_cache               .elapsed_time())).append(", ");
     durations.append(std::to_string(compute_source_term      .elapsed_time())).append(", ");
     durations.append(std::to_string(compute_charges          .elapsed_time())).append(", ");
     durations.append(std::to_string(compute_solvation_energy .elapsed_time())).append(", ");
@@ -784,6 +763,7 @@ std::string Timers_Particles::get_headers() const
 {
     std::string headers;
     headers.append("Particles ctor, ");
+    headers.append("Particles mesh_cache, ");
     headers.append("Particles compute_source_term, ");
     headers.append("Particles compute_charges, ");
     headers.append("Particles compute_solvation_energy, ");
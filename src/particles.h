@@ -2,6 +2,7 @@
 #define H_TABIPB_PARTICLES_STRUCT_H
 
 #include <vector>
+#include <string>
 #include <cstdlib>
 
 #include "timer.h"
@@ -40,18 +41,31 @@ private:
     std::vector<double> target_charge_dx_;
     std::vector<double> target_charge_dy_;
     std::vector<double> target_charge_dz_;
-    
-    std::vector<double> source_charge_;
-    std::vector<double> source_charge_dx_;
-    std::vector<double> source_charge_dy_;
-    std::vector<double> source_charge_dz_;
 
     std::vector<std::size_t> order_;
     
+    std::vector<double> packed_geometry_;
+    
     void generate_particles(Params::Mesh, double, double);
+    void run_NanoShaper(Params::Mesh, double, double);
+    void triangulate_surface(Params::Mesh, double, double);
+    void triangulate_spheres();
     void update_source_term_on_host() const;
+    void pack_geometry();
+    
+    template <class Kernel> double solvation_energy_sum(const std::vector<double>& potential,
+                                                        const class YukawaTable& yukawa_table) const;
+    
+    std::string mesh_cache_path() const;
+    bool read_mesh_cache(const std::string&);
+    void write_mesh_cache(const std::string&) const;
     
 public:
+    /* AoSoA geometry: blocks of 8 particles holding x, y, z, nx, ny, nz, area,
+     * each field as 8 consecutive values */
+    static constexpr std::size_t PACKED_BLOCK_SIZE = 8;
+    static constexpr std::size_t PACKED_NUM_FIELDS = 7;
+    
     Particles(const class Molecule&, const struct Params&, struct Timers_Particles&);
     ~Particles() = default;
     
@@ -59,14 +73,16 @@ public:
     void reorder();
     void unorder(std::vector<double>& potential);
     
-    void compute_charges(const double* potential);
+    // the target charges depend only on the normals, so they are set once; the
+    // source charges, area * potential, are formed by the kernels that read them
+    void compute_target_charges();
     
     const std::array<double, 6> bounds(std::size_t begin, std::size_t end) const;
-    double compute_solvation_energy(std::vector<double>& potential) const;
-    
-    void output_VTK(const std::vector<double>& potential) const;
+    double compute_solvation_energy(std::vector<double>& potential,
+                                    const class YukawaTable& yukawa_table) const;
     
     std::size_t num() const { return num_; };
+    std::size_t num_faces() const { return num_faces_; };
     double surface_area() const { return surface_area_; };
     
     const double* x_ptr() const { return x_.data(); };
@@ -77,7 +93,14 @@ public:
     const double* ny_ptr() const { return ny_.data(); };
     const double* nz_ptr() const { return nz_.data(); };
     
+    const std::size_t* face_x_ptr() const { return face_x_.data(); };
+    const std::size_t* face_y_ptr() const { return face_y_.data(); };
+    const std::size_t* face_z_ptr() const { return face_z_.data(); };
+    
+    const std::size_t* order_ptr() const { return order_.data(); };
+    
     const double* area_ptr() const { return area_.data(); };
+    const double* packed_geometry_ptr() const { return packed_geometry_.data(); };
     const double* source_term_ptr() const { return source_term_.data(); };
     
     const double* target_charge_ptr()    const { return target_charge_.data(); };
@@ -85,11 +108,6 @@ public:
     const double* target_charge_dy_ptr() const { return target_charge_dy_.data(); };
     const double* target_charge_dz_ptr() const { return target_charge_dz_.data(); };
     
-    const double* source_charge_ptr()    const { return source_charge_.data(); };
-    const double* source_charge_dx_ptr() const { return source_charge_dx_.data(); };
-    const double* source_charge_dy_ptr() const { return source_charge_dy_.data(); };
-    const double* source_charge_dz_ptr() const { return source_charge_dz_.data(); };
-    
     void compute_source_term();
     void copyin_to_device() const;
     void delete_from_device() const;
@@ -99,12 +117,12 @@ public:
 struct Timers_Particles
 {
     Timer ctor;
+    Timer mesh_cache;
     Timer compute_source_term;
     Timer compute_charges;
     Timer compute_solvation_energy;
     Timer copyin_to_device;
     Timer delete_from_device;
-    Timer output_VTK;
     
     void print() const;
     std::string get_durations() const;
@@ -0,0 +1,245 @@
+#include <array>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+
+#ifdef PERF_COUNTERS_ENABLED
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#include "perf_counters.h"
+
+/*  One counter per event for the whole process, opened with inherit so that the
+ *  kernel sums the counts of every thread started after it. Each event is opened
+ *  on its own rather than as a group, since a group read is not supported for
+ *  inherited counters, and each read is scaled by its enabled over running time
+ *  in case the kernel multiplexes the events onto fewer hardware counters. */
+
+static const std::array<const char*, PerfCounters::NUM_EVENTS> PERF_EVENT_NAMES {
+    "cycles", "instructions", "LLC misses", "dTLB misses", "branch misses"};
+
+static const std::array<const char*, PerfCounters::NUM_EVENTS> PERF_EVENT_HEADERS {
+    "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses"};
+
+static const std::array<const char*, PerfCounters::NUM_PHASES> PERF_PHASE_NAMES {
+    "tree", "interaction_list", "upward_pass", "interact", "downward_pass", "precondition", "run_GMRES"};
+
+struct PerfCounterState
+{
+    std::mutex mutex;
+    bool opened = false;
+    std::atomic<bool> active {false};
+
+    std::array<int, PerfCounters::NUM_EVENTS> fds;
+    std::string status;
+
+    std::array<PerfCounters::Values, PerfCounters::NUM_PHASES> counts {};
+    std::array<std::size_t, PerfCounters::NUM_PHASES> entries {};
+
+    PerfCounterState() { fds.fill(-1); }
+};
+
+
+static PerfCounterState& perf_counter_state()
+{
+    static PerfCounterState state;
+    return state;
+}
+
+
+#ifdef PERF_COUNTERS_ENABLED
+static int open_event(std::size_t event)
+{
+    static const std::array<std::uint32_t, PerfCounters::NUM_EVENTS> types {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE};
+
+    static const std::array<std::uint64_t, PerfCounters::NUM_EVENTS> configs {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_LL   | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_BRANCH_MISSES};
+
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+
+    attr.size           = sizeof(attr);
+    attr.type           = types[event];
+    attr.config         = configs[event];
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.inherit        = 1;
+    // user space only, which is what an unprivileged process may count
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+#endif
+
+
+void PerfCounters::open()
+{
+    PerfCounterState& state = perf_counter_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    if (state.opened) return;
+    state.opened = true;
+
+#ifdef PERF_COUNTERS_ENABLED
+    std::size_t num_open = 0;
+    std::string unavailable;
+    int error = 0;
+
+    for (std::size_t event = 0; event < NUM_EVENTS; ++event) {
+        state.fds[event] = open_event(event);
+
+        if (state.fds[event] >= 0) {
+            ++num_open;
+        } else {
+            error = errno;
+            unavailable.append(unavailable.empty() ? "" : ", ").append(PERF_EVENT_NAMES[event]);
+        }
+    }
+
+    if (num_open == 0) {
+        state.status = std::string("perf_event_open failed: ") + std::strerror(error);
+        std::cout << "Hardware counters unavailable (" << state.status << "), continuing without them."
+                  << std::endl;
+        return;
+    }
+
+    if (!unavailable.empty()) {
+        state.status = unavailable + " unavailable: " + std::strerror(error);
+        std::cout << "Hardware counters: " << state.status << "." << std::endl;
+    }
+
+    state.active.store(true);
+#else
+    state.status = "not built; configure with ENABLE_PERF_COUNTERS on Linux";
+    std::cout << "Hardware counters " << state.status << "." << std::endl;
+#endif
+}
+
+
+bool PerfCounters::active()
+{
+    return perf_counter_state().active.load(std::memory_order_relaxed);
+}
+
+
+void PerfCounters::read(Values& values)
+{
+    values.fill(std::nan(""));
+
+#ifdef PERF_COUNTERS_ENABLED
+    const PerfCounterState& state = perf_counter_state();
+
+    for (std::size_t event = 0; event < NUM_EVENTS; ++event) {
+        if (state.fds[event] < 0) continue;
+
+        // value, time enabled, time running
+        std::uint64_t data[3];
+        if (::read(state.fds[event], data, sizeof(data)) != (ssize_t)sizeof(data)) continue;
+
+        values[event] = data[2] > 0 ? (double)data[0] * ((double)data[1] / data[2]) : (double)data[0];
+    }
+#endif
+}
+
+
+void PerfCounters::add(Phase phase, const Values& begin, const Values& end)
+{
+    PerfCounterState& state = perf_counter_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    for (std::size_t event = 0; event < NUM_EVENTS; ++event)
+        state.counts[phase][event] += end[event] - begin[event];
+
+    state.entries[phase] += 1;
+}
+
+
+void PerfCounters::print()
+{
+    PerfCounterState& state = perf_counter_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    if (!state.opened) return;
+
+    std::cout << "|...Hardware counters per phase (all threads)...." << std::endl;
+
+    if (!state.active.load()) {
+        std::cout << "|   " << state.status << std::endl;
+        std::cout << "|" << std::endl;
+        return;
+    }
+
+    std::cout << "|   " << std::left << std::setw(18) << "phase" << std::right;
+    for (const char* name : PERF_EVENT_NAMES) std::cout << std::setw(14) << name;
+    std::cout << std::setw(8) << "IPC" << std::endl;
+
+    std::ostringstream row;
+    for (std::size_t phase = 0; phase < NUM_PHASES; ++phase) {
+        if (state.entries[phase] == 0) continue;
+
+        const Values& counts = state.counts[phase];
+
+        row.str("");
+        row << "|   " << std::left << std::setw(18) << PERF_PHASE_NAMES[phase] << std::right
+            << std::scientific << std::setprecision(4);
+        for (double count : counts) {
+            if (std::isnan(count)) row << std::setw(14) << "n/a";
+            else                   row << std::setw(14) << count;
+        }
+
+        double ipc = counts[1] / counts[0];
+        row << std::fixed << std::setprecision(3);
+        if (std::isnan(ipc) || std::isinf(ipc)) row << std::setw(8) << "n/a";
+        else                                    row << std::setw(8) << ipc;
+
+        std::cout << row.str() << std::endl;
+    }
+
+    if (!state.status.empty()) std::cout << "|   (" << state.status << ")" << std::endl;
+    std::cout << "|" << std::endl;
+}
+
+
+std::string PerfCounters::get_values()
+{
+    PerfCounterState& state = perf_counter_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    bool active = state.active.load();
+
+    std::string values;
+    for (std::size_t phase = 0; phase < NUM_PHASES; ++phase) {
+        for (std::size_t event = 0; event < NUM_EVENTS; ++event) {
+            double count = state.counts[phase][event];
+            if (!active || std::isnan(count)) values.append("nan, ");
+            else values.append(std::to_string(count)).append(", ");
+        }
+    }
+
+    return values;
+}
+
+
+std::string PerfCounters::get_headers()
+{
+    std::string headers;
+    for (const char* phase : PERF_PHASE_NAMES)
+        for (const char* event : PERF_EVENT_HEADERS)
+            headers.append("PerfCounters ").append(phase).append(" ").append(event).append(", ");
+
+    return headers;
+}
@@ -0,0 +1,75 @@
+#ifndef H_TABIPB_PERF_COUNTERS_H
+#define H_TABIPB_PERF_COUNTERS_H
+
+#include <array>
+#include <string>
+#include <cstddef>
+
+/*  Hardware counters per solver phase, through Linux perf_event_open. The counters
+ *  are opened once, before any worker thread starts, and are inherited by every
+ *  thread created after, so reading them around a phase on the main thread counts
+ *  the work of all threads in it. Events the kernel or the hardware refuses are
+ *  reported as unavailable and the rest still count; if none can be opened, the
+ *  run goes on without them.
+ *
+ *  PERF_SCOPE(phase) counts the rest of the enclosing block into the phase. Without
+ *  PERF_COUNTERS_ENABLED it compiles to nothing and open() reports the counters
+ *  as not built. */
+
+class PerfCounters
+{
+public:
+    enum Phase { TREE, INTERACTION_LIST, UPWARD_PASS, INTERACT, DOWNWARD_PASS,
+                 PRECONDITION, GMRES, NUM_PHASES };
+
+    static constexpr std::size_t NUM_EVENTS = 5;
+    using Values = std::array<double, NUM_EVENTS>;
+
+    static void open();
+    static bool active();
+
+    static void read(Values& values);
+    static void add(Phase phase, const Values& begin, const Values& end);
+
+    static void print();
+    static std::string get_values();
+    static std::string get_headers();
+};
+
+
+class PerfScope
+{
+private:
+    PerfCounters::Phase phase_;
+    bool active_;
+    PerfCounters::Values begin_;
+
+public:
+    explicit PerfScope(PerfCounters::Phase phase) : phase_(phase), active_(PerfCounters::active())
+    {
+        if (active_) PerfCounters::read(begin_);
+    }
+
+    ~PerfScope()
+    {
+        if (!active_) return;
+        PerfCounters::Values end;
+        PerfCounters::read(end);
+        PerfCounters::add(phase_, begin_, end);
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+};
+
+
+#define PERF_CONCAT_(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_(a, b)
+
+#ifdef PERF_COUNTERS_ENABLED
+    #define PERF_SCOPE(phase) PerfScope PERF_CONCAT(perf_scope_, __LINE__)(PerfCounters::phase)
+#else
+    #define PERF_SCOPE(phase)
+#endif
+
+#endif /* H_TABIPB_PERF_COUNTERS_H */
@@ -1,6 +1,9 @@
 #include <cmath>
 
 #include "constants.h"
+#include "profiler.h"
+#include "perf_counters.h"
+#include "kernel_policy.h"
 #include "boundary_element.h"
 
 static int lu_decomp(double* A, int N, int* pivot);
@@ -9,6 +12,8 @@ static void lu_solve(double* A, int N, int* pivot, double* rhs);
 
 void BoundaryElement::precondition_diagonal(double *z, double *r)
 {
+    PROFILE_SCOPE("run_GMRES/iteration/precondition");
+    PERF_SCOPE(PRECONDITION);
     timers_.precondition.start();
 
     double potential_coeff_1 = 0.5 * (1. +      params_.phys_eps_);
@@ -23,11 +28,25 @@ void BoundaryElement::precondition_diagonal(double *z, double *r)
 
 void BoundaryElement::precondition_block(double *z, double *r)
 {
+    PROFILE_SCOPE("run_GMRES/iteration/precondition");
+    PERF_SCOPE(PRECONDITION);
     timers_.precondition.start();
 
+    switch (kernel_policy_) {
+        case UNSCREENED: BoundaryElement::precondition_block_leaves<UnscreenedKernel>(z, r); break;
+        case SCREENED:   BoundaryElement::precondition_block_leaves<ScreenedKernel>  (z, r); break;
+        case TABULATED:  BoundaryElement::precondition_block_leaves<TabulatedKernel> (z, r); break;
+    }
+
+    timers_.precondition.stop();
+}
+
+
+template <class Kernel>
+void BoundaryElement::precondition_block_leaves(double *z, double *r)
+{
     double eps    = params_.phys_eps_;
-    double kappa  = params_.phys_kappa_;
-    double kappa2 = params_.phys_kappa2_;
+    const Kernel kernel(params_.phys_kappa_, params_.phys_kappa2_, yukawa_table_);
 
     const std::size_t num_total_particles         = particles_.num();
     const double* __restrict particles_x_ptr    = particles_.x_ptr();
@@ -52,7 +71,7 @@ void BoundaryElement::precondition_block(double *z, double *r)
 
         std::vector<double> A(num_cols * num_cols, 0.);
         std::vector<double> rhs(num_cols, 0.);
-        std::vector<int> pivot(num_cols, 0);
+        std::vector<int> pivot(num_cols + 1, 0);
 
         for (std::size_t j = particle_begin; j < particle_end; ++j) {
 
@@ -87,21 +106,17 @@ void BoundaryElement::precondition_block(double *z, double *r)
                 if (r > 0) {
                     double one_over_r = 1. / r;
                     double G0 = constants::ONE_OVER_4PI * one_over_r;
-                    double kappa_r = kappa * r;
-                    double exp_kappa_r = std::exp(-kappa_r);
-                    double Gk = exp_kappa_r * G0;
                     double source_cos = (source_nx * dist_x + source_ny * dist_y + source_nz * dist_z) * one_over_r;
                     double target_cos = (target_nx * dist_x + target_ny * dist_y + target_nz * dist_z) * one_over_r;
                     double tp1 = G0 * one_over_r;
-                    double tp2 = (1. + kappa_r) * exp_kappa_r;
 
                     double dot_tqsq = source_nx * target_nx + source_ny * target_ny + source_nz * target_nz;
-                    double G3 = (dot_tqsq - 3. * target_cos * source_cos) * one_over_r * tp1;
-                    double G4 = tp2 * G3 - kappa2 * target_cos * source_cos * Gk;
+
+                    double tp2, L2, L3;
+                    kernel.boundary_terms(r, one_over_r, G0, tp1, source_cos, target_cos, dot_tqsq,
+                                          tp2, L2, L3);
 
                     double L1 = source_cos * tp1 * (1. - tp2 * eps);
-                    double L2 = G0 - Gk;
-                    double L3 = G4 - G3;
                     double L4 = target_cos * tp1 * (1. - tp2 / eps);
 
                     A[(row                ) * num_cols + (col                )] = -L1 * source_area;
@@ -142,8 +157,6 @@ void BoundaryElement::precondition_block(double *z, double *r)
         }
 
     }
-
-    timers_.precondition.stop();
 }
 
 
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#include "profiler.h"
+
+/*  Every thread that enters a region gets its own ThreadProfile on first use,
+ *  registered once under the mutex and never freed, so recording a scope only
+ *  touches the thread's own arrays. The totals and events are read once the
+ *  parallel work is done, when the report or the trace is written. */
+
+static constexpr std::size_t PROFILER_MAX_EVENTS_PER_THREAD = std::size_t(1) << 22;
+
+struct ProfileEvent
+{
+    int region;
+    std::uint64_t begin;
+    std::uint64_t end;
+};
+
+struct ThreadProfile
+{
+    std::size_t tid;
+    std::vector<std::uint64_t> time;
+    std::vector<std::size_t> count;
+    std::vector<ProfileEvent> events;
+    std::size_t dropped_events = 0;
+};
+
+struct ProfilerState
+{
+    std::mutex mutex;
+    std::vector<std::string> paths;
+    std::vector<std::unique_ptr<ThreadProfile>> threads;
+    std::atomic<bool> tracing {false};
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+
+static ProfilerState& profiler_state()
+{
+    static ProfilerState state;
+    return state;
+}
+
+
+static ThreadProfile& thread_profile()
+{
+    static thread_local ThreadProfile* profile = nullptr;
+
+    if (profile == nullptr) {
+        ProfilerState& state = profiler_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        state.threads.emplace_back(new ThreadProfile());
+        profile = state.threads.back().get();
+        profile->tid = state.threads.size() - 1;
+    }
+
+    return *profile;
+}
+
+
+static int find_region(const ProfilerState& state, const std::string& path)
+{
+    auto it = std::find(state.paths.begin(), state.paths.end(), path);
+    return it == state.paths.end() ? -1 : (int)(it - state.paths.begin());
+}
+
+
+int Profiler::region(const char* path)
+{
+    ProfilerState& state = profiler_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    int region = find_region(state, path);
+    if (region >= 0) return region;
+
+    state.paths.push_back(path);
+    return (int)state.paths.size() - 1;
+}
+
+
+std::uint64_t Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - profiler_state().epoch).count();
+}
+
+
+void Profiler::record(int region, std::uint64_t begin, std::uint64_t end)
+{
+    ThreadProfile& profile = thread_profile();
+
+    if ((std::size_t)region >= profile.time.size()) {
+        profile.time.resize(region + 1, 0);
+        profile.count.resize(region + 1, 0);
+    }
+
+    profile.time[region] += end - begin;
+    profile.count[region] += 1;
+
+    if (profiler_state().tracing.load(std::memory_order_relaxed)) {
+        if (profile.events.size() < PROFILER_MAX_EVENTS_PER_THREAD)
+            profile.events.push_back(ProfileEvent {region, begin, end});
+        else
+            ++profile.dropped_events;
+    }
+}
+
+
+void Profiler::set_tracing(bool tracing)
+{
+    profiler_state().tracing.store(tracing);
+}
+
+
+double Profiler::total_time(const std::string& path)
+{
+    ProfilerState& state = profiler_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    int region = find_region(state, path);
+    if (region < 0) return 0.;
+
+    std::uint64_t time = 0;
+    for (const auto& profile : state.threads)
+        if ((std::size_t)region < profile->time.size()) time += profile->time[region];
+
+    return time * 1e-9;
+}
+
+
+std::size_t Profiler::count(const std::string& path)
+{
+    ProfilerState& state = profiler_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    int region = find_region(state, path);
+    if (region < 0) return 0;
+
+    std::size_t count = 0;
+    for (const auto& profile : state.threads)
+        if ((std::size_t)region < profile->count.size()) count += profile->count[region];
+
+    return count;
+}
+
+
+void Profiler::print()
+{
+    ProfilerState& state = profiler_state();
+
+    std::vector<std::string> paths;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        paths = state.paths;
+    }
+    if (paths.empty()) return;
+
+    // every path and every prefix of one is a node, keyed by the first region
+    // registered under each of its prefixes, so children follow their parents
+    // in the order they were first entered
+    auto first_under = [&](const std::string& prefix) {
+        for (std::size_t i = 0; i < paths.size(); ++i)
+            if (paths[i] == prefix || paths[i].compare(0, prefix.size() + 1, prefix + "/") == 0) return i;
+        return paths.size();
+    };
+
+    std::vector<std::string> nodes;
+    for (const auto& path : paths) {
+        for (std::size_t pos = path.find('/'); pos != std::string::npos; pos = path.find('/', pos + 1))
+            nodes.push_back(path.substr(0, pos));
+        nodes.push_back(path);
+    }
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+
+    auto key = [&](const std::string& node) {
+        std::vector<std::size_t> key;
+        for (std::size_t pos = node.find('/'); pos != std::string::npos; pos = node.find('/', pos + 1))
+            key.push_back(first_under(node.substr(0, pos)));
+        key.push_back(first_under(node));
+        return key;
+    };
+    std::sort(nodes.begin(), nodes.end(),
+              [&](const std::string& a, const std::string& b) { return key(a) < key(b); });
+
+    std::cout.setf(std::ios::fixed, std::ios::floatfield);
+    std::cout.precision(5);
+    std::cout << "|...Profiled regions (s summed over threads, calls)...." << std::endl;
+
+    for (const auto& node : nodes) {
+        std::size_t depth = std::count(node.begin(), node.end(), '/');
+        std::size_t name_begin = node.rfind('/') == std::string::npos ? 0 : node.rfind('/') + 1;
+
+        std::string label = "|   " + std::string(4 * depth, ' ') + "|..." + node.substr(name_begin);
+        if (label.size() < 35) label.append(35 - label.size(), '.');
+        std::cout << label << ": ";
+
+        if (std::find(paths.begin(), paths.end(), node) != paths.end()) {
+            std::cout << std::setw(12) << std::right << Profiler::total_time(node)
+                      << std::setw(10) << std::right << Profiler::count(node);
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "|" << std::endl;
+}
+
+
+void Profiler::write_trace(const std::string& path)
+{
+    ProfilerState& state = profiler_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    std::ofstream trace(path);
+    std::size_t num_events = 0;
+    std::size_t num_dropped = 0;
+
+    // Chrome trace complete events, in microseconds; nesting on a thread is by time
+    trace << "{\"traceEvents\":[\n";
+    trace << std::fixed << std::setprecision(3);
+
+    bool first = true;
+    for (const auto& profile : state.threads) {
+        if (!first) trace << ",\n";
+        first = false;
+
+        trace << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << profile->tid
+              << ",\"args\":{\"name\":\"thread " << profile->tid << "\"}}";
+
+        for (const auto& event : profile->events) {
+            const std::string& region_path = state.paths[event.region];
+            std::size_t name_begin = region_path.rfind('/') == std::string::npos ? 0 : region_path.rfind('/') + 1;
+
+            trace << ",\n{\"name\":\"" << region_path.substr(name_begin) << "\",\"cat\":\"" << region_path
+                  << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << profile->tid
+                  << ",\"ts\":" << event.begin * 1e-3 << ",\"dur\":" << (event.end - event.begin) * 1e-3 << "}";
+        }
+
+        num_events  += profile->events.size();
+        num_dropped += profile->dropped_events;
+    }
+
+    trace << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    trace.close();
+
+    if (!trace.good()) {
+        std::cout << "Could not write trace to " << path << "." << std::endl;
+        return;
+    }
+
+    std::cout << "Wrote " << num_events << " trace events to " << path;
+    if (num_dropped > 0) std::cout << ", dropping " << num_dropped << " past the per-thread limit";
+    std::cout << "." << std::endl;
+}
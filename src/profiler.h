@@ -0,0 +1,61 @@
+#ifndef H_TABIPB_PROFILER_H
+#define H_TABIPB_PROFILER_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+/*  Scoped, per-thread profiling regions. A region is named by a static path such
+ *  as "run_GMRES/iteration/matrix_vector/interact/PP", which places it in the
+ *  report hierarchy wherever it is entered from. Each thread accumulates its own
+ *  time and call count per region, so regions entered inside OpenMP loops do not
+ *  race, and the totals are summed over threads. When tracing is on, every scope
+ *  is also kept as an event for the Chrome trace.
+ *
+ *  PROFILE_SCOPE(path) times the rest of the enclosing block. Without
+ *  PROFILING_ENABLED it compiles to nothing, and the region totals read zero. */
+
+class Profiler
+{
+public:
+    static int region(const char* path);
+    static std::uint64_t now();
+    static void record(int region, std::uint64_t begin, std::uint64_t end);
+
+    static void set_tracing(bool tracing);
+
+    static double total_time(const std::string& path);
+    static std::size_t count(const std::string& path);
+
+    static void print();
+    static void write_trace(const std::string& path);
+};
+
+
+class ProfileScope
+{
+private:
+    int region_;
+    std::uint64_t begin_;
+
+public:
+    explicit ProfileScope(int region) : region_(region), begin_(Profiler::now()) {}
+    ~ProfileScope() { Profiler::record(region_, begin_, Profiler::now()); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef PROFILING_ENABLED
+    #define PROFILE_SCOPE(path) \
+        static const int PROFILE_CONCAT(profile_region_, __LINE__) = Profiler::region(path); \
+        ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_region_, __LINE__))
+#else
+    #define PROFILE_SCOPE(path)
+#endif
+
+#endif /* H_TABIPB_PROFILER_H */
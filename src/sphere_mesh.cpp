@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <array>
+#include <iostream>
+#include <cmath>
+#include <cstddef>
+
+#include "particles.h"
+
+/*  Synthetic geometry for scaling studies and validation: a union of spheres,
+ *  each triangulated as a geodesic icosphere. Every icosahedron face is split
+ *  into frequency^2 triangles and the points are projected onto the sphere, so
+ *  an icosphere has 10 * frequency^2 + 2 vertices, and the frequency is chosen
+ *  to come closest to sphere_vertices. Vertex normals are exact. Where spheres
+ *  overlap, triangles with a vertex inside another sphere are dropped, which
+ *  leaves a narrow uncovered seam along each intersection circle. */
+
+struct Icosphere
+{
+    std::vector<double> vertices;
+    std::vector<std::size_t> triangles;
+};
+
+
+static Icosphere unit_icosphere(long frequency)
+{
+    const double phi = 0.5 * (1. + std::sqrt(5.));
+
+    const double corners[12][3] = {
+        {-1.,  phi, 0.}, { 1.,  phi, 0.}, {-1., -phi, 0.}, { 1., -phi, 0.},
+        {0., -1.,  phi}, {0.,  1.,  phi}, {0., -1., -phi}, {0.,  1., -phi},
+        { phi, 0., -1.}, { phi, 0.,  1.}, {-phi, 0., -1.}, {-phi, 0.,  1.}
+    };
+
+    const std::size_t faces[20][3] = {
+        {0, 11,  5}, {0,  5,  1}, { 0,  1,  7}, { 0,  7, 10}, {0, 10, 11},
+        {1,  5,  9}, {5, 11,  4}, {11, 10,  2}, {10,  7,  6}, {7,  1,  8},
+        {3,  9,  4}, {3,  4,  2}, { 3,  2,  6}, { 3,  6,  8}, {3,  8,  9},
+        {4,  9,  5}, {2,  4, 11}, { 6,  2, 10}, { 8,  6,  7}, {9,  8,  1}
+    };
+
+    Icosphere sphere;
+
+    // points on shared edges and corners are keyed by their nonzero corner weights,
+    // sorted by corner, so that neighboring faces find the same vertex
+    using Key = std::array<long, 6>;
+    std::map<Key, std::size_t> vertex_idx;
+
+    for (const auto& face : faces) {
+
+        std::vector<std::size_t> face_idx;
+
+        for (long i = 0; i <= frequency; ++i) {
+            for (long j = 0; j <= frequency - i; ++j) {
+
+                std::array<std::pair<long, long>, 3> weights {{
+                    {(long)face[0], frequency - i - j}, {(long)face[1], i}, {(long)face[2], j} }};
+                for (auto& w : weights) if (w.second == 0) w.first = -1;
+                std::sort(weights.begin(), weights.end());
+
+                Key key;
+                for (int k = 0; k < 3; ++k) {
+                    key[2*k]     = weights[k].first;
+                    key[2*k + 1] = weights[k].second;
+                }
+
+                auto inserted = vertex_idx.insert({key, sphere.vertices.size() / 3});
+                face_idx.push_back(inserted.first->second);
+
+                if (inserted.second) {
+                    double p[3];
+                    for (int d = 0; d < 3; ++d) {
+                        p[d] = 0.;
+                        for (const auto& w : weights) if (w.first >= 0) p[d] += w.second * corners[w.first][d];
+                    }
+                    double norm = std::sqrt(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+                    for (int d = 0; d < 3; ++d) sphere.vertices.push_back(p[d] / norm);
+                }
+            }
+        }
+
+        // (i, j) is at offset i * (frequency + 1) - i * (i - 1) / 2 + j in face_idx
+        auto at = [&](long i, long j) { return face_idx[i * (frequency + 1) - i * (i - 1) / 2 + j]; };
+
+        for (long i = 0; i < frequency; ++i) {
+            for (long j = 0; j < frequency - i; ++j) {
+                sphere.triangles.insert(sphere.triangles.end(), {at(i, j), at(i + 1, j), at(i, j + 1)});
+                if (j < frequency - i - 1)
+                    sphere.triangles.insert(sphere.triangles.end(),
+                                            {at(i + 1, j), at(i + 1, j + 1), at(i, j + 1)});
+            }
+        }
+    }
+
+    return sphere;
+}
+
+
+void Particles::triangulate_spheres()
+{
+    const std::vector<double>& spheres = params_.spheres_;
+    std::size_t num_spheres = spheres.size() / 4;
+
+    long frequency = std::max(1L, std::lround(std::sqrt((params_.sphere_vertices_ - 2.) / 10.)));
+    Icosphere unit = unit_icosphere(frequency);
+    std::size_t num_unit_vertices = unit.vertices.size() / 3;
+
+    x_.clear();  y_.clear();  z_.clear();
+    nx_.clear(); ny_.clear(); nz_.clear();
+    face_x_.clear(); face_y_.clear(); face_z_.clear();
+
+    for (std::size_t s = 0; s < num_spheres; ++s) {
+
+        const double* sphere = &spheres[4*s];
+        std::vector<bool> buried(num_unit_vertices, false);
+
+        for (std::size_t v = 0; v < num_unit_vertices; ++v) {
+            for (std::size_t t = 0; t < num_spheres; ++t) {
+                if (t == s) continue;
+
+                const double* other = &spheres[4*t];
+                double dist_x = sphere[0] + sphere[3] * unit.vertices[3*v + 0] - other[0];
+                double dist_y = sphere[1] + sphere[3] * unit.vertices[3*v + 1] - other[1];
+                double dist_z = sphere[2] + sphere[3] * unit.vertices[3*v + 2] - other[2];
+
+                if (dist_x * dist_x + dist_y * dist_y + dist_z * dist_z < other[3] * other[3]) {
+                    buried[v] = true;
+                    break;
+                }
+            }
+        }
+
+        // 1-indexed particle of each kept unit vertex, 0 until it is first used
+        std::vector<std::size_t> particle_idx(num_unit_vertices, 0);
+
+        for (std::size_t f = 0; f < unit.triangles.size() / 3; ++f) {
+            const std::size_t* triangle = &unit.triangles[3*f];
+            if (buried[triangle[0]] || buried[triangle[1]] || buried[triangle[2]]) continue;
+
+            for (int k = 0; k < 3; ++k) {
+                std::size_t v = triangle[k];
+                if (particle_idx[v] != 0) continue;
+
+                x_.push_back(sphere[0] + sphere[3] * unit.vertices[3*v + 0]);
+                y_.push_back(sphere[1] + sphere[3] * unit.vertices[3*v + 1]);
+                z_.push_back(sphere[2] + sphere[3] * unit.vertices[3*v + 2]);
+                nx_.push_back(unit.vertices[3*v + 0]);
+                ny_.push_back(unit.vertices[3*v + 1]);
+                nz_.push_back(unit.vertices[3*v + 2]);
+                particle_idx[v] = x_.size();
+            }
+
+            face_x_.push_back(particle_idx[triangle[0]]);
+            face_y_.push_back(particle_idx[triangle[1]]);
+            face_z_.push_back(particle_idx[triangle[2]]);
+        }
+    }
+
+    num_       = x_.size();
+    num_faces_ = face_x_.size();
+
+    std::cout << "Icosphere triangulation of " << num_spheres << " sphere(s) at frequency "
+              << frequency << ": " << num_ << " vertices, " << num_faces_ << " faces." << std::endl;
+}
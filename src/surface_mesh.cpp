@@ -0,0 +1,590 @@
+#include <algorithm>
+#include <unordered_map>
+#include <map>
+#include <vector>
+#include <array>
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#include "constants.h"
+#include "particles.h"
+
+/*  In-process replacement for NanoShaper. The surface is the zero level set of a
+ *  scalar field sampled on a uniform grid of spacing 1/mesh_density, negative
+ *  inside the molecule:
+ *
+ *    SES:  inside the solvent accessible surface, f = probe_radius - distance to
+ *          the nearest probe center, with probe centers sampled on the SAS;
+ *          outside it, f = probe_radius + signed distance to the SAS.
+ *    SKIN: f = smooth minimum of |p - c_i| - r_i over all atoms, a blended
+ *          approximation of the skin surface with NanoShaper's shrink factor.
+ *
+ *  The level set is extracted with marching tetrahedra, six per grid cube, which
+ *  needs no case tables and produces a closed, consistently oriented mesh. Vertex
+ *  normals are the normalized field gradient, and edges much shorter than the
+ *  grid spacing are collapsed. Field evaluation and extraction are both split
+ *  over z-planes of the grid, and the per-plane pieces are merged in order, so
+ *  the mesh does not depend on the number of threads. */
+
+static constexpr double SKIN_SURFACE_PARAMETER = 0.45;
+static constexpr double MIN_EDGE_FRACTION      = 0.2;
+
+struct SurfaceGrid
+{
+    double x0, y0, z0, h;
+    long nx, ny, nz;
+    std::vector<double> f;
+
+    std::size_t idx(long i, long j, long k) const { return (k * ny + j) * nx + i; }
+    double x(long i) const { return x0 + i * h; }
+    double y(long j) const { return y0 + j * h; }
+    double z(long k) const { return z0 + k * h; }
+};
+
+struct SurfaceMesh
+{
+    // grid edge of each vertex, used only while merging the slabs
+    std::vector<std::uint64_t> keys;
+    std::vector<double> vertices;
+    std::vector<double> normals;
+    std::vector<std::size_t> triangles;
+};
+
+
+/* visit the grid points of plane k within distance reach of center */
+template <typename Function>
+static void for_each_in_ball(const SurfaceGrid& grid, long k, const double* center,
+                             double reach, Function&& function)
+{
+    double dz = grid.z(k) - center[2];
+    double reach2_xy = reach * reach - dz * dz;
+    if (reach2_xy < 0.) return;
+
+    double reach_xy = std::sqrt(reach2_xy);
+    long j_begin = std::max(0L,            (long)std::ceil ((center[1] - reach_xy - grid.y0) / grid.h));
+    long j_end   = std::min(grid.ny - 1,   (long)std::floor((center[1] + reach_xy - grid.y0) / grid.h));
+
+    for (long j = j_begin; j <= j_end; ++j) {
+        double dy = grid.y(j) - center[1];
+        double reach2_x = reach2_xy - dy * dy;
+        if (reach2_x < 0.) continue;
+
+        double reach_x = std::sqrt(reach2_x);
+        long i_begin = std::max(0L,          (long)std::ceil ((center[0] - reach_x - grid.x0) / grid.h));
+        long i_end   = std::min(grid.nx - 1, (long)std::floor((center[0] + reach_x - grid.x0) / grid.h));
+
+        for (long i = i_begin; i <= i_end; ++i) {
+            double dx = grid.x(i) - center[0];
+            function(grid.idx(i, j, k), dx * dx + dy * dy + dz * dz);
+        }
+    }
+}
+
+
+static void compute_sas_distance(SurfaceGrid& grid, const double* coords, const double* radius,
+                                 std::size_t num_atoms, double probe_radius, double cutoff)
+{
+    std::fill(grid.f.begin(), grid.f.end(), cutoff);
+
+#ifdef OPENMP_ENABLED
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (long k = 0; k < grid.nz; ++k) {
+        for (std::size_t a = 0; a < num_atoms; ++a) {
+            double sas_radius = radius[a] + probe_radius;
+            for_each_in_ball(grid, k, &coords[3*a], sas_radius + cutoff,
+                [&](std::size_t idx, double dist2) {
+                    grid.f[idx] = std::min(grid.f[idx], std::sqrt(dist2) - sas_radius);
+                });
+        }
+    }
+}
+
+
+static std::vector<std::array<double, 3>> sample_sas(const double* coords, const double* radius,
+                                                     std::size_t num_atoms, double probe_radius,
+                                                     double spacing)
+{
+    // cell list of atoms, with cells at least as wide as the largest SAS diameter
+    double max_sas_radius = probe_radius + *std::max_element(radius, radius + num_atoms);
+    double cell_size = 2. * max_sas_radius;
+
+    std::array<double, 3> lower, upper;
+    for (int d = 0; d < 3; ++d) {
+        lower[d] = upper[d] = coords[d];
+        for (std::size_t a = 1; a < num_atoms; ++a) {
+            lower[d] = std::min(lower[d], coords[3*a + d]);
+            upper[d] = std::max(upper[d], coords[3*a + d]);
+        }
+    }
+
+    std::array<long, 3> num_cells;
+    for (int d = 0; d < 3; ++d) num_cells[d] = (long)((upper[d] - lower[d]) / cell_size) + 1;
+
+    auto cell_of = [&](const double* point, int d) {
+        return std::min(num_cells[d] - 1, std::max(0L, (long)((point[d] - lower[d]) / cell_size)));
+    };
+
+    std::vector<std::vector<std::size_t>> cells(num_cells[0] * num_cells[1] * num_cells[2]);
+    for (std::size_t a = 0; a < num_atoms; ++a) {
+        const double* c = &coords[3*a];
+        cells[(cell_of(c, 2) * num_cells[1] + cell_of(c, 1)) * num_cells[0] + cell_of(c, 0)].push_back(a);
+    }
+
+    std::vector<std::vector<std::array<double, 3>>> atom_samples(num_atoms);
+    const double golden_angle = constants::PI * (3. - std::sqrt(5.));
+
+#ifdef OPENMP_ENABLED
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (std::size_t a = 0; a < num_atoms; ++a) {
+        const double* c = &coords[3*a];
+        double sas_radius = radius[a] + probe_radius;
+
+        std::vector<std::size_t> neighbors;
+        for (long cz = std::max(0L, cell_of(c, 2) - 1); cz <= std::min(num_cells[2] - 1, cell_of(c, 2) + 1); ++cz)
+        for (long cy = std::max(0L, cell_of(c, 1) - 1); cy <= std::min(num_cells[1] - 1, cell_of(c, 1) + 1); ++cy)
+        for (long cx = std::max(0L, cell_of(c, 0) - 1); cx <= std::min(num_cells[0] - 1, cell_of(c, 0) + 1); ++cx)
+            for (auto b : cells[(cz * num_cells[1] + cy) * num_cells[0] + cx]) {
+                double dx = coords[3*b + 0] - c[0];
+                double dy = coords[3*b + 1] - c[1];
+                double dz = coords[3*b + 2] - c[2];
+                double reach = sas_radius + radius[b] + probe_radius;
+                if (b != a && dx*dx + dy*dy + dz*dz < reach * reach) neighbors.push_back(b);
+            }
+
+        // Fibonacci points on the SAS sphere, kept if no other SAS sphere buries them
+        long num_points = std::max(12L, (long)std::ceil(4. * constants::PI * sas_radius * sas_radius
+                                                        / (spacing * spacing)));
+        for (long m = 0; m < num_points; ++m) {
+            double zz  = 1. - (2. * m + 1.) / num_points;
+            double rr  = std::sqrt(1. - zz * zz);
+            double phi = m * golden_angle;
+
+            std::array<double, 3> point {c[0] + sas_radius * rr * std::cos(phi),
+                                         c[1] + sas_radius * rr * std::sin(phi),
+                                         c[2] + sas_radius * zz};
+
+            bool buried = false;
+            for (auto b : neighbors) {
+                double dx = point[0] - coords[3*b + 0];
+                double dy = point[1] - coords[3*b + 1];
+                double dz = point[2] - coords[3*b + 2];
+                double other_radius = radius[b] + probe_radius;
+                if (dx*dx + dy*dy + dz*dz < other_radius * other_radius) {
+                    buried = true;
+                    break;
+                }
+            }
+
+            if (!buried) atom_samples[a].push_back(point);
+        }
+    }
+
+    std::vector<std::array<double, 3>> samples;
+    for (const auto& points : atom_samples) samples.insert(samples.end(), points.begin(), points.end());
+
+    return samples;
+}
+
+
+static void compute_ses_field(SurfaceGrid& grid, const double* coords, const double* radius,
+                              std::size_t num_atoms, double probe_radius)
+{
+    double cutoff = 2. * grid.h;
+    compute_sas_distance(grid, coords, radius, num_atoms, probe_radius, cutoff + probe_radius);
+
+    // with no probe, the SES is the van der Waals surface and d_SAS is already its field
+    if (probe_radius <= 0.) return;
+
+    auto samples = sample_sas(coords, radius, num_atoms, probe_radius, 0.5 * grid.h);
+    std::sort(samples.begin(), samples.end(),
+              [](const std::array<double, 3>& a, const std::array<double, 3>& b) { return a[2] < b[2]; });
+
+    // beyond this distance from every probe center the field is below -cutoff
+    double reach = probe_radius + cutoff;
+    std::vector<double> probe_dist2(grid.f.size(), reach * reach);
+
+#ifdef OPENMP_ENABLED
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (long k = 0; k < grid.nz; ++k) {
+        double z = grid.z(k);
+        auto begin = std::lower_bound(samples.begin(), samples.end(), z - reach,
+            [](const std::array<double, 3>& s, double value) { return s[2] < value; });
+
+        for (auto it = begin; it != samples.end() && (*it)[2] <= z + reach; ++it) {
+            for_each_in_ball(grid, k, it->data(), reach,
+                [&](std::size_t idx, double dist2) {
+                    if (grid.f[idx] < 0.) probe_dist2[idx] = std::min(probe_dist2[idx], dist2);
+                });
+        }
+
+        for (std::size_t idx = grid.idx(0, 0, k); idx < grid.idx(0, 0, k + 1); ++idx) {
+            if (grid.f[idx] < 0.) grid.f[idx] = probe_radius - std::sqrt(probe_dist2[idx]);
+            else                  grid.f[idx] = probe_radius + grid.f[idx];
+        }
+    }
+}
+
+
+static void compute_skin_field(SurfaceGrid& grid, const double* coords, const double* radius,
+                               std::size_t num_atoms)
+{
+    // softmin(d) = min(d) - log(sum(exp(-k (d_i - min(d))))) / k, blending over a length of (1 - s) / 2
+    double sharpness = 2. / (1. - SKIN_SURFACE_PARAMETER);
+    double cutoff = 2. * grid.h + 8. / sharpness;
+    std::size_t plane_size = grid.nx * grid.ny;
+
+    std::fill(grid.f.begin(), grid.f.end(), cutoff);
+
+#ifdef OPENMP_ENABLED
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (long k = 0; k < grid.nz; ++k) {
+        double* f = &grid.f[grid.idx(0, 0, k)];
+        std::vector<double> sum(plane_size, 0.);
+
+        for (std::size_t a = 0; a < num_atoms; ++a) {
+            for_each_in_ball(grid, k, &coords[3*a], radius[a] + cutoff,
+                [&](std::size_t idx, double dist2) {
+                    f[idx - k * plane_size] = std::min(f[idx - k * plane_size], std::sqrt(dist2) - radius[a]);
+                });
+        }
+
+        for (std::size_t a = 0; a < num_atoms; ++a) {
+            for_each_in_ball(grid, k, &coords[3*a], radius[a] + cutoff,
+                [&](std::size_t idx, double dist2) {
+                    std::size_t plane_idx = idx - k * plane_size;
+                    sum[plane_idx] += std::exp(-sharpness * (std::sqrt(dist2) - radius[a] - f[plane_idx]));
+                });
+        }
+
+        for (std::size_t idx = 0; idx < plane_size; ++idx)
+            if (sum[idx] > 0.) f[idx] -= std::log(sum[idx]) / sharpness;
+    }
+}
+
+
+static std::array<double, 3> field_gradient(const SurfaceGrid& grid, long i, long j, long k)
+{
+    long i0 = std::max(0L, i - 1), i1 = std::min(grid.nx - 1, i + 1);
+    long j0 = std::max(0L, j - 1), j1 = std::min(grid.ny - 1, j + 1);
+    long k0 = std::max(0L, k - 1), k1 = std::min(grid.nz - 1, k + 1);
+
+    return std::array<double, 3> {
+        (grid.f[grid.idx(i1, j, k)] - grid.f[grid.idx(i0, j, k)]) / ((i1 - i0) * grid.h),
+        (grid.f[grid.idx(i, j1, k)] - grid.f[grid.idx(i, j0, k)]) / ((j1 - j0) * grid.h),
+        (grid.f[grid.idx(i, j, k1)] - grid.f[grid.idx(i, j, k0)]) / ((k1 - k0) * grid.h)};
+}
+
+
+static void extract_slab(const SurfaceGrid& grid, long k, SurfaceMesh& slab)
+{
+    // cube corners, and the six tetrahedra around the (0,0,0)-(1,1,1) diagonal;
+    // every cube uses the same diagonal, so shared faces are split consistently
+    static const int corner[8][3] = {{0,0,0}, {1,0,0}, {1,1,0}, {0,1,0},
+                                     {0,0,1}, {1,0,1}, {1,1,1}, {0,1,1}};
+    static const int tetrahedra[6][4] = {{0,1,2,6}, {0,2,3,6}, {0,3,7,6},
+                                         {0,7,4,6}, {0,4,5,6}, {0,5,1,6}};
+
+    std::unordered_map<std::uint64_t, std::size_t> slab_vertex;
+
+    auto edge_vertex = [&](const long* a, const long* b) {
+        std::size_t idx_a = grid.idx(a[0], a[1], a[2]);
+        std::size_t idx_b = grid.idx(b[0], b[1], b[2]);
+
+        // every edge of the tetrahedra steps by 0 or 1 along each axis, in the same
+        // direction on all three, so it is keyed by its lower grid point and which of
+        // the 7 steps it takes
+        std::uint64_t step = std::labs(b[0] - a[0]) + 2 * std::labs(b[1] - a[1]) + 4 * std::labs(b[2] - a[2]);
+        std::uint64_t key  = 8 * (std::uint64_t)std::min(idx_a, idx_b) + step;
+
+        auto found = slab_vertex.find(key);
+        if (found != slab_vertex.end()) return found->second;
+
+        double t = grid.f[idx_a] / (grid.f[idx_a] - grid.f[idx_b]);
+        auto grad_a = field_gradient(grid, a[0], a[1], a[2]);
+        auto grad_b = field_gradient(grid, b[0], b[1], b[2]);
+
+        std::array<double, 3> normal;
+        for (int d = 0; d < 3; ++d) normal[d] = grad_a[d] + t * (grad_b[d] - grad_a[d]);
+        double norm = std::sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+        if (norm > 0.) for (int d = 0; d < 3; ++d) normal[d] /= norm;
+
+        slab.vertices.push_back(grid.x(a[0]) + t * (b[0] - a[0]) * grid.h);
+        slab.vertices.push_back(grid.y(a[1]) + t * (b[1] - a[1]) * grid.h);
+        slab.vertices.push_back(grid.z(a[2]) + t * (b[2] - a[2]) * grid.h);
+        slab.normals.insert(slab.normals.end(), normal.begin(), normal.end());
+        slab.keys.push_back(key);
+
+        std::size_t vertex_idx = slab.keys.size() - 1;
+        slab_vertex[key] = vertex_idx;
+        return vertex_idx;
+    };
+
+    auto add_triangle = [&](std::size_t v0, std::size_t v1, std::size_t v2) {
+        slab.triangles.push_back(v0);
+        slab.triangles.push_back(v1);
+        slab.triangles.push_back(v2);
+    };
+
+    for (long j = 0; j < grid.ny - 1; ++j) {
+    for (long i = 0; i < grid.nx - 1; ++i) {
+        for (const auto& tetrahedron : tetrahedra) {
+
+            long points[4][3];
+            std::array<int, 4> inside, outside;
+            int num_inside = 0, num_outside = 0;
+
+            for (int v = 0; v < 4; ++v) {
+                const int* offset = corner[tetrahedron[v]];
+                points[v][0] = i + offset[0];
+                points[v][1] = j + offset[1];
+                points[v][2] = k + offset[2];
+
+                if (grid.f[grid.idx(points[v][0], points[v][1], points[v][2])] < 0.) inside[num_inside++] = v;
+                else                                                                 outside[num_outside++] = v;
+            }
+
+            if (num_inside == 1 || num_inside == 3) {
+                // a single vertex is separated from the other three
+                const auto& lone   = (num_inside == 1) ? inside : outside;
+                const auto& others = (num_inside == 1) ? outside : inside;
+                int a = lone[0];
+                add_triangle(edge_vertex(points[a], points[others[0]]),
+                             edge_vertex(points[a], points[others[1]]),
+                             edge_vertex(points[a], points[others[2]]));
+
+            } else if (num_inside == 2) {
+                int a = inside[0],  b = inside[1];
+                int c = outside[0], d = outside[1];
+                std::size_t ac = edge_vertex(points[a], points[c]);
+                std::size_t ad = edge_vertex(points[a], points[d]);
+                std::size_t bd = edge_vertex(points[b], points[d]);
+                std::size_t bc = edge_vertex(points[b], points[c]);
+                add_triangle(ac, ad, bd);
+                add_triangle(ac, bd, bc);
+            }
+        }
+    }
+    }
+}
+
+
+/* Marching tetrahedra leaves clusters of nearly coincident vertices around grid
+ * points that lie close to the surface, which the boundary integral kernels cannot
+ * resolve. Collapse every edge shorter than min_length, moving each cluster to its
+ * centroid and dropping the triangles that degenerate or fold onto each other. */
+static void weld_short_edges(SurfaceMesh& mesh, double min_length)
+{
+    std::size_t num_vertices = mesh.vertices.size() / 3;
+    std::vector<std::size_t> parent(num_vertices);
+    for (std::size_t v = 0; v < num_vertices; ++v) parent[v] = v;
+
+    auto find = [&](std::size_t v) {
+        while (parent[v] != v) v = parent[v] = parent[parent[v]];
+        return v;
+    };
+
+    for (std::size_t t = 0; t < mesh.triangles.size(); t += 3) {
+        for (int e = 0; e < 3; ++e) {
+            std::size_t a = mesh.triangles[t + e];
+            std::size_t b = mesh.triangles[t + (e + 1) % 3];
+
+            double dx = mesh.vertices[3*a + 0] - mesh.vertices[3*b + 0];
+            double dy = mesh.vertices[3*a + 1] - mesh.vertices[3*b + 1];
+            double dz = mesh.vertices[3*a + 2] - mesh.vertices[3*b + 2];
+            if (dx*dx + dy*dy + dz*dz >= min_length * min_length) continue;
+
+            std::size_t root_a = find(a), root_b = find(b);
+            if (root_a < root_b) parent[root_b] = root_a;
+            if (root_b < root_a) parent[root_a] = root_b;
+        }
+    }
+
+    // remap the triangles onto cluster roots, dropping degenerate and doubly covered ones
+    std::vector<std::size_t> triangles;
+    std::map<std::array<std::size_t, 3>, std::size_t> triangle_count;
+
+    for (std::size_t t = 0; t < mesh.triangles.size(); t += 3) {
+        std::array<std::size_t, 3> triangle {find(mesh.triangles[t + 0]),
+                                             find(mesh.triangles[t + 1]),
+                                             find(mesh.triangles[t + 2])};
+        if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[2] == triangle[0]) continue;
+
+        triangles.insert(triangles.end(), triangle.begin(), triangle.end());
+        std::sort(triangle.begin(), triangle.end());
+        ++triangle_count[triangle];
+    }
+
+    // average the clusters that are still referenced, in order of first appearance
+    const std::size_t unused = static_cast<std::size_t>(-1);
+    std::vector<std::size_t> new_idx(num_vertices, unused);
+    std::vector<std::size_t> cluster_size;
+    SurfaceMesh welded;
+
+    for (std::size_t t = 0; t < triangles.size(); t += 3) {
+        std::array<std::size_t, 3> triangle {triangles[t + 0], triangles[t + 1], triangles[t + 2]};
+        std::sort(triangle.begin(), triangle.end());
+        if (triangle_count[triangle] > 1) continue;
+
+        for (int v = 0; v < 3; ++v) {
+            std::size_t root = triangles[t + v];
+            if (new_idx[root] == unused) {
+                new_idx[root] = cluster_size.size();
+                cluster_size.push_back(0);
+            }
+            welded.triangles.push_back(new_idx[root]);
+        }
+    }
+
+    welded.vertices.assign(3 * cluster_size.size(), 0.);
+    welded.normals .assign(3 * cluster_size.size(), 0.);
+
+    for (std::size_t v = 0; v < num_vertices; ++v) {
+        std::size_t cluster = new_idx[find(v)];
+        if (cluster == unused) continue;
+
+        for (int d = 0; d < 3; ++d) {
+            welded.vertices[3*cluster + d] += mesh.vertices[3*v + d];
+            welded.normals [3*cluster + d] += mesh.normals [3*v + d];
+        }
+        ++cluster_size[cluster];
+    }
+
+    for (std::size_t cluster = 0; cluster < cluster_size.size(); ++cluster) {
+        double* normal = &welded.normals[3*cluster];
+        double norm = std::sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+        for (int d = 0; d < 3; ++d) {
+            welded.vertices[3*cluster + d] /= cluster_size[cluster];
+            if (norm > 0.) normal[d] /= norm;
+        }
+    }
+
+    mesh = std::move(welded);
+}
+
+
+/* orient each triangle so that its normal points along the field gradient, i.e. outward */
+static void orient_outward(SurfaceMesh& mesh)
+{
+    for (std::size_t t = 0; t < mesh.triangles.size(); t += 3) {
+        std::size_t v0 = mesh.triangles[t + 0];
+        std::size_t v1 = mesh.triangles[t + 1];
+        std::size_t v2 = mesh.triangles[t + 2];
+
+        double e1[3], e2[3], outward = 0.;
+        for (int d = 0; d < 3; ++d) {
+            e1[d] = mesh.vertices[3*v1 + d] - mesh.vertices[3*v0 + d];
+            e2[d] = mesh.vertices[3*v2 + d] - mesh.vertices[3*v0 + d];
+        }
+        double cross[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                           e1[2] * e2[0] - e1[0] * e2[2],
+                           e1[0] * e2[1] - e1[1] * e2[0]};
+        for (int d = 0; d < 3; ++d)
+            outward += cross[d] * (mesh.normals[3*v0 + d] + mesh.normals[3*v1 + d] + mesh.normals[3*v2 + d]);
+
+        if (outward < 0.) std::swap(mesh.triangles[t + 1], mesh.triangles[t + 2]);
+    }
+}
+
+
+void Particles::triangulate_surface(Params::Mesh mesh, double mesh_density, double probe_radius)
+{
+    std::size_t num_atoms = molecule_.num_atoms();
+    const double* coords = molecule_.coords_ptr();
+    const double* radius = molecule_.radius_ptr();
+
+    if (num_atoms == 0) {
+        std::cout << "No atoms to triangulate. Exiting." << std::endl;
+        std::exit(1);
+    }
+
+    SurfaceGrid grid;
+    grid.h = 1. / mesh_density;
+
+    double max_radius = *std::max_element(radius, radius + num_atoms);
+    double margin = max_radius + 4. * grid.h;
+    if (mesh == Params::Mesh::SES)  margin += probe_radius;
+    if (mesh == Params::Mesh::SKIN) margin += 8. * (1. - SKIN_SURFACE_PARAMETER) / 2.;
+
+    std::array<double, 3> lower, upper;
+    for (int d = 0; d < 3; ++d) {
+        lower[d] = upper[d] = coords[d];
+        for (std::size_t a = 1; a < num_atoms; ++a) {
+            lower[d] = std::min(lower[d], coords[3*a + d]);
+            upper[d] = std::max(upper[d], coords[3*a + d]);
+        }
+    }
+
+    grid.x0 = lower[0] - margin;
+    grid.y0 = lower[1] - margin;
+    grid.z0 = lower[2] - margin;
+    grid.nx = (long)std::ceil((upper[0] - lower[0] + 2. * margin) / grid.h) + 1;
+    grid.ny = (long)std::ceil((upper[1] - lower[1] + 2. * margin) / grid.h) + 1;
+    grid.nz = (long)std::ceil((upper[2] - lower[2] + 2. * margin) / grid.h) + 1;
+    grid.f.resize(grid.nx * grid.ny * grid.nz);
+
+    if (mesh == Params::Mesh::SES)  compute_ses_field (grid, coords, radius, num_atoms, probe_radius);
+    if (mesh == Params::Mesh::SKIN) compute_skin_field(grid, coords, radius, num_atoms);
+
+    std::vector<SurfaceMesh> slabs(grid.nz - 1);
+
+#ifdef OPENMP_ENABLED
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (long k = 0; k < grid.nz - 1; ++k) extract_slab(grid, k, slabs[k]);
+
+    // merge the slabs in order, identifying vertices on shared grid edges by their key
+    std::unordered_map<std::uint64_t, std::size_t> vertex_idx;
+    SurfaceMesh surface;
+
+    for (const auto& slab : slabs) {
+        std::vector<std::size_t> global_idx(slab.keys.size());
+
+        for (std::size_t v = 0; v < slab.keys.size(); ++v) {
+            auto inserted = vertex_idx.insert({slab.keys[v], surface.vertices.size() / 3});
+            global_idx[v] = inserted.first->second;
+
+            if (inserted.second) {
+                surface.vertices.insert(surface.vertices.end(), &slab.vertices[3*v], &slab.vertices[3*v + 3]);
+                surface.normals .insert(surface.normals .end(), &slab.normals [3*v], &slab.normals [3*v + 3]);
+            }
+        }
+
+        for (auto v : slab.triangles) surface.triangles.push_back(global_idx[v]);
+    }
+
+    weld_short_edges(surface, MIN_EDGE_FRACTION * grid.h);
+    orient_outward(surface);
+
+    num_       = surface.vertices.size() / 3;
+    num_faces_ = surface.triangles.size() / 3;
+
+    x_.resize(num_);  y_.resize(num_);  z_.resize(num_);
+    nx_.resize(num_); ny_.resize(num_); nz_.resize(num_);
+
+    for (std::size_t v = 0; v < num_; ++v) {
+        x_[v]  = surface.vertices[3*v + 0];
+        y_[v]  = surface.vertices[3*v + 1];
+        z_[v]  = surface.vertices[3*v + 2];
+        nx_[v] = surface.normals [3*v + 0];
+        ny_[v] = surface.normals [3*v + 1];
+        nz_[v] = surface.normals [3*v + 2];
+    }
+
+    // faces are 1-indexed, as NanoShaper writes them
+    face_x_.resize(num_faces_); face_y_.resize(num_faces_); face_z_.resize(num_faces_);
+
+    for (std::size_t f = 0; f < num_faces_; ++f) {
+        face_x_[f] = surface.triangles[3*f + 0] + 1;
+        face_y_[f] = surface.triangles[3*f + 1] + 1;
+        face_z_[f] = surface.triangles[3*f + 2] + 1;
+    }
+
+    std::cout << "Native surface triangulation on a " << grid.nx << " x " << grid.ny << " x " << grid.nz
+              << " grid: " << num_ << " vertices, " << num_faces_ << " faces." << std::endl;
+}
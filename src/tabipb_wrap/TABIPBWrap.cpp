@@ -17,18 +17,17 @@ struct TABIPBOutput runTABIPBWrapAPBS(struct TABIPBInput tabipbIn, Valist* APBSM
     class Molecule molecule(APBSMolecule, params, timers.molecule);
     
     molecule.compute_coulombic_energy();
-    molecule.build_xyzr_file();
     
     class Particles particles(molecule, params, timers.particles);
     class Tree tree(particles, params, timers.tree);
     
     particles.compute_source_term();
     
-    class Clusters clusters(particles, tree, params, timers.clusters);
+    class InteractionList interaction_list(tree, params, timers.interaction_list);
+    class Clusters clusters(particles, tree, interaction_list, params, timers.clusters);
     
     clusters.compute_all_interp_pts();
     
-    class InteractionList interaction_list(tree, params, timers.interaction_list);
     class BoundaryElement boundary_element(particles, clusters, tree, interaction_list, molecule, 
                             params, timers.boundary_element);
     
@@ -19,4 +19,6 @@ Molecule::Molecule(Valist* APBSMolecule,
         charge_.push_back(Vatom_getCharge(atom));
         radius_.push_back(Vatom_getRadius(atom));
     }
+    
+    kirkwood_energy_ = std::nan("");
 }
@@ -9,27 +9,43 @@ Params::Params(TABIPBInput tabipbIn)
     if (tabipbIn.mesh_flag_ == 1) mesh_ = SES;
     if (tabipbIn.mesh_flag_ == 2) mesh_ = SKIN;
 
+    mesh_generator_ = NANOSHAPER;
     mesh_density_ = tabipbIn.mesh_density_;
     mesh_probe_radius_ = tabipbIn.mesh_probe_radius_;
+    mesh_cache_size_ = 1024.;
+    setup_threads_ = 2;
+    sphere_vertices_ = 2562;
+    checkpoint_interval_ = 1;
+    tune_tol_ = 1e-3;
     
     phys_temp_ = tabipbIn.phys_temp_;
     phys_eps_solute_ = tabipbIn.phys_eps_solute_;
     phys_eps_solvent_ = tabipbIn.phys_eps_solvent_;
     phys_bulk_strength_ = tabipbIn.phys_bulk_strength_;
     
+    engine_ = TREECODE;
+    direct_sample_ = 0;
     tree_degree_ = tabipbIn.tree_degree_;
+    tree_adaptive_degree_ = false;
+    tree_mutual_ = false;
+    tree_task_graph_ = false;
     tree_max_per_leaf_ = tabipbIn.tree_max_per_leaf_;
     tree_theta_ = tabipbIn.tree_theta_;
+    tree_node_layout_ = ARRAYS;
+    particle_layout_ = SOA;
+    kernel_exp_tol_ = 0.;
 
     nonpolar_ = false;
     precondition_ = false;
     
     if (tabipbIn.output_data_ == 1) output_vtk_ = true;
+    output_vtp_ = false;
+    output_vtp_float32_ = false;
     output_csv_ = false;
     output_csv_headers_ = false;
     output_timers_ = false;
+    output_trace_ = false;
+    output_perf_counters_ = false;
     
-    phys_eps_    = phys_eps_solvent_ / phys_eps_solute_;
-    phys_kappa2_ = constants::BULK_COEFF * phys_bulk_strength_ / phys_eps_solvent_ / phys_temp_;
-    phys_kappa_  = std::sqrt(phys_kappa2_);
+    Params::compute_derived_params();
 }
@@ -0,0 +1,152 @@
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#ifdef OPENMP_ENABLED
+    #include <omp.h>
+#endif
+
+#include "task_graph.h"
+
+static double seconds_since(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+
+std::size_t TaskGraph::add(std::function<void()> task)
+{
+    tasks_.push_back(std::move(task));
+    successors_.emplace_back();
+    num_dependencies_.push_back(0);
+
+    return tasks_.size() - 1;
+}
+
+
+void TaskGraph::depend(std::size_t task_idx, std::size_t dependency_idx)
+{
+    successors_[dependency_idx].push_back(task_idx);
+    num_dependencies_[task_idx] += 1;
+}
+
+
+void TaskGraph::execute(std::size_t task_idx)
+{
+    auto begin = std::chrono::steady_clock::now();
+    tasks_[task_idx]();
+
+#ifdef OPENMP_ENABLED
+    busy_[omp_get_thread_num()].seconds += seconds_since(begin);
+
+    for (auto successor_idx : successors_[task_idx]) {
+        if (remaining_[successor_idx].fetch_sub(1) == 1) {
+            #pragma omp task firstprivate(successor_idx)
+            TaskGraph::execute(successor_idx);
+        }
+    }
+#else
+    busy_[0].seconds += seconds_since(begin);
+#endif
+}
+
+
+void TaskGraph::run()
+{
+    std::size_t num_tasks = tasks_.size();
+
+    remaining_.reset(new std::atomic<int>[num_tasks]);
+    for (std::size_t i = 0; i < num_tasks; ++i) remaining_[i] = num_dependencies_[i];
+
+    auto begin = std::chrono::steady_clock::now();
+
+#ifdef OPENMP_ENABLED
+    #pragma omp parallel
+    {
+        #pragma omp single
+        {
+            num_threads_ = omp_get_num_threads();
+            busy_.assign(num_threads_, BusyTime());
+
+            for (std::size_t i = 0; i < num_tasks; ++i) {
+                if (num_dependencies_[i] == 0) {
+                    #pragma omp task firstprivate(i)
+                    TaskGraph::execute(i);
+                }
+            }
+        }
+    }
+#else
+    num_threads_ = 1;
+    busy_.assign(1, BusyTime());
+
+    for (std::size_t i = 0; i < num_tasks; ++i) TaskGraph::execute(i);
+#endif
+
+    wall_time_ = seconds_since(begin);
+
+    busy_time_ = 0.;
+    for (const auto& busy : busy_) busy_time_ += busy.seconds;
+}
+
+
+void TaskGraph::run_on_threads(int num_threads)
+{
+    std::size_t num_tasks = tasks_.size();
+    std::size_t num_done = 0;
+
+    // tasks whose dependencies are done, oldest first
+    std::deque<std::size_t> ready;
+    std::mutex mutex;
+    std::condition_variable task_ready;
+
+    remaining_.reset(new std::atomic<int>[num_tasks]);
+    for (std::size_t i = 0; i < num_tasks; ++i) {
+        remaining_[i] = num_dependencies_[i];
+        if (num_dependencies_[i] == 0) ready.push_back(i);
+    }
+
+    num_threads_ = num_threads;
+    busy_.assign(num_threads_, BusyTime());
+
+    auto worker = [&](int thread_idx) {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            task_ready.wait(lock, [&]() { return !ready.empty() || num_done == num_tasks; });
+            if (ready.empty()) return;
+
+            std::size_t task_idx = ready.front();
+            ready.pop_front();
+            lock.unlock();
+
+            auto begin = std::chrono::steady_clock::now();
+            tasks_[task_idx]();
+            busy_[thread_idx].seconds += seconds_since(begin);
+
+            lock.lock();
+            ++num_done;
+            for (auto successor_idx : successors_[task_idx])
+                if (remaining_[successor_idx].fetch_sub(1) == 1) ready.push_back(successor_idx);
+
+            task_ready.notify_all();
+        }
+    };
+
+    auto begin = std::chrono::steady_clock::now();
+
+    // the calling thread is the first worker of the pool
+    std::vector<std::thread> threads;
+    for (int thread_idx = 1; thread_idx < num_threads; ++thread_idx)
+        threads.emplace_back(worker, thread_idx);
+
+    worker(0);
+    for (auto& thread : threads) thread.join();
+
+    wall_time_ = seconds_since(begin);
+
+    busy_time_ = 0.;
+    for (const auto& busy : busy_) busy_time_ += busy.seconds;
+}
@@ -0,0 +1,60 @@
+#ifndef H_TABIPB_TASK_GRAPH_H
+#define H_TABIPB_TASK_GRAPH_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/* Tasks and the dependencies between them, run as OpenMP tasks: a task is spawned
+ * by whichever thread finishes the last task it depends on, so independent work
+ * never waits behind a phase barrier. A task may only depend on tasks added before
+ * it; without OpenMP the graph then runs in the order it was built.
+ *
+ * run_on_threads instead runs the graph on a pool of its own threads, for tasks that
+ * open parallel regions themselves; with one thread it also runs in build order.
+ *
+ * Each run records the time threads spent inside tasks against the time they were
+ * there for, and the difference is the idle time the dependencies cost. */
+
+class TaskGraph
+{
+private:
+    // one accumulator per thread, padded to its own cache line
+    struct BusyTime
+    {
+        double seconds;
+        char padding[64 - sizeof(double)];
+    };
+
+    std::vector<std::function<void()>> tasks_;
+    std::vector<std::vector<std::size_t>> successors_;
+    std::vector<int> num_dependencies_;
+
+    std::unique_ptr<std::atomic<int>[]> remaining_;
+    std::vector<BusyTime> busy_;
+
+    int num_threads_;
+    double wall_time_;
+    double busy_time_;
+
+    void execute(std::size_t task_idx);
+
+public:
+    TaskGraph() : num_threads_(1), wall_time_(0.), busy_time_(0.) {}
+    ~TaskGraph() = default;
+
+    std::size_t add(std::function<void()> task);
+    void depend(std::size_t task_idx, std::size_t dependency_idx);
+    void run();
+    void run_on_threads(int num_threads);
+
+    std::size_t num_tasks() const { return tasks_.size(); };
+    int num_threads() const { return num_threads_; };
+    double wall_time() const { return wall_time_; };
+    double busy_time() const { return busy_time_; };
+    double idle_time() const { return num_threads_ * wall_time_ - busy_time_; };
+};
+
+#endif /* H_TABIPB_TASK_GRAPH_H */
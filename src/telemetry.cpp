@@ -0,0 +1,167 @@
+#include <iostream>
+#include <fstream>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <signal.h>
+    #include <pthread.h>
+#endif
+
+#include "telemetry.h"
+
+
+#ifdef _WIN32
+
+bool Telemetry::open(const std::string& path)
+{
+    Telemetry::close();
+
+    file_.open(path, std::ios::out | std::ios::trunc);
+
+    if (!file_.is_open()) {
+        std::cout << "Could not open telemetry file " << path
+                  << ", continuing without telemetry." << std::endl;
+        return false;
+    }
+
+    path_ = path;
+    num_dropped_ = 0;
+    start_ = std::chrono::steady_clock::now();
+    last_totals_.clear();
+
+    return true;
+}
+
+
+void Telemetry::close()
+{
+    if (file_.is_open()) file_.close();
+}
+
+
+void Telemetry::write(const std::string& record)
+{
+    if (!file_.is_open()) return;
+
+    // flushed per record, so a reader sees whole lines as they come
+    file_ << record << "\n";
+    file_.flush();
+
+    if (file_.good()) return;
+
+    std::cout << "Telemetry to " << path_ << " stopped (write failed)." << std::endl;
+    Telemetry::close();
+}
+
+
+#else
+
+bool Telemetry::open(const std::string& path)
+{
+    Telemetry::close();
+
+    // without a reader, a nonblocking open of a FIFO fails with ENXIO instead of waiting
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK | O_CLOEXEC, 0644);
+
+    if (fd_ < 0) {
+        std::cout << "Could not open telemetry file " << path << " (" << std::strerror(errno)
+                  << "), continuing without telemetry." << std::endl;
+        return false;
+    }
+
+    path_ = path;
+    num_dropped_ = 0;
+    start_ = std::chrono::steady_clock::now();
+    last_totals_.clear();
+
+    return true;
+}
+
+
+void Telemetry::close()
+{
+    if (fd_ < 0) return;
+
+    ::close(fd_);
+    fd_ = -1;
+
+    if (num_dropped_ > 0)
+        std::cout << "Dropped " << num_dropped_ << " telemetry records not taken by the reader of "
+                  << path_ << "." << std::endl;
+}
+
+
+void Telemetry::write(const std::string& record)
+{
+    if (fd_ < 0) return;
+
+    std::string line = record + "\n";
+
+    // a FIFO whose reader has gone raises SIGPIPE, which is held back here and
+    // taken off again, so that the write just fails with EPIPE
+    sigset_t pipe_set, old_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+    ssize_t written = ::write(fd_, line.data(), line.size());
+    int write_errno = errno;
+
+    if (written < 0 && write_errno == EPIPE) {
+        struct timespec no_wait {0, 0};
+        sigtimedwait(&pipe_set, nullptr, &no_wait);
+    }
+    pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+    errno = write_errno;
+
+    if (written == (ssize_t)line.size()) return;
+
+    // a full pipe drops the record; a vanished reader or a failed file ends the stream
+    if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        ++num_dropped_;
+        return;
+    }
+
+    std::cout << "Telemetry to " << path_ << " stopped ("
+              << (written < 0 ? std::strerror(errno) : "partial write") << ")." << std::endl;
+    Telemetry::close();
+}
+
+
+#endif
+
+
+double Telemetry::elapsed() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+}
+
+
+double Telemetry::delta(std::size_t slot, double total)
+{
+    if (slot >= last_totals_.size()) last_totals_.resize(slot + 1, 0.);
+
+    double change = total - last_totals_[slot];
+    last_totals_[slot] = total;
+
+    return change;
+}
+
+
+long Telemetry::resident_bytes()
+{
+#ifdef _WIN32
+    return -1;
+#else
+    // the second field of statm is the resident size in pages
+    std::ifstream statm("/proc/self/statm");
+    long size = 0, resident = 0;
+
+    if (!(statm >> size >> resident)) return -1;
+
+    return resident * sysconf(_SC_PAGESIZE);
+#endif
+}
@@ -0,0 +1,58 @@
+#ifndef H_TABIPB_TELEMETRY_H
+#define H_TABIPB_TELEMETRY_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstddef>
+
+#ifdef _WIN32
+    #include <fstream>
+#endif
+
+/*  A stream of newline-delimited JSON records, one per GMRES iteration, written to a
+ *  file or a FIFO as the solve runs. Each record goes out in a single nonblocking
+ *  write, so a reader sees whole lines, and a FIFO reader that falls behind costs
+ *  dropped records rather than a stalled solver. A FIFO needs its reader attached
+ *  before the solve starts. On Windows the records go to a plain file stream. */
+
+class Telemetry
+{
+private:
+#ifdef _WIN32
+    std::ofstream file_;
+#else
+    int fd_ = -1;
+#endif
+    std::string path_;
+    std::size_t num_dropped_ = 0;
+
+    std::chrono::steady_clock::time_point start_;
+    std::vector<double> last_totals_;
+
+public:
+    bool open(const std::string& path);
+    void close();
+#ifdef _WIN32
+    bool is_open() const { return file_.is_open(); }
+#else
+    bool is_open() const { return fd_ >= 0; }
+#endif
+
+    void write(const std::string& record);
+
+    // seconds since open, and the change in a running total since the last call for its slot
+    double elapsed() const;
+    double delta(std::size_t slot, double total);
+
+    // resident set size in bytes, or -1 where it cannot be read
+    static long resident_bytes();
+
+    Telemetry() = default;
+    ~Telemetry() { close(); }
+
+    Telemetry(const Telemetry&) = delete;
+    Telemetry& operator=(const Telemetry&) = delete;
+};
+
+#endif /* H_TABIPB_TELEMETRY_H */
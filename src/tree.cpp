@@ -5,12 +5,14 @@
 #include <iomanip>
 #include <cmath>
 
+#include "perf_counters.h"
 #include "tree.h"
 
 Tree::Tree(class Particles& particles, 
            const struct Params& params, struct Timers_Tree& timers)
     : particles_(particles), params_(params), timers_(timers)
 {
+    PERF_SCOPE(TREE);
     timers_.ctor.start();
 
     num_nodes_     = 0;
@@ -28,6 +30,16 @@ Tree::Tree(class Particles& particles,
     auto container_end = std::remove_if(leaves_.begin(), leaves_.end(), [this](std::size_t n)
         {return this->node_num_children_[n] > 0; });
     leaves_.erase(container_end, leaves_.end());
+    
+    packed_nodes_ = nullptr;
+    if (params_.tree_node_layout_ != Params::TreeNodeLayout::ARRAYS)
+        Tree::pack_nodes(params_.tree_node_layout_);
+    
+    timers_.num_nodes     = num_nodes_;
+    timers_.num_leaves    = num_leaves_;
+    timers_.max_depth     = max_depth_;
+    timers_.min_leaf_size = min_leaf_size_;
+    timers_.max_leaf_size = max_leaf_size_;
 
     timers_.ctor.stop();
 }
@@ -111,6 +123,70 @@ void Tree::construct(std::size_t parent, std::size_t current_level,
 }
 
 
+void Tree::pack_nodes(Params::TreeNodeLayout layout)
+{
+    timers_.pack_nodes.start();
+    
+    // Both layouts keep siblings together. BFS stores the tree level by level;
+    // DFS stores a node's children, then the subtree of each child in turn, so
+    // a traversal descending into one subtree stays within a compact range.
+    std::vector<std::size_t> packed_order;
+    packed_order.reserve(num_nodes_);
+    packed_order.push_back(0);
+    
+    if (layout == Params::TreeNodeLayout::PACKED_BFS) {
+        for (std::size_t i = 0; i < packed_order.size(); ++i) {
+            std::size_t node_idx = packed_order[i];
+            for (std::size_t j = 0; j < node_num_children_[node_idx]; ++j)
+                packed_order.push_back(node_children_idx_[8*node_idx + j]);
+        }
+        
+    } else {
+        std::vector<std::size_t> stack {0};
+        while (!stack.empty()) {
+            std::size_t node_idx = stack.back();
+            stack.pop_back();
+            
+            std::size_t num_children = node_num_children_[node_idx];
+            for (std::size_t j = 0; j < num_children; ++j)
+                packed_order.push_back(node_children_idx_[8*node_idx + j]);
+            for (std::size_t j = num_children; j > 0; --j)
+                stack.push_back(node_children_idx_[8*node_idx + j - 1]);
+        }
+    }
+    
+    std::vector<std::size_t> packed_position(num_nodes_);
+    for (std::size_t i = 0; i < num_nodes_; ++i) packed_position[packed_order[i]] = i;
+    
+    // one spare record, so that the first record can be aligned to a cache line
+    packed_nodes_buffer_.resize(num_nodes_ + 1);
+    auto address = reinterpret_cast<std::uintptr_t>(packed_nodes_buffer_.data());
+    auto packed_nodes = reinterpret_cast<TreeNode*>((address + sizeof(TreeNode) - 1)
+                                                    / sizeof(TreeNode) * sizeof(TreeNode));
+    
+    for (std::size_t i = 0; i < num_nodes_; ++i) {
+        std::size_t node_idx = packed_order[i];
+        TreeNode& node = packed_nodes[i];
+        
+        node.x_mid = node_x_mid_[node_idx];
+        node.y_mid = node_y_mid_[node_idx];
+        node.z_mid = node_z_mid_[node_idx];
+        node.radius = node_radius_[node_idx];
+        
+        node.num_particles = node_num_particles_[node_idx];
+        node.node_idx = node_idx;
+        
+        node.num_children = node_num_children_[node_idx];
+        node.first_child = node.num_children ? packed_position[node_children_idx_[8*node_idx]] : 0;
+        node.reserved = 0;
+    }
+    
+    packed_nodes_ = packed_nodes;
+    
+    timers_.pack_nodes.stop();
+}
+
+
 const std::array<double, 12> Tree::node_particle_bounds(std::size_t node_idx) const
 {
     return std::array<double, 12> {node_x_min_[node_idx], node_x_max_[node_idx],
@@ -133,6 +209,15 @@ void Timers_Tree::print() const
     std::cout << "|...Tree function times (s)...." << std::endl;
     std::cout << "|   |...ctor.......................: ";
     std::cout << std::setw(12) << std::right << ctor.elapsed_time() << std::endl;
+    std::cout << "|       |...pack_nodes.............: ";
+    std::cout << std::setw(12) << std::right << pack_nodes.elapsed_time() << std::endl;
+    std::cout << "|" << std::endl;
+    std::cout << "|...Tree shape......................" << std::endl;
+    std::cout << "|   |...nodes......................: " << std::setw(12) << std::right << num_nodes     << std::endl;
+    std::cout << "|   |...leaves.....................: " << std::setw(12) << std::right << num_leaves    << std::endl;
+    std::cout << "|   |...max depth..................: " << std::setw(12) << std::right << max_depth     << std::endl;
+    std::cout << "|   |...min leaf size..............: " << std::setw(12) << std::right << min_leaf_size << std::endl;
+    std::cout << "|   |...max leaf size..............: " << std::setw(12) << std::right << max_leaf_size << std::endl;
     std::cout << "|" << std::endl;
 }
 
@@ -141,6 +226,12 @@ std::string Timers_Tree::get_durations() const
 {
     std::string durations;
     durations.append(std::to_string(ctor.elapsed_time())).append(", ");
+    durations.append(std::to_string(pack_nodes.elapsed_time())).append(", ");
+    durations.append(std::to_string(num_nodes)).append(", ");
+    durations.append(std::to_string(num_leaves)).append(", ");
+    durations.append(std::to_string(max_depth)).append(", ");
+    durations.append(std::to_string(min_leaf_size)).append(", ");
+    durations.append(std::to_string(max_leaf_size)).append(", ");
     
     return durations;
 }
@@ -150,6 +241,12 @@ std::string Timers_Tree::get_headers() const
 {
     std::string headers;
     headers.append("Tree ctor, ");
+    headers.append("Tree pack_nodes, ");
+    headers.append("Tree num_nodes, ");
+    headers.append("Tree num_leaves, ");
+    headers.append("Tree max_depth, ");
+    headers.append("Tree min_leaf_size, ");
+    headers.append("Tree max_leaf_size, ");
     
     return headers;
 }
@@ -2,7 +2,9 @@
 #define H_TABIPB_TREE_STRUCT_H
 
 #include <array>
+#include <vector>
 #include <cstddef>
+#include <cstdint>
 
 #include "timer.h"
 #include "params.h"
@@ -11,6 +13,25 @@
 class InteractionList;
 struct Timers_Tree;
 
+/* The fields read while building interaction lists, packed into one cache line.
+ * Children of a node are stored contiguously, starting at first_child. */
+struct TreeNode
+{
+    double x_mid;
+    double y_mid;
+    double z_mid;
+    double radius;
+    
+    std::uint64_t num_particles;
+    std::uint64_t node_idx;
+    
+    std::uint32_t first_child;
+    std::uint32_t num_children;
+    std::uint64_t reserved;
+};
+
+static_assert(sizeof(TreeNode) == 64, "TreeNode must fill exactly one cache line");
+
 class Tree
 {
 private:
@@ -49,15 +70,24 @@ private:
     std::vector<std::size_t> node_parent_idx_;
     std::vector<std::size_t> node_level_;
     
+    std::vector<TreeNode> packed_nodes_buffer_;
+    const TreeNode* packed_nodes_;
+    
     void construct(std::size_t, std::size_t, std::size_t, std::size_t);
+    void pack_nodes(Params::TreeNodeLayout);
     
 public:
     Tree(class Particles&, const struct Params&, struct Timers_Tree&);
     ~Tree() = default;
     
     std::size_t num_nodes() const { return num_nodes_; };
+    std::size_t num_leaves() const { return num_leaves_; };
+    std::size_t max_depth() const { return max_depth_; };
+    std::size_t min_leaf_size() const { return min_leaf_size_; };
+    std::size_t max_leaf_size() const { return max_leaf_size_; };
     const std::array<double, 12> node_particle_bounds(std::size_t node_idx) const;
     const std::array<std::size_t, 2> node_particle_idxs(std::size_t node_idx) const;
+    std::size_t node_parent_idx(std::size_t node_idx) const { return node_parent_idx_[node_idx]; };
     const std::vector<std::size_t>& leaves() const { return leaves_; }
     
     friend class InteractionList;
@@ -67,6 +97,14 @@ public:
 struct Timers_Tree
 {
     Timer ctor;
+    Timer pack_nodes;
+    
+    // the shape of the last tree built, reported with its times
+    std::size_t num_nodes     = 0;
+    std::size_t num_leaves    = 0;
+    std::size_t max_depth     = 0;
+    std::size_t min_leaf_size = 0;
+    std::size_t max_leaf_size = 0;
     
     void print() const;
     std::string get_durations() const;
@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+
+#include "tree.h"
+#include "interaction_list.h"
+#include "clusters.h"
+#include "boundary_element.h"
+#include "tabipb_timers.h"
+#include "tuner.h"
+
+/*  The tuner times a single matvec for each candidate (tree_degree, tree_theta,
+ *  tree_max_per_leaf) on the real mesh, with the source term as the input vector,
+ *  and measures its error on a fixed sample of rows against a direct sum. A
+ *  candidate's cost is its setup time plus a typical solve's worth of matvecs.
+ *
+ *  Degrees are searched upward. At each degree, theta is lowered from the top of
+ *  its range until the error target is met, and leaf sizes are then tried at that
+ *  theta. The search stops at the first degree whose best candidate is slower
+ *  than the best of the lower degrees. */
+
+static constexpr std::size_t TUNER_NUM_SAMPLES       = 256;
+static constexpr int         TUNER_MAX_DEGREE        = 10;
+static constexpr double      TUNER_MATVECS_PER_SOLVE = 10.;
+
+static const std::vector<double> TUNER_THETAS     = {0.9, 0.8, 0.7, 0.6, 0.5, 0.4, 0.3};
+static const std::vector<int>    TUNER_LEAF_SIZES = {25, 50, 100, 200, 400};
+
+
+double Tuner::Candidate::cost() const
+{
+    return setup_time + TUNER_MATVECS_PER_SOLVE * matvec_time;
+}
+
+
+Tuner::Tuner(const class Particles& particles, const class Molecule& molecule,
+             struct Params& params, struct Timers_Tuner& timers)
+    : particles_(particles), molecule_(molecule), params_(params), timers_(timers)
+{
+    std::size_t num = particles_.num();
+    std::size_t num_samples = std::min(num, TUNER_NUM_SAMPLES);
+
+    // rows are sampled evenly in the original order, which follows the surface
+    for (std::size_t k = 0; k < num_samples; ++k)
+        sample_idxs_.push_back(k * num / num_samples);
+
+    best_ = 0;
+}
+
+
+void Tuner::run()
+{
+    timers_.run.start();
+
+    std::cout << "Tuning tree parameters for a sampled matvec error of "
+              << params_.tune_tol_ << "." << std::endl;
+
+    int base_max_per_leaf = params_.tree_max_per_leaf_;
+    bool found = false;
+
+    for (int degree = 1; degree <= TUNER_MAX_DEGREE; ++degree) {
+
+        std::size_t degree_best = candidates_.size();
+        double theta = -1.;
+
+        for (double trial_theta : TUNER_THETAS) {
+            candidates_.push_back(Tuner::calibrate(degree, trial_theta, base_max_per_leaf));
+            if (candidates_.back().error <= params_.tune_tol_) {
+                theta = trial_theta;
+                degree_best = candidates_.size() - 1;
+                break;
+            }
+            
+            // lower theta only costs more, so stop once this degree cannot win
+            if (found && candidates_.back().cost() >= candidates_[best_].cost()) break;
+        }
+
+        if (theta < 0.) continue;
+
+        for (int max_per_leaf : TUNER_LEAF_SIZES) {
+            if (max_per_leaf == base_max_per_leaf) continue;
+
+            candidates_.push_back(Tuner::calibrate(degree, theta, max_per_leaf));
+            const Candidate& candidate = candidates_.back();
+
+            if (candidate.error <= params_.tune_tol_
+             && candidate.cost() < candidates_[degree_best].cost())
+                degree_best = candidates_.size() - 1;
+        }
+
+        if (found && candidates_[degree_best].cost() >= candidates_[best_].cost()) break;
+
+        best_ = degree_best;
+        found = true;
+    }
+
+    if (!found) {
+        std::cout << "No tested tree parameters meet tune_tol. exiting." << std::endl;
+        std::exit(1);
+    }
+
+    const Candidate& best = candidates_[best_];
+
+    params_.tree_degree_       = best.degree;
+    params_.tree_theta_        = best.theta;
+    params_.tree_max_per_leaf_ = best.max_per_leaf;
+
+    std::cout << "Tuned tree_degree " << best.degree << ", tree_theta " << best.theta
+              << ", tree_max_per_leaf " << best.max_per_leaf << " after "
+              << candidates_.size() << " calibration matvecs." << std::endl;
+
+    timers_.run.stop();
+}
+
+
+Tuner::Candidate Tuner::calibrate(int degree, double theta, int max_per_leaf)
+{
+    params_.tree_degree_       = degree;
+    params_.tree_theta_        = theta;
+    params_.tree_max_per_leaf_ = max_per_leaf;
+
+    // every candidate sorts its own copy of the unsorted particles
+    class Particles particles(particles_);
+    struct Timers timers;
+    Timer setup;
+    Timer matvec;
+
+    setup.start();
+
+    class Tree tree(particles, params_, timers.tree);
+    class InteractionList interaction_list(tree, params_, timers.interaction_list);
+    class Clusters clusters(particles, tree, interaction_list, params_, timers.clusters);
+
+    clusters.copyin_to_device();
+    clusters.compute_all_interp_pts();
+
+    // the boundary element forms its target charges on the device copy of the particles;
+    // the source term is the same for every candidate, so it is left out of the setup time
+    setup.stop();
+
+    particles.copyin_to_device();
+    particles.compute_source_term();
+
+    setup.start();
+
+    class BoundaryElement bem(particles, clusters, tree, interaction_list, molecule_,
+                              params_, timers.boundary_element);
+
+    setup.stop();
+
+    std::size_t num = particles.num();
+    const std::size_t* order = particles.order_ptr();
+
+    std::vector<std::size_t> current_idx(num);
+    for (std::size_t i = 0; i < num; ++i) current_idx[order[i]] = i;
+
+    std::vector<std::size_t> sample_current_idxs;
+    for (auto idx : sample_idxs_) sample_current_idxs.push_back(current_idx[idx]);
+
+    if (reference_.empty()) Tuner::compute_reference(bem, particles, sample_current_idxs);
+
+    std::vector<double> potential(2 * num, 0.);
+
+    matvec.start();
+    bem.matrix_vector(1., particles.source_term_ptr(), 0., potential.data());
+    matvec.stop();
+
+    particles.delete_from_device();
+    clusters.delete_from_device();
+
+    std::size_t num_samples = sample_current_idxs.size();
+    double error_norm2     = 0.;
+    double reference_norm2 = 0.;
+
+    for (std::size_t k = 0; k < num_samples; ++k) {
+        double diff_1 = potential[sample_current_idxs[k]]       - reference_[k];
+        double diff_2 = potential[sample_current_idxs[k] + num] - reference_[k + num_samples];
+
+        error_norm2     += diff_1 * diff_1 + diff_2 * diff_2;
+        reference_norm2 += reference_[k] * reference_[k]
+                         + reference_[k + num_samples] * reference_[k + num_samples];
+    }
+
+    Candidate candidate {degree, theta, max_per_leaf, std::sqrt(error_norm2 / reference_norm2),
+                         setup.elapsed_time(), matvec.elapsed_time()};
+
+    std::ostringstream line;
+    line << "    degree " << std::setw(2) << degree
+         << ", theta " << std::fixed << std::setprecision(2) << theta
+         << ", leaf "  << std::setw(4) << max_per_leaf
+         << ": error " << std::scientific << std::setprecision(3) << candidate.error
+         << ", setup " << std::fixed << std::setprecision(3) << candidate.setup_time
+         << " s, matvec " << candidate.matvec_time << " s";
+    std::cout << line.str() << std::endl;
+
+    return candidate;
+}
+
+
+void Tuner::compute_reference(class BoundaryElement& bem, const class Particles& particles,
+                              const std::vector<std::size_t>& current_idxs)
+{
+    timers_.reference.start();
+
+    bem.direct_sum_rows(particles.source_term_ptr(), current_idxs, reference_);
+
+    timers_.reference.stop();
+}
+
+
+void Tuner::write_params(const std::string& input_file) const
+{
+    timers_.write_params.start();
+
+    std::ifstream input(input_file);
+    std::ofstream output(params_.tune_file_);
+
+    // keep every input line except the tuned and tuning parameters
+    std::string line;
+    while (std::getline(input, line)) {
+
+        std::istringstream iss(line);
+        std::string param_token;
+        iss >> param_token;
+
+        std::transform(param_token.begin(), param_token.end(), param_token.begin(),
+                       [=](unsigned char c){ return std::tolower(c); });
+
+        if (param_token == "tree_degree" || param_token == "tree_theta"
+         || param_token == "tree_max_per_leaf"
+         || param_token == "tune" || param_token == "tune_tol") continue;
+
+        output << line << "\n";
+    }
+
+    const Candidate& best = candidates_[best_];
+
+    output << "tree_degree       " << best.degree       << "\n";
+    output << "tree_theta        " << best.theta        << "\n";
+    output << "tree_max_per_leaf " << best.max_per_leaf << "\n";
+    output.close();
+
+    if (!output.good()) {
+        std::cout << "Could not write tuned parameters to " << params_.tune_file_ << "." << std::endl;
+    } else {
+        std::cout << "Wrote tuned parameters to " << params_.tune_file_ << "." << std::endl;
+    }
+
+    timers_.write_params.stop();
+}
+
+
+void Timers_Tuner::print() const
+{
+    std::cout.setf(std::ios::fixed, std::ios::floatfield);
+    std::cout.precision(5);
+    std::cout << "|...Tuner function times (s)...." << std::endl;
+    std::cout << "|   |...run........................: ";
+    std::cout << std::setw(12) << std::right << run.elapsed_time() << std::endl;
+    std::cout << "|       |...reference..............: ";
+    std::cout << std::setw(12) << std::right << reference.elapsed_time() << std::endl;
+    std::cout << "|   |...write_params...............: ";
+    std::cout << std::setw(12) << std::right << write_params.elapsed_time() << std::endl;
+    std::cout << "|" << std::endl;
+}
+
+
+std::string Timers_Tuner::get_durations() const
+{
+    std::string durations;
+    durations.append(std::to_string(run          .elapsed_time())).append(", ");
+    durations.append(std::to_string(reference    .elapsed_time())).append(", ");
+    durations.append(std::to_string(write_params .elapsed_time())).append(", ");
+
+    return durations;
+}
+
+
+std::string Timers_Tuner::get_headers() const
+{
+    std::string headers;
+    headers.append("Tuner run, ");
+    headers.append("Tuner reference, ");
+    headers.append("Tuner write_params, ");
+
+    return headers;
+}
@@ -0,0 +1,70 @@
+#ifndef H_TABIPB_TUNER_STRUCT_H
+#define H_TABIPB_TUNER_STRUCT_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "timer.h"
+#include "molecule.h"
+#include "particles.h"
+#include "params.h"
+
+class BoundaryElement;
+struct Timers_Tuner;
+
+class Tuner
+{
+private:
+    const class Particles& particles_;
+    const class Molecule& molecule_;
+    struct Params& params_;
+    struct Timers_Tuner& timers_;
+
+    struct Candidate
+    {
+        int degree;
+        double theta;
+        int max_per_leaf;
+
+        double error;
+        double setup_time;
+        double matvec_time;
+
+        double cost() const;
+    };
+
+    std::vector<std::size_t> sample_idxs_;
+    std::vector<double> reference_;
+
+    std::vector<Candidate> candidates_;
+    std::size_t best_;
+
+    Candidate calibrate(int degree, double theta, int max_per_leaf);
+    void compute_reference(class BoundaryElement& bem, const class Particles& particles,
+                           const std::vector<std::size_t>& current_idxs);
+
+public:
+    Tuner(const class Particles&, const class Molecule&, struct Params&, struct Timers_Tuner&);
+    ~Tuner() = default;
+
+    void run();
+    void write_params(const std::string& input_file) const;
+};
+
+
+struct Timers_Tuner
+{
+    Timer run;
+    Timer reference;
+    Timer write_params;
+
+    void print() const;
+    std::string get_durations() const;
+    std::string get_headers() const;
+
+    Timers_Tuner() = default;
+    ~Timers_Tuner() = default;
+};
+
+#endif /* H_TABIPB_TUNER_STRUCT_H */
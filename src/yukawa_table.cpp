@@ -0,0 +1,70 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+#include "yukawa_table.h"
+
+// points checked against std::exp in each interval, besides its two ends
+static constexpr int YUKAWA_CHECK_POINTS = 15;
+
+
+bool YukawaTable::build(double kappa, double r_max, double tolerance)
+{
+    values_.clear();
+    tolerance_ = tolerance;
+    max_error_ = 0.;
+    x_max_     = kappa * r_max;
+
+    // the largest half step whose Taylor remainder stays under the bound
+    double factorial = 1.;
+    for (int k = 2; k <= DEGREE + 1; ++k) factorial *= k;
+
+    double half_step = std::pow(tolerance * factorial, 1. / (DEGREE + 1));
+    while (std::pow(half_step, DEGREE + 1) / factorial * std::exp(half_step) > tolerance)
+        half_step *= 0.99;
+
+    step_     = 2. * half_step;
+    inv_step_ = 1. / step_;
+
+    std::size_t size = (std::size_t)(x_max_ * inv_step_) + 1;
+    if (size > MAX_SIZE) {
+        std::cout << "Tabulating exp(-kappa r) to " << tolerance << " would need " << size
+                  << " entries, more than " << MAX_SIZE << "; using std::exp." << std::endl;
+        return false;
+    }
+
+    values_.resize(size);
+    for (std::size_t i = 0; i < size; ++i) values_[i] = std::exp(-(i + 0.5) * step_);
+
+    Lookup lookup(*this);
+    for (std::size_t i = 0; i < size; ++i) {
+        for (int k = 0; k <= YUKAWA_CHECK_POINTS + 1; ++k) {
+            double x = (i + (double)k / (YUKAWA_CHECK_POINTS + 1)) * step_;
+            double exact = std::exp(-x);
+            max_error_ = std::max(max_error_, std::abs(lookup(x) - exact) / exact);
+        }
+    }
+
+    if (max_error_ > tolerance) {
+        std::cout << "Tabulated exp(-kappa r) has relative error " << max_error_
+                  << ", over the bound of " << tolerance << "; using std::exp." << std::endl;
+        values_.clear();
+        return false;
+    }
+
+    return true;
+}
+
+
+void YukawaTable::print() const
+{
+    std::ostringstream line;
+    line << "Tabulated exp(-kappa r) in " << values_.size() << " intervals up to kappa r = "
+         << std::fixed << std::setprecision(3) << x_max_
+         << ", relative error " << std::scientific << std::setprecision(2) << max_error_
+         << " against std::exp (bound " << tolerance_ << ").";
+
+    std::cout << line.str() << std::endl;
+}
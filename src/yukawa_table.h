@@ -0,0 +1,71 @@
+#ifndef H_TABIPB_YUKAWA_TABLE_H
+#define H_TABIPB_YUKAWA_TABLE_H
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+/* exp(-kappa r), the screening factor of every kernel, tabulated over the distances of
+ * one run. In x = kappa r, entry i holds exp(-x_i) at the midpoint x_i of the i-th
+ * interval of width h, and inside the interval
+ *
+ *     exp(-x) = exp(-x_i) exp(-t),   t = x - x_i,   |t| <= h / 2,
+ *
+ * with exp(-t) replaced by its Taylor polynomial of degree DEGREE. The relative error
+ * is then at most (h/2)^(DEGREE+1) / (DEGREE+1)! exp(h/2), and h is the largest step
+ * that keeps this under the requested bound. Past the end of the table the lookup falls
+ * back to std::exp. */
+
+class YukawaTable
+{
+public:
+    static constexpr int DEGREE = 5;
+    static constexpr std::size_t MAX_SIZE = 1 << 16;
+
+    /* The table as the kernels read it: a pointer and two scalars, cheap to copy */
+    struct Lookup
+    {
+        const double* values;
+        std::size_t size;
+        double step;
+        double inv_step;
+
+        explicit Lookup(const YukawaTable& table)
+            : values(table.values_.data()), size(table.values_.size()),
+              step(table.step_), inv_step(table.inv_step_) {}
+
+        // exp(-x) for x >= 0
+        inline double operator()(double x) const
+        {
+            std::size_t idx = (std::size_t)(x * inv_step);
+            if (idx >= size) return std::exp(-x);
+
+            double t = x - (idx + 0.5) * step;
+            double p = 1. + t * (-1. + t * (1. / 2. + t * (-1. / 6. + t * (1. / 24. + t * (-1. / 120.)))));
+
+            return values[idx] * p;
+        }
+    };
+
+private:
+    std::vector<double> values_;
+    double step_      = 0.;
+    double inv_step_  = 0.;
+    double x_max_     = 0.;
+    double tolerance_ = 0.;
+    double max_error_ = 0.;
+
+public:
+    /* Tabulates exp(-kappa r) for r up to r_max, checks every interval against std::exp,
+     * and returns false, leaving the table empty, if the bound cannot be met */
+    bool build(double kappa, double r_max, double tolerance);
+
+    bool empty() const { return values_.empty(); }
+    std::size_t size() const { return values_.size(); }
+    double tolerance() const { return tolerance_; }
+    double max_error() const { return max_error_; }
+
+    void print() const;
+};
+
+#endif /* H_TABIPB_YUKAWA_TABLE_H */